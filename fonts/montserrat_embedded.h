@@ -0,0 +1,23 @@
+/**
+ * @file montserrat_embedded.h
+ * @brief Embedded font data for Montserrat-VariableFont_wght.ttf
+ */
+
+#ifndef MONTSERRAT_FONT_DATA_H
+#define MONTSERRAT_FONT_DATA_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+// Font data size: 394140 bytes
+extern const uint8_t montserrat_font_data[];
+extern const uint32_t montserrat_font_data_size;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MONTSERRAT_FONT_DATA_H */
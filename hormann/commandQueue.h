@@ -0,0 +1,228 @@
+#ifndef COMMANDQUEUE_H_
+    #define COMMANDQUEUE_H_
+
+        #include <Arduino.h>
+        #include <atomic>
+
+        // Bounded lock-free FIFO between the command producers (MQTT, HTTP, the
+        // engine itself) and the Modbus task, which hands one command at a time to
+        // the master. Multi-producer / multi-consumer ring after D. Vyukov: every
+        // cell carries a sequence number, so push and pop are a single CAS each and
+        // nobody ever blocks the bus task.
+        //
+        // Coalescing rules:
+        //   DOOR  a newer door command supersedes every queued older one. A push
+        //         bumps the door generation once it owns a cell, so a push that finds
+        //         the queue full leaves the queued door command valid. Entries from
+        //         an older generation are discarded when they reach the head; a door
+        //         push into a full queue first reclaims such entries from the head.
+        //   LAMP  lamp toggles are never merged, two toggles must stay two toggles.
+        // Every entry also carries a deadline; a command that was not fetched by the
+        // master in time is discarded instead of moving the door long after the fact.
+
+        #define COMMAND_QUEUE_SIZE 8            // power of two
+        #define COMMAND_DOOR_TTL_MS 5000
+        #define COMMAND_LAMP_TTL_MS 5000
+
+        class HoermannCommand;
+
+        enum class CommandKind : uint8_t {
+            DOOR,
+            LAMP
+        };
+
+        struct CommandQueueStats {
+            uint32_t depth;         // commands still to be executed (superseded ones not counted)
+            uint32_t maxDepth;
+            uint32_t pushed;
+            uint32_t coalesced;     // door commands superseded by a newer one
+            uint32_t expired;       // commands past their deadline
+            uint32_t dropped;       // rejected because the queue was full
+        };
+
+        class CommandQueue {
+        public:
+            CommandQueue() {
+                for (uint32_t i = 0; i < COMMAND_QUEUE_SIZE; i++) {
+                    cells[i].sequence.store(i, std::memory_order_relaxed);
+                }
+            }
+
+            /**
+             * Queue a command, false if the queue is full
+             */
+            bool push(const HoermannCommand *command, CommandKind kind, uint32_t ttlMs) {
+                Entry entry;
+                entry.command = command;
+                entry.kind = kind;
+                entry.queuedAt = millis();
+                entry.deadline = entry.queuedAt + ttlMs;
+
+                uint32_t pos = enqueuePos.load(std::memory_order_relaxed);
+                bool reclaimed = false;
+                for (;;) {
+                    Cell &cell = cells[pos & (COMMAND_QUEUE_SIZE - 1)];
+                    uint32_t seq = cell.sequence.load(std::memory_order_acquire);
+                    int32_t diff = (int32_t)(seq - pos);
+                    if (diff == 0) {
+                        if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                            if (kind == CommandKind::DOOR) {
+                                // the cell is ours, only now may older door commands go stale
+                                entry.generation = doorGeneration.fetch_add(1, std::memory_order_acq_rel) + 1;
+                                doorQueued.fetch_add(1, std::memory_order_relaxed);
+                                liveDoor.store(entry.generation, std::memory_order_relaxed);
+                            }
+                            cell.entry = entry;
+                            cell.sequence.store(pos + 1, std::memory_order_release);
+                            break;
+                        }
+                    } else if (diff < 0) {
+                        if (kind == CommandKind::DOOR && !reclaimed) {
+                            reclaimed = true;
+                            if (reclaimStale()) {
+                                pos = enqueuePos.load(std::memory_order_relaxed);
+                                continue;
+                            }
+                        }
+                        dropped.fetch_add(1, std::memory_order_relaxed);
+                        return false;
+                    } else {
+                        pos = enqueuePos.load(std::memory_order_relaxed);
+                    }
+                }
+
+                pushed.fetch_add(1, std::memory_order_relaxed);
+                uint32_t d = depth();
+                uint32_t m = maxDepth.load(std::memory_order_relaxed);
+                while (d > m && !maxDepth.compare_exchange_weak(m, d, std::memory_order_relaxed)) {
+                }
+                return true;
+            }
+
+            /**
+             * Next command that is still current and within its deadline, nullptr if none
+             * @param waitMs time the returned command spent in the queue
+             */
+            const HoermannCommand *pop(uint32_t *waitMs = nullptr) {
+                Entry entry;
+                while (popEntry(entry)) {
+                    if (discardable(entry)) continue;
+                    if (waitMs != nullptr) *waitMs = millis() - entry.queuedAt;
+                    return entry.command;
+                }
+                return nullptr;
+            }
+
+            /**
+             * Commands still to be executed; superseded door commands still holding a
+             * cell are not counted (a snapshot, exact only while nobody pushes or pops)
+             */
+            uint32_t depth() const {
+                uint32_t total = enqueuePos.load(std::memory_order_relaxed) - dequeuePos.load(std::memory_order_relaxed);
+                uint32_t doors = doorQueued.load(std::memory_order_relaxed);
+                uint32_t stale = doors - (doors > 0 && liveDoor.load(std::memory_order_relaxed) != 0 ? 1 : 0);
+                return total > stale ? total - stale : 0;
+            }
+
+            CommandQueueStats getStats() const {
+                CommandQueueStats stats;
+                stats.depth = depth();
+                stats.maxDepth = maxDepth.load(std::memory_order_relaxed);
+                stats.pushed = pushed.load(std::memory_order_relaxed);
+                stats.coalesced = coalesced.load(std::memory_order_relaxed);
+                stats.expired = expired.load(std::memory_order_relaxed);
+                stats.dropped = dropped.load(std::memory_order_relaxed);
+                return stats;
+            }
+
+        private:
+            struct Entry {
+                const HoermannCommand *command = nullptr;
+                CommandKind kind = CommandKind::DOOR;
+                uint32_t generation = 0;
+                unsigned long queuedAt = 0;
+                unsigned long deadline = 0;
+            };
+            struct Cell {
+                std::atomic<uint32_t> sequence;
+                Entry entry;
+            };
+
+            Cell cells[COMMAND_QUEUE_SIZE];
+            std::atomic<uint32_t> enqueuePos{0};
+            std::atomic<uint32_t> dequeuePos{0};
+            std::atomic<uint32_t> doorGeneration{0};
+            std::atomic<uint32_t> doorQueued{0};        // door entries holding a cell
+            std::atomic<uint32_t> liveDoor{0};          // generation of the queued current door command, 0 if none
+
+            std::atomic<uint32_t> maxDepth{0};
+            std::atomic<uint32_t> pushed{0};
+            std::atomic<uint32_t> coalesced{0};
+            std::atomic<uint32_t> expired{0};
+            std::atomic<uint32_t> dropped{0};
+
+            /**
+             * Superseded or past its deadline; counts it and settles the door bookkeeping
+             */
+            bool discardable(const Entry &entry) {
+                if (entry.kind == CommandKind::DOOR) {
+                    doorQueued.fetch_sub(1, std::memory_order_relaxed);
+                    uint32_t live = entry.generation;
+                    liveDoor.compare_exchange_strong(live, 0, std::memory_order_relaxed);
+                    if (entry.generation != doorGeneration.load(std::memory_order_acquire)) {
+                        coalesced.fetch_add(1, std::memory_order_relaxed);
+                        return true;
+                    }
+                }
+                if ((long)(millis() - entry.deadline) > 0) {
+                    expired.fetch_add(1, std::memory_order_relaxed);
+                    return true;
+                }
+                return false;
+            }
+
+            /**
+             * Take entries off the head as long as they would be discarded anyway
+             * @return true if at least one cell was freed
+             */
+            bool reclaimStale() {
+                bool freed = false;
+                Entry entry;
+                while (popEntry(entry, true)) {
+                    discardable(entry);
+                    freed = true;
+                }
+                return freed;
+            }
+
+            /**
+             * @param staleOnly only take the head if it is superseded or expired; the
+             *        entry is read before the CAS, it cannot change while the cell is full
+             */
+            bool popEntry(Entry &entry, bool staleOnly = false) {
+                uint32_t pos = dequeuePos.load(std::memory_order_relaxed);
+                for (;;) {
+                    Cell &cell = cells[pos & (COMMAND_QUEUE_SIZE - 1)];
+                    uint32_t seq = cell.sequence.load(std::memory_order_acquire);
+                    int32_t diff = (int32_t)(seq - (pos + 1));
+                    if (diff == 0) {
+                        entry = cell.entry;
+                        if (staleOnly && !stale(entry)) return false;
+                        if (dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                            cell.sequence.store(pos + COMMAND_QUEUE_SIZE, std::memory_order_release);
+                            return true;
+                        }
+                    } else if (diff < 0) {
+                        return false;
+                    } else {
+                        pos = dequeuePos.load(std::memory_order_relaxed);
+                    }
+                }
+            }
+
+            bool stale(const Entry &entry) const {
+                if (entry.kind == CommandKind::DOOR && entry.generation != doorGeneration.load(std::memory_order_acquire)) return true;
+                return (long)(millis() - entry.deadline) > 0;
+            }
+        };
+#endif
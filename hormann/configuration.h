@@ -6,11 +6,11 @@
 
     // Station -> set AP_ACTIF to false if you wanna use password from config file
     const bool AP_ACTIF = (bool)true;
-    const char* STA_SSID   = "";
-    const char* STA_PASSWD = "";
-    const char* AP_PASSWD = "tynet.eu";
+    constexpr const char *STA_SSID   = "";
+    constexpr const char *STA_PASSWD = "";
+    constexpr const char *AP_PASSWD = "tynet.eu";
     const char* WWW_USER = "admin";
-    const char* WWW_PASSWD = "";
+    constexpr const char *WWW_PASSWD = "";
 
     //RS485 pins
     #ifdef CONFIG_IDF_TARGET_ESP32S3
@@ -26,11 +26,23 @@
         #define PIN_RXD 16 // UART 2 RXD - G16
     #endif
 
+    // Task plan. The HCI reply window (HCI_REPLY_DEADLINE_US) is the only hard
+    // deadline: the Modbus task gets core 1 and the top priority, everything
+    // else runs on core 0 below the WiFi (23) and lwIP (18) tasks and blocks
+    // instead of spinning, so a slow sensor or a discovery burst can only delay
+    // other background work.
+    const int MODBUS_TASK_CORE = 1;
+    const int MODBUS_TASK_PRIORITY = configMAX_PRIORITIES - 1;
+    const int MQTT_TASK_CORE = 0;
+    const int MQTT_TASK_PRIORITY = 5;       // above async_tcp (3): publishes keep up with the callbacks
+    const int SENSOR_TASK_CORE = 0;
+    const int SENSOR_TASK_PRIORITY = 2;
+
     // MQTT
     #define DEVICE_ID "hcpbridge"
     const char ID_LENGTH = 16;
     const char DEVICENAME[] = "Garage Door";
-    const char *MQTTSERVER = "192.168.1.100";
+    constexpr const char *MQTTSERVER = "192.168.1.100";
     const int MQTTPORT = 1883;
     const char MQTTUSER[] = "mqtt";
     const char MQTTPASSWORD[] = "password";
@@ -59,7 +71,10 @@
     const char* OTA_PASSWD = "admin";
     
     // MQTT
-    const int READ_DELAY = 2000;           // intervall (ms) to update status on mqtt
+    const int POSITION_PUBLISH_HZ = 5;          // max position publishes per second while the door moves, 0 = every change
+    const int STATE_PUBLISH_MIN_INTERVAL = 0;   // minimum time (ms) between two state publishes, 0 = publish every change right away
+    const int HCI_METRICS_INTERVAL = 60000; // intervall (ms) to publish HCI bus metrics on mqtt
+    const int DISCOVERY_PACE_MS = 250;      // time between two discovery messages
 
     #define SENSE_PERIOD 120  //read interval in Seconds of all defined sensors in seconds
 
@@ -67,6 +82,9 @@
     #define hum_threshold 1    //only send mqtt msg when temp,pressure or humidity rises this threshold. set 0 to send every status
     #define pres_threshold 1    //only send mqtt msg when temp,pressure or humidity rises this threshold. set 0 to send every status
     #define prox_treshold 10    //only send mqtt msg when distance change this treshold. Set 0 to send every status
+    #define SENSOR_EWMA_ALPHA 1.0   //smoothing of sensor values before the thresholds are checked, 1 = off, smaller = smoother
+    #define SENSOR_MIN_INTERVAL 5   //minimum seconds between two sensor publishes, changes in between are sent late
+    #define SENSOR_HEARTBEAT 7200   //send the sensor values after this many seconds even without change, 0 = never
 
     //DS18X20
     #define oneWireBus 4     //GPIO where the DS18B20 is connected to
@@ -80,6 +98,7 @@
     #define SR04_TRIGPIN 7
     #define SR04_ECHOPIN 8
     #define SR04_MAXDISTANCECM 150
+    #define SR04_PERIOD_MS 500  //time between two distance measurements in ms
     #define SOUND_SPEED 0.034   //define sound speed in cm/uS
 
     // DHT22
@@ -97,6 +116,7 @@
     #define HA_DISCOVERY_COVER "homeassistant/cover/%s/%s/config"
     #define HA_DISCOVERY_LIGHT "homeassistant/light/%s/%s/config"
     #define HA_DISCOVERY_TEXT "homeassistant/text/%s/%s/config"
+    #define HA_STATUS_TOPIC "homeassistant/status"     // HA birth message, discovery is resent on "online"
 
     // DEBUG
     //#define DEBUG
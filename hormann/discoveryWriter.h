@@ -0,0 +1,141 @@
+#ifndef DISCOVERYWRITER_H_
+    #define DISCOVERYWRITER_H_
+
+        #include <Arduino.h>
+        #include <Print.h>
+
+        // Streaming JSON writer for Home Assistant discovery configs. It writes
+        // straight into any Print: a DigestPrint first, to learn the length (and the
+        // hash of the discovery set), then a BufferPrint over the exact-size buffer
+        // the publish queue takes over. No document tree, no stack buffers.
+        // Topics below the base topic are written as "~/..." (HA expands "~").
+
+        #define FNV_OFFSET 2166136261u
+        #define FNV_PRIME 16777619u
+
+        // Counts and FNV-1a hashes everything written to it
+        class DigestPrint : public Print {
+        public:
+            uint32_t hash = FNV_OFFSET;
+            size_t length = 0;
+
+            size_t write(uint8_t c) override {
+                hash ^= c;
+                hash *= FNV_PRIME;
+                length++;
+                return 1;
+            }
+            void reset() {
+                hash = FNV_OFFSET;
+                length = 0;
+            }
+        };
+
+        // Writes into a fixed buffer, keeps it NUL terminated
+        class BufferPrint : public Print {
+        public:
+            BufferPrint(char *buf, size_t size) : buf(buf), size(size) {
+                buf[0] = '\0';
+            }
+            size_t write(uint8_t c) override {
+                if (length + 1 >= size) return 0;
+                buf[length++] = c;
+                buf[length] = '\0';
+                return 1;
+            }
+
+        private:
+            char *buf;
+            size_t size;
+            size_t length = 0;
+        };
+
+        class DiscoveryWriter {
+        public:
+            /**
+             * @param base topic written as "~", nullptr for none
+             */
+            DiscoveryWriter(Print &out, const char *base) : out(out), base(base) {
+                out.write('{');
+                if (base != nullptr) add("~", base);
+            }
+
+            DiscoveryWriter &add(const char *key, const char *value) {
+                name(key);
+                string(value);
+                return *this;
+            }
+            DiscoveryWriter &add(const char *key, int value) {
+                name(key);
+                out.print(value);
+                return *this;
+            }
+            DiscoveryWriter &add(const char *key, bool value) {
+                name(key);
+                out.print(value ? "true" : "false");
+                return *this;
+            }
+
+            /**
+             * Topic value, abbreviated to "~/..." when it lies below the base topic
+             */
+            DiscoveryWriter &topic(const char *key, const char *value) {
+                size_t len = base != nullptr ? strlen(base) : 0;
+                if (len > 0 && strncmp(value, base, len) == 0 && value[len] == '/') {
+                    name(key);
+                    out.write('"');
+                    out.write('~');
+                    escaped(value + len);
+                    out.write('"');
+                    return *this;
+                }
+                return add(key, value);
+            }
+
+            DiscoveryWriter &open(const char *key) {
+                name(key);
+                out.write('{');
+                first = true;
+                return *this;
+            }
+            DiscoveryWriter &close() {
+                out.write('}');
+                first = false;
+                return *this;
+            }
+
+            void end() {
+                out.write('}');
+            }
+
+        private:
+            Print &out;
+            const char *base;
+            bool first = true;
+
+            void name(const char *key) {
+                if (!first) out.write(',');
+                first = false;
+                string(key);
+                out.write(':');
+            }
+            void string(const char *value) {
+                out.write('"');
+                escaped(value);
+                out.write('"');
+            }
+            void escaped(const char *value) {
+                for (; *value; value++) {
+                    uint8_t c = *value;
+                    if (c == '"' || c == '\\') {
+                        out.write('\\');
+                        out.write(c);
+                    } else if (c < 0x20) {
+                        out.printf("\\u%04x", c);
+                    } else {
+                        out.write(c);
+                    }
+                }
+            }
+        };
+#endif
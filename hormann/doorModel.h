@@ -0,0 +1,180 @@
+#ifndef DOORMODEL_H_
+    #define DOORMODEL_H_
+
+        #include <Arduino.h>
+        #include <Preferences.h>
+        #include "ArduinoJson.h"
+        #include "hciMetrics.h"
+        #include "preferencesKeys.h"
+
+        // Learned door movement model for set_position.
+        // Per direction it keeps the travel speed (position fraction per second) and
+        // the stop latency: time from deciding to stop until the door stands still,
+        // which covers the wait for the next master poll, the simulated key press and
+        // the motor run-down. The stop is issued once the remaining distance is what
+        // the door still travels within that latency. Both figures are learned from
+        // every move (EWMA) by the Modbus task; save() persists them from a task that
+        // may block on flash, never from the bus task.
+
+        #define DOORMODEL_DEFAULT_SPEED 0.066f      // full travel in ~15 s
+        #define DOORMODEL_DEFAULT_LATENCY_MS 600.0f
+        #define DOORMODEL_MAX_LATENCY_MS 3000.0f
+        #define DOORMODEL_ALPHA 0.3f                // EWMA weight of a new observation
+        #define DOORMODEL_SETTLE_MS 1500            // position updates after the stop still count
+        #define DOORMODEL_MIN_SPEED_MS 2000         // shortest run used to learn the speed
+        #define DOORMODEL_MIN_SPEED_TRAVEL 0.1f
+
+        class DoorModel {
+        public:
+            enum Direction {
+                OPENING = 0,
+                CLOSING = 1
+            };
+
+            void load(Preferences *prefs) {
+                this->prefs = prefs;
+                speed[OPENING] = prefs->getFloat(preference_dm_speed_open, DOORMODEL_DEFAULT_SPEED);
+                speed[CLOSING] = prefs->getFloat(preference_dm_speed_close, DOORMODEL_DEFAULT_SPEED);
+                latencyMs[OPENING] = prefs->getFloat(preference_dm_lat_open, DOORMODEL_DEFAULT_LATENCY_MS);
+                latencyMs[CLOSING] = prefs->getFloat(preference_dm_lat_close, DOORMODEL_DEFAULT_LATENCY_MS);
+            }
+
+            /**
+             * Position report while the door moves in direction
+             */
+            void onMoving(Direction direction, float position, unsigned long now) {
+                if (!moving || direction != this->direction) {
+                    // new run, or reversed before it settled
+                    moving = true;
+                    settling = false;
+                    stopIssued = false;
+                    this->direction = direction;
+                    startPosition = position;
+                    startMs = now;
+                }
+                if (!stopIssued) {
+                    lastPosition = position;
+                    lastMs = now;
+                }
+                settlePosition = position;
+            }
+
+            /**
+             * true when a stop issued now lands on target
+             */
+            bool shouldStop(float position, float target) const {
+                float remaining = direction == OPENING ? target - position : position - target;
+                return remaining <= speed[direction] * latencyMs[direction] / 1000.0f;
+            }
+
+            void onStopIssued(float position, float target) {
+                stopIssued = true;
+                stopPosition = position;
+                stopTarget = target;
+            }
+
+            /**
+             * Door reported a non-moving state; the final position may still follow
+             */
+            void onStopped(float position, unsigned long now) {
+                if (!moving) return;
+                moving = false;
+                settling = true;
+                settleSince = now;
+                settlePosition = position;
+            }
+
+            void onSettlePosition(float position) {
+                if (settling) settlePosition = position;
+            }
+
+            /**
+             * Called for every bus frame: finishes a move once the door settled
+             */
+            void tick(unsigned long now) {
+                if (!settling || now - settleSince < DOORMODEL_SETTLE_MS) return;
+                settling = false;
+                learn();
+                stopIssued = false;
+            }
+
+            /**
+             * Write learned values to flash if a move changed them
+             */
+            void save() {
+                if (!dirty || prefs == nullptr) return;
+                dirty = false;
+                prefs->putFloat(preference_dm_speed_open, speed[OPENING]);
+                prefs->putFloat(preference_dm_speed_close, speed[CLOSING]);
+                prefs->putFloat(preference_dm_lat_open, latencyMs[OPENING]);
+                prefs->putFloat(preference_dm_lat_close, latencyMs[CLOSING]);
+            }
+
+            void toJson(JsonObject obj) const {
+                obj["speedOpen"] = speed[OPENING];
+                obj["speedClose"] = speed[CLOSING];
+                obj["latencyOpenMs"] = (int)latencyMs[OPENING];
+                obj["latencyCloseMs"] = (int)latencyMs[CLOSING];
+                obj["moves"] = moves;
+                obj["positionedMoves"] = positionedMoves;
+                obj["lastErrorPct"] = lastErrorPct;
+                obj["meanAbsErrorPct"] = positionedMoves ? absErrorPctSum / positionedMoves : 0.0f;
+                errorTenthPct.toJson(obj.createNestedObject("absErrorTenthPct"));
+            }
+
+        private:
+            Preferences *prefs = nullptr;
+            volatile bool dirty = false;
+            float speed[2] = {DOORMODEL_DEFAULT_SPEED, DOORMODEL_DEFAULT_SPEED};
+            float latencyMs[2] = {DOORMODEL_DEFAULT_LATENCY_MS, DOORMODEL_DEFAULT_LATENCY_MS};
+
+            bool moving = false;
+            Direction direction = OPENING;
+            float startPosition = 0;
+            unsigned long startMs = 0;
+            float lastPosition = 0;         // last report before the stop was issued
+            unsigned long lastMs = 0;
+
+            bool stopIssued = false;
+            float stopPosition = 0;
+            float stopTarget = 0;
+
+            bool settling = false;
+            unsigned long settleSince = 0;
+            float settlePosition = 0;
+
+            uint32_t moves = 0;
+            uint32_t positionedMoves = 0;
+            float lastErrorPct = 0;
+            float absErrorPctSum = 0;
+            LogHistogram errorTenthPct;     // |final - target| in 0.1 % steps
+
+            void learn() {
+                moves++;
+
+                // Speed from the undisturbed part of the run
+                float travel = fabsf(lastPosition - startPosition);
+                unsigned long duration = lastMs - startMs;
+                if (duration >= DOORMODEL_MIN_SPEED_MS && travel >= DOORMODEL_MIN_SPEED_TRAVEL) {
+                    speed[direction] += DOORMODEL_ALPHA * (travel * 1000.0f / duration - speed[direction]);
+                    dirty = true;
+                }
+
+                if (stopIssued) {
+                    // What the door still travelled after the stop decision, as time
+                    float overrun = fabsf(settlePosition - stopPosition);
+                    float observedMs = overrun * 1000.0f / speed[direction];
+                    if (observedMs > DOORMODEL_MAX_LATENCY_MS) observedMs = DOORMODEL_MAX_LATENCY_MS;
+                    latencyMs[direction] += DOORMODEL_ALPHA * (observedMs - latencyMs[direction]);
+                    dirty = true;
+
+                    lastErrorPct = (settlePosition - stopTarget) * 100.0f;
+                    absErrorPctSum += fabsf(lastErrorPct);
+                    errorTenthPct.record((uint32_t)(fabsf(lastErrorPct) * 10.0f + 0.5f));
+                    positionedMoves++;
+                    ESP_LOGI("HCI-BUS", "positioned move: target %.1f%%, final %.1f%%, latency now %d ms",
+                             stopTarget * 100.0f, settlePosition * 100.0f, (int)latencyMs[direction]);
+                }
+            }
+        };
+#endif
@@ -0,0 +1,277 @@
+#ifndef HCIMETRICS_H_
+    #define HCIMETRICS_H_
+
+        #include <Arduino.h>
+        #include "ArduinoJson.h"
+        #include "hciSlave.h"
+
+        // HCI bus health figures. Written only by the Modbus task; HTTP and MQTT
+        // read them without locking (32 bit stores are atomic on the ESP32, a
+        // report may mix two consecutive frames, which is fine for statistics).
+
+        #define HCI_HIST_BUCKETS 24
+        #define HCI_RATE_WINDOW_MS 10000
+        // The master gives up on a slave that has not started its reply by then
+        #define HCI_REPLY_DEADLINE_US 3000
+
+        #define HCI_DEADLINE_LOG 8          // latest misses kept with their context
+        #define HCI_DEADLINE_CULPRITS 6     // distinct task names counted, the rest is "other"
+
+        // Frame type names indexed by HciFrameType
+        constexpr const char *HCI_FRAME_NAMES[] = {"none", "command", "empty", "busscan", "broadcast", "unknown", "crc", "ignored"};
+
+        // Fixed size log2 histogram: bucket 0 holds 0, bucket i holds [2^(i-1), 2^i)
+        class LogHistogram {
+        public:
+            void record(uint32_t value) {
+                uint8_t bucket = value == 0 ? 0 : 32 - __builtin_clz(value);
+                if (bucket >= HCI_HIST_BUCKETS) bucket = HCI_HIST_BUCKETS - 1;
+                buckets[bucket]++;
+                count++;
+                sum += value;
+                if (value > max) max = value;
+                if (count == 1 || value < min) min = value;
+            }
+
+            /**
+             * Upper bound of the bucket holding the p-th percentile (0..100)
+             */
+            uint32_t percentile(uint8_t p) const {
+                if (count == 0) return 0;
+                uint64_t rank = ((uint64_t)count * p + 99) / 100;
+                uint64_t seen = 0;
+                for (uint8_t i = 0; i < HCI_HIST_BUCKETS; i++) {
+                    seen += buckets[i];
+                    if (seen >= rank) {
+                        uint32_t upper = bucketLimit(i);
+                        return upper < max ? upper : max;
+                    }
+                }
+                return max;
+            }
+
+            uint32_t getBucket(uint8_t i) const {
+                return buckets[i];
+            }
+            /**
+             * Upper bound of bucket i
+             */
+            static uint32_t bucketLimit(uint8_t i) {
+                return i == 0 ? 0 : (uint32_t)((1ULL << i) - 1);
+            }
+            uint32_t getCount() const {
+                return count;
+            }
+            uint64_t getSum() const {
+                return sum;
+            }
+
+            void toJson(JsonObject obj) const {
+                obj["count"] = count;
+                obj["min"] = min;
+                obj["max"] = max;
+                obj["avg"] = count ? (uint32_t)(sum / count) : 0;
+                obj["p50"] = percentile(50);
+                obj["p90"] = percentile(90);
+                obj["p99"] = percentile(99);
+                // counts per bucket, bucket i ends at 2^i - 1; trailing empty buckets left out
+                uint8_t last = 0;
+                for (uint8_t i = 0; i < HCI_HIST_BUCKETS; i++) {
+                    if (buckets[i]) last = i + 1;
+                }
+                JsonArray arr = obj.createNestedArray("buckets");
+                for (uint8_t i = 0; i < last; i++) {
+                    arr.add(buckets[i]);
+                }
+            }
+
+        private:
+            uint32_t buckets[HCI_HIST_BUCKETS] = {0};
+            uint32_t count = 0;
+            uint32_t min = 0;
+            uint32_t max = 0;
+            uint64_t sum = 0;
+        };
+
+        struct HciDeadlineMiss {
+            uint32_t atMs = 0;
+            uint32_t latencyUs = 0;
+            HciFrameType type = HciFrameType::NONE;
+            char task[configMAX_TASK_NAME_LEN] = {0};
+        };
+
+        // Every poll whose reply started after HCI_REPLY_DEADLINE_US, with the task
+        // that was running on the other core when the late reply went out. The
+        // Modbus task has core 1 to itself, so what holds it up is core 0 keeping
+        // the cache or interrupts busy (flash writes, long critical sections); the
+        // culprit counts point at the task doing it.
+        class HciDeadlineGuard {
+        public:
+            void record(uint32_t latencyUs, HciFrameType type) {
+                const char *task = otherCoreTask();
+                HciDeadlineMiss &miss = log[next];
+                next = (next + 1) % HCI_DEADLINE_LOG;
+                if (logged < HCI_DEADLINE_LOG) logged++;
+                miss.atMs = millis();
+                miss.latencyUs = latencyUs;
+                miss.type = type;
+                strlcpy(miss.task, task, sizeof(miss.task));
+                count(task);
+            }
+
+            uint8_t culpritCount() const {
+                return culprits;
+            }
+            const char *culpritName(uint8_t i) const {
+                return names[i];
+            }
+            uint32_t culpritMisses(uint8_t i) const {
+                return misses[i];
+            }
+            uint32_t otherMisses() const {
+                return other;
+            }
+
+            void toJson(JsonObject obj) const {
+                JsonObject tasks = obj.createNestedObject("byTask");
+                for (uint8_t i = 0; i < culprits; i++) {
+                    tasks[names[i]] = misses[i];
+                }
+                if (other) tasks["other"] = other;
+                // newest first
+                JsonArray recent = obj.createNestedArray("recent");
+                for (uint8_t i = 1; i <= logged; i++) {
+                    const HciDeadlineMiss &miss = log[(next + HCI_DEADLINE_LOG - i) % HCI_DEADLINE_LOG];
+                    JsonObject entry = recent.createNestedObject();
+                    entry["agoMs"] = millis() - miss.atMs;
+                    entry["latencyUs"] = miss.latencyUs;
+                    entry["type"] = HCI_FRAME_NAMES[(uint8_t)miss.type];
+                    entry["task"] = miss.task;
+                }
+            }
+
+        private:
+            HciDeadlineMiss log[HCI_DEADLINE_LOG];
+            uint8_t next = 0;
+            uint8_t logged = 0;
+            char names[HCI_DEADLINE_CULPRITS][configMAX_TASK_NAME_LEN] = {{0}};
+            uint32_t misses[HCI_DEADLINE_CULPRITS] = {0};
+            uint8_t culprits = 0;
+            uint32_t other = 0;
+
+            static const char *otherCoreTask() {
+                #if portNUM_PROCESSORS > 1
+                    TaskHandle_t task = xTaskGetCurrentTaskHandleForCPU(1 - xPortGetCoreID());
+                    return task != nullptr ? pcTaskGetName(task) : "none";
+                #else
+                    return "none";
+                #endif
+            }
+
+            void count(const char *task) {
+                for (uint8_t i = 0; i < culprits; i++) {
+                    if (strncmp(names[i], task, configMAX_TASK_NAME_LEN) == 0) {
+                        misses[i]++;
+                        return;
+                    }
+                }
+                if (culprits < HCI_DEADLINE_CULPRITS) {
+                    strlcpy(names[culprits], task, configMAX_TASK_NAME_LEN);
+                    misses[culprits++] = 1;
+                } else {
+                    other++;
+                }
+            }
+        };
+
+        class HciMetrics {
+        public:
+            LogHistogram turnaroundUs;      // end of request -> reply handed to the UART
+            LogHistogram pollGapUs;         // between consecutive polls addressed to us
+            LogHistogram commandWaitMs;     // command queued -> fetched by the master
+            HciDeadlineGuard deadlineGuard;
+            uint32_t deadlineMisses = 0;    // replies started after HCI_REPLY_DEADLINE_US, or never
+            uint32_t lostFrames = 0;        // requests addressed to us dropped unanswered
+            uint32_t unknownFrames = 0;
+            uint8_t lastUnknownFc = 0;
+
+            void recordFrame(const HciFrame &frame) {
+                uint8_t type = (uint8_t)frame.type;
+                frames[type]++;
+                windowFrames[type]++;
+
+                if (frame.type == HciFrameType::COMMAND || frame.type == HciFrameType::EMPTY) {
+                    if (lastPollUs != 0) pollGapUs.record(frame.endUs - lastPollUs);
+                    lastPollUs = frame.endUs;
+                } else if (frame.type == HciFrameType::UNKNOWN) {
+                    unknownFrames++;
+                    lastUnknownFc = frame.function;
+                }
+
+                unsigned long now = millis();
+                unsigned long elapsed = now - windowStartMs;
+                if (elapsed >= HCI_RATE_WINDOW_MS) {
+                    for (uint8_t i = 0; i < (uint8_t)HciFrameType::COUNT; i++) {
+                        rates[i] = windowFrames[i] * 1000.0f / elapsed;
+                        windowFrames[i] = 0;
+                    }
+                    windowStartMs = now;
+                }
+            }
+
+            void recordReply(uint32_t latencyUs, HciFrameType type) {
+                turnaroundUs.record(latencyUs);
+                if (latencyUs > HCI_REPLY_DEADLINE_US) {
+                    deadlineMisses++;
+                    deadlineGuard.record(latencyUs, type);
+                }
+            }
+
+            /**
+             * A request that may have been ours was dropped (UART overflow, overrun,
+             * torn frame, CRC error): the master sees a miss, logged as type "none"
+             * with latency 0
+             */
+            void recordLost() {
+                lostFrames++;
+                deadlineMisses++;
+                deadlineGuard.record(0, HciFrameType::NONE);
+            }
+
+            void toJson(JsonObject obj, const HciSlaveStats &bus, uint32_t lineErrors, uint32_t overflows) const {
+                JsonObject fps = obj.createNestedObject("fps");
+                JsonObject total = obj.createNestedObject("frames");
+                for (uint8_t i = 1; i < (uint8_t)HciFrameType::COUNT; i++) {
+                    fps[HCI_FRAME_NAMES[i]] = roundf(rates[i] * 10.0f) / 10.0f;
+                    total[HCI_FRAME_NAMES[i]] = frames[i];
+                }
+
+                JsonObject errors = obj.createNestedObject("errors");
+                errors["crc"] = bus.frames[(uint8_t)HciFrameType::CRC_ERROR];
+                errors["framing"] = lineErrors;
+                errors["overflow"] = overflows + bus.overruns;
+                errors["unknown"] = unknownFrames;
+                errors["lost"] = lostFrames;
+                errors["lastUnknownFc"] = lastUnknownFc;
+
+                obj["deadlineUs"] = HCI_REPLY_DEADLINE_US;
+                obj["deadlineMisses"] = deadlineMisses;
+                deadlineGuard.toJson(obj.createNestedObject("deadlineMissContext"));
+                obj["maxTurnaroundUs"] = bus.maxReplyUs;
+                turnaroundUs.toJson(obj.createNestedObject("turnaroundUs"));
+                pollGapUs.toJson(obj.createNestedObject("pollGapUs"));
+                commandWaitMs.toJson(obj.createNestedObject("commandWaitMs"));
+            }
+
+            uint32_t frameCount(HciFrameType type) const {
+                return frames[(uint8_t)type];
+            }
+
+        private:
+            uint32_t frames[(uint8_t)HciFrameType::COUNT] = {0};
+            uint32_t windowFrames[(uint8_t)HciFrameType::COUNT] = {0};
+            float rates[(uint8_t)HciFrameType::COUNT] = {0};
+            unsigned long windowStartMs = 0;
+            unsigned long lastPollUs = 0;
+        };
+#endif
@@ -0,0 +1,317 @@
+#ifndef HCISLAVE_H_
+    #define HCISLAVE_H_
+
+        #include <Arduino.h>
+        #include <Stream.h>
+
+        // Modbus RTU slave for the Hoermann HCI bus.
+        // Decodes only the frames the Supramatic master sends and answers from
+        // precomputed reply templates: no register map, no callbacks, no heap.
+        // Worst-case work between the last request byte and the reply is one
+        // pass over a <= HCI_MAX_FRAME byte frame plus one over a <= 21 byte reply.
+
+        #define HCI_BAUD 57600
+        #define HCI_CHAR_BITS 11                                    // 8E1: start + 8 data + parity + stop
+        #define HCI_CHAR_US ((HCI_CHAR_BITS * 1000000UL) / HCI_BAUD)
+        #define HCI_FRAME_GAP_US ((HCI_CHAR_US * 7) / 2)            // 3.5 character times, ~670us
+        #define HCI_MAX_FRAME 64
+
+        #define HCI_FC_WRITE_REGS 0x10
+        #define HCI_FC_READWRITE_REGS 0x17
+
+        #define HCI_REG_COMMAND 0x9C41
+        #define HCI_REG_RESPONSE 0x9CB9
+        #define HCI_REG_BROADCAST 0x9D31
+        #define HCI_BROADCAST_REGS 9
+
+        enum class HciFrameType : uint8_t {
+            NONE,       // no complete frame yet
+            COMMAND,    // write 0x9C41 x2, read 0x9CB9 x8: poll for the next key press
+            EMPTY,      // write 0x9C41 x2, read 0x9CB9 x2
+            BUSSCAN,    // write 0x9C41 x3, read 0x9CB9 x5: master enumerating slaves
+            BROADCAST,  // write 0x9D31..: door state broadcast, never answered
+            UNKNOWN,    // addressed to us but not a frame we know
+            CRC_ERROR,
+            IGNORED,    // valid frame for another slave
+            COUNT
+        };
+
+        struct HciFrame {
+            HciFrameType type = HciFrameType::NONE;
+            uint8_t address = 0;
+            uint8_t function = 0;
+            uint16_t writeAddress = 0;
+            uint16_t writeCount = 0;
+            uint16_t readAddress = 0;
+            uint16_t readCount = 0;
+            const uint8_t *data = nullptr;  // written registers, valid until the next poll()
+            unsigned long endUs = 0;        // micros() when the last byte arrived (estimate)
+
+            uint16_t reg(uint8_t i) const {
+                return (uint16_t)(data[2 * i] << 8) | data[2 * i + 1];
+            }
+        };
+
+        struct HciSlaveStats {
+            uint32_t frames[(uint8_t)HciFrameType::COUNT] = {0};
+            uint32_t overruns = 0;          // frames longer than HCI_MAX_FRAME
+            uint32_t lost = 0;              // requests addressed to us dropped unanswered
+            uint32_t lastReplyUs = 0;       // end of request -> reply handed to the UART
+            uint32_t maxReplyUs = 0;
+        };
+
+        class HciSlave {
+        public:
+            void begin(Stream *port, uint8_t slaveId) {
+                static const uint16_t commandRegs[8] = {0x0000, 0x0001, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000};
+                static const uint16_t emptyRegs[2] = {0x0004, 0x0000};
+                static const uint16_t busScanRegs[5] = {0x0000, 0x0005, 0x0430, 0x10FF, 0xA845};
+
+                this->port = port;
+                this->slaveId = slaveId;
+                initTemplate(commandReply, commandRegs, 8);
+                initTemplate(emptyReply, emptyRegs, 2);
+                initTemplate(busScanReply, busScanRegs, 5);
+            }
+
+            /**
+             * Read pending bytes; returns true with frame filled once a complete frame arrived.
+             * Frames with a known layout complete on their last byte, anything else on the
+             * 3.5 character gap, or right away when idle tells that the transport saw the gap.
+             * @param idleEndUs with idle: micros() the transport took for the end of the last
+             *                  byte it holds; frames read in this call are dated back from it
+             *                  by the bytes that follow them. Without idle bytes are dated
+             *                  when they are read.
+             */
+            bool poll(HciFrame &frame, bool idle = false, unsigned long idleEndUs = 0) {
+                unsigned long now = micros();
+                if (rxLen > 0 && now - lastByteUs > HCI_FRAME_GAP_US) {
+                    // Silence on the line: whatever we hold is a whole frame
+                    uint8_t len = rxLen;
+                    if (len >= 4 && !overrun) {
+                        resetRx();
+                        return decode(frame, len, lastByteUs);
+                    }
+                    dropRx();
+                }
+
+                while (port->available() > 0) {
+                    uint8_t c = (uint8_t)port->read();
+                    now = micros();
+                    // A gap inside this loop means poll() came too late for the previous
+                    // frame; only frames of unknown layout can be pending here, drop them.
+                    if (rxLen > 0 && now - lastByteUs > HCI_FRAME_GAP_US) dropRx();
+                    lastByteUs = now;
+
+                    if (rxLen >= HCI_MAX_FRAME) {
+                        if (!overrun) stats.overruns++;
+                        overrun = true;
+                        continue;
+                    }
+                    rx[rxLen++] = c;
+
+                    if (rxLen == expectedLength()) {
+                        uint8_t len = rxLen;
+                        resetRx();
+                        return decode(frame, len, idle ? idleEndUs - port->available() * HCI_CHAR_US : now);
+                    }
+                }
+
+                if (idle && rxLen > 0) {
+                    uint8_t len = rxLen;
+                    if (len >= 4 && !overrun) {
+                        resetRx();
+                        return decode(frame, len, idleEndUs);
+                    }
+                    dropRx();
+                }
+                return false;
+            }
+
+            // Replies return the turnaround in us (end of request -> reply handed to the UART),
+            // 0 when nothing was sent
+            uint32_t replyCommand(const HciFrame &frame, uint16_t reg2, uint16_t reg3) {
+                putReg(commandReply.buf, 2, reg2);
+                putReg(commandReply.buf, 3, reg3);
+                return send(commandReply, frame);
+            }
+
+            uint32_t replyEmpty(const HciFrame &frame) {
+                return send(emptyReply, frame);
+            }
+
+            uint32_t replyBusScan(const HciFrame &frame) {
+                return send(busScanReply, frame);
+            }
+
+            const HciSlaveStats &getStats() const {
+                return stats;
+            }
+
+            static uint16_t crc16(const uint8_t *buf, size_t len, uint16_t crc = 0xFFFF) {
+                while (len--) {
+                    crc = (crc >> 8) ^ crcTable[(crc ^ *buf++) & 0xFF];
+                }
+                return crc;
+            }
+
+        private:
+            // Reply frame prepared at begin(): address, function, byte count, registers, CRC.
+            // Per reply only the counter/command echo in the first two registers (and the
+            // key press registers of COMMAND) are patched, then the CRC is finished from
+            // the header state.
+            struct ReplyTemplate {
+                uint8_t buf[3 + 2 * 8 + 2];
+                uint8_t len = 0;
+                uint16_t headerCrc = 0;
+                uint16_t base[2] = {0, 0};
+            };
+
+            Stream *port = nullptr;
+            uint8_t slaveId = 0;
+            uint8_t rx[HCI_MAX_FRAME];
+            uint8_t rxLen = 0;
+            bool overrun = false;
+            unsigned long lastByteUs = 0;
+            ReplyTemplate commandReply;
+            ReplyTemplate emptyReply;
+            ReplyTemplate busScanReply;
+            HciSlaveStats stats;
+
+            void initTemplate(ReplyTemplate &t, const uint16_t *regs, uint8_t count) {
+                t.buf[0] = slaveId;
+                t.buf[1] = HCI_FC_READWRITE_REGS;
+                t.buf[2] = count * 2;
+                for (uint8_t i = 0; i < count; i++) {
+                    putReg(t.buf, i, regs[i]);
+                }
+                t.len = 3 + count * 2 + 2;
+                t.headerCrc = crc16(t.buf, 3);
+                t.base[0] = regs[0];
+                t.base[1] = regs[1];
+            }
+
+            void resetRx() {
+                rxLen = 0;
+                overrun = false;
+            }
+
+            // Discard a torn or overlong frame; one addressed to us goes unanswered
+            void dropRx() {
+                if (rx[0] == slaveId) stats.lost++;
+                resetRx();
+            }
+
+            // Frame length once enough of the header is in, 0 while unknown
+            uint8_t expectedLength() const {
+                if (rxLen < 2) return 0;
+                if (rx[1] == HCI_FC_READWRITE_REGS && rxLen >= 11) return 11 + rx[10] + 2;
+                if (rx[1] == HCI_FC_WRITE_REGS && rxLen >= 7) return 7 + rx[6] + 2;
+                return 0;
+            }
+
+            bool decode(HciFrame &frame, uint8_t len, unsigned long endUs) {
+                frame = HciFrame();
+                frame.endUs = endUs;
+                frame.address = rx[0];
+                frame.function = rx[1];
+
+                uint16_t crc = crc16(rx, len - 2);
+                if (rx[len - 2] != (crc & 0xFF) || rx[len - 1] != (crc >> 8)) {
+                    frame.type = HciFrameType::CRC_ERROR;
+                } else if (frame.address != slaveId && frame.address != 0) {
+                    frame.type = HciFrameType::IGNORED;
+                } else if (frame.function == HCI_FC_READWRITE_REGS && len >= 13 && rx[10] == getWord(rx + 8) * 2) {
+                    frame.readAddress = getWord(rx + 2);
+                    frame.readCount = getWord(rx + 4);
+                    frame.writeAddress = getWord(rx + 6);
+                    frame.writeCount = getWord(rx + 8);
+                    frame.data = rx + 11;
+                    frame.type = classifyReadWrite(frame);
+                } else if (frame.function == HCI_FC_WRITE_REGS && len >= 9 && rx[6] == getWord(rx + 4) * 2) {
+                    frame.writeAddress = getWord(rx + 2);
+                    frame.writeCount = getWord(rx + 4);
+                    frame.data = rx + 7;
+                    frame.type = frame.writeAddress == HCI_REG_BROADCAST ? HciFrameType::BROADCAST : HciFrameType::UNKNOWN;
+                } else {
+                    frame.type = HciFrameType::UNKNOWN;
+                }
+                stats.frames[(uint8_t)frame.type]++;
+                return true;
+            }
+
+            static HciFrameType classifyReadWrite(const HciFrame &f) {
+                if (f.writeAddress != HCI_REG_COMMAND || f.readAddress != HCI_REG_RESPONSE) return HciFrameType::UNKNOWN;
+                if (f.writeCount == 2 && f.readCount == 8) return HciFrameType::COMMAND;
+                if (f.writeCount == 2 && f.readCount == 2) return HciFrameType::EMPTY;
+                if (f.writeCount == 3 && f.readCount == 5) return HciFrameType::BUSSCAN;
+                return HciFrameType::UNKNOWN;
+            }
+
+            uint32_t send(ReplyTemplate &t, const HciFrame &frame) {
+                if (frame.address != slaveId) return 0;   // bus broadcasts are never answered
+
+                // The master writes counter (high byte) and command (low byte) to 0x9C41;
+                // the reply echoes them OR-ed into the first two response registers.
+                uint16_t written = frame.reg(0);
+                putReg(t.buf, 0, t.base[0] | (written & 0xFF00));
+                putReg(t.buf, 1, t.base[1] | (uint16_t)((written & 0x00FF) << 8));
+
+                uint16_t crc = crc16(t.buf + 3, t.len - 5, t.headerCrc);
+                t.buf[t.len - 2] = crc & 0xFF;
+                t.buf[t.len - 1] = crc >> 8;
+                port->write(t.buf, t.len);
+
+                unsigned long now = micros();
+                stats.lastReplyUs = now - frame.endUs;
+                if (stats.lastReplyUs > stats.maxReplyUs) stats.maxReplyUs = stats.lastReplyUs;
+                return stats.lastReplyUs;
+            }
+
+            static uint16_t getWord(const uint8_t *p) {
+                return (uint16_t)(p[0] << 8) | p[1];
+            }
+            static void putReg(uint8_t *buf, uint8_t i, uint16_t val) {
+                buf[3 + 2 * i] = val >> 8;
+                buf[3 + 2 * i + 1] = val & 0xFF;
+            }
+
+            static const uint16_t crcTable[256];
+        };
+
+        // Modbus CRC16 (polynomial 0xA001, reflected)
+        const uint16_t HciSlave::crcTable[256] = {
+                0x0000, 0xC0C1, 0xC181, 0x0140, 0xC301, 0x03C0, 0x0280, 0xC241,
+                0xC601, 0x06C0, 0x0780, 0xC741, 0x0500, 0xC5C1, 0xC481, 0x0440,
+                0xCC01, 0x0CC0, 0x0D80, 0xCD41, 0x0F00, 0xCFC1, 0xCE81, 0x0E40,
+                0x0A00, 0xCAC1, 0xCB81, 0x0B40, 0xC901, 0x09C0, 0x0880, 0xC841,
+                0xD801, 0x18C0, 0x1980, 0xD941, 0x1B00, 0xDBC1, 0xDA81, 0x1A40,
+                0x1E00, 0xDEC1, 0xDF81, 0x1F40, 0xDD01, 0x1DC0, 0x1C80, 0xDC41,
+                0x1400, 0xD4C1, 0xD581, 0x1540, 0xD701, 0x17C0, 0x1680, 0xD641,
+                0xD201, 0x12C0, 0x1380, 0xD341, 0x1100, 0xD1C1, 0xD081, 0x1040,
+                0xF001, 0x30C0, 0x3180, 0xF141, 0x3300, 0xF3C1, 0xF281, 0x3240,
+                0x3600, 0xF6C1, 0xF781, 0x3740, 0xF501, 0x35C0, 0x3480, 0xF441,
+                0x3C00, 0xFCC1, 0xFD81, 0x3D40, 0xFF01, 0x3FC0, 0x3E80, 0xFE41,
+                0xFA01, 0x3AC0, 0x3B80, 0xFB41, 0x3900, 0xF9C1, 0xF881, 0x3840,
+                0x2800, 0xE8C1, 0xE981, 0x2940, 0xEB01, 0x2BC0, 0x2A80, 0xEA41,
+                0xEE01, 0x2EC0, 0x2F80, 0xEF41, 0x2D00, 0xEDC1, 0xEC81, 0x2C40,
+                0xE401, 0x24C0, 0x2580, 0xE541, 0x2700, 0xE7C1, 0xE681, 0x2640,
+                0x2200, 0xE2C1, 0xE381, 0x2340, 0xE101, 0x21C0, 0x2080, 0xE041,
+                0xA001, 0x60C0, 0x6180, 0xA141, 0x6300, 0xA3C1, 0xA281, 0x6240,
+                0x6600, 0xA6C1, 0xA781, 0x6740, 0xA501, 0x65C0, 0x6480, 0xA441,
+                0x6C00, 0xACC1, 0xAD81, 0x6D40, 0xAF01, 0x6FC0, 0x6E80, 0xAE41,
+                0xAA01, 0x6AC0, 0x6B80, 0xAB41, 0x6900, 0xA9C1, 0xA881, 0x6840,
+                0x7800, 0xB8C1, 0xB981, 0x7940, 0xBB01, 0x7BC0, 0x7A80, 0xBA41,
+                0xBE01, 0x7EC0, 0x7F80, 0xBF41, 0x7D00, 0xBDC1, 0xBC81, 0x7C40,
+                0xB401, 0x74C0, 0x7580, 0xB541, 0x7700, 0xB7C1, 0xB681, 0x7640,
+                0x7200, 0xB2C1, 0xB381, 0x7340, 0xB101, 0x71C0, 0x7080, 0xB041,
+                0x5000, 0x90C1, 0x9181, 0x5140, 0x9301, 0x53C0, 0x5280, 0x9241,
+                0x9601, 0x56C0, 0x5780, 0x9741, 0x5500, 0x95C1, 0x9481, 0x5440,
+                0x9C01, 0x5CC0, 0x5D80, 0x9D41, 0x5F00, 0x9FC1, 0x9E81, 0x5E40,
+                0x5A00, 0x9AC1, 0x9B81, 0x5B40, 0x9901, 0x59C0, 0x5880, 0x9841,
+                0x8801, 0x48C0, 0x4980, 0x8941, 0x4B00, 0x8BC1, 0x8A81, 0x4A40,
+                0x4E00, 0x8EC1, 0x8F81, 0x4F40, 0x8D01, 0x4DC0, 0x4C80, 0x8C41,
+                0x4400, 0x84C1, 0x8581, 0x4540, 0x8701, 0x47C0, 0x4680, 0x8641,
+                0x8201, 0x42C0, 0x4380, 0x8341, 0x4100, 0x81C1, 0x8081, 0x4040,
+        };
+#endif
@@ -0,0 +1,136 @@
+#ifndef HCIUART_H_
+    #define HCIUART_H_
+
+        #include <Arduino.h>
+        #include <Stream.h>
+        #include "driver/uart.h"
+        #include "hciSlave.h"
+
+        // RS485 transport on the ESP-IDF UART driver. The bus task blocks on the
+        // driver's event queue and is woken by the hardware RX timeout, i.e. once
+        // the master went quiet after a frame. No polling, no tick latency.
+        // The end of the frame is dated from that event, not from when its bytes
+        // are read, so reply latency counts everything after the RX timeout.
+        // Exposed as a Stream so HciSlave does not care where its bytes come from.
+
+        #define HCI_UART UART_NUM_2
+        #define HCI_UART_RX_BUFFER 256
+        #define HCI_UART_QUEUE_LEN 16
+        #define HCI_RX_TIMEOUT_SYMBOLS 3                            // character times of silence that end a frame
+        #define HCI_RX_TIMEOUT_US (HCI_RX_TIMEOUT_SYMBOLS * HCI_CHAR_US)
+
+        class HciUart : public Stream {
+        public:
+            bool begin(uart_port_t port, int rxPin, int txPin) {
+                this->port = port;
+
+                uart_config_t config = {};
+                config.baud_rate = HCI_BAUD;
+                config.data_bits = UART_DATA_8_BITS;
+                config.parity = UART_PARITY_EVEN;
+                config.stop_bits = UART_STOP_BITS_1;
+                config.flow_ctrl = UART_HW_FLOWCTRL_DISABLE;
+
+                // TX buffer 0: a reply (<= 21 bytes) always fits the 128 byte hardware FIFO,
+                // so uart_write_bytes() returns as soon as the reply is on its way.
+                esp_err_t err = uart_driver_install(port, HCI_UART_RX_BUFFER, 0, HCI_UART_QUEUE_LEN, &events, 0);
+                if (err == ESP_OK) err = uart_param_config(port, &config);
+                if (err == ESP_OK) err = uart_set_pin(port, txPin, rxPin, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE);
+                if (err == ESP_OK) err = uart_set_rx_timeout(port, HCI_RX_TIMEOUT_SYMBOLS);
+                if (err != ESP_OK) {
+                    ESP_LOGE("HCI-BUS", "uart setup failed: %s", esp_err_to_name(err));
+                    return false;
+                }
+                return true;
+            }
+
+            /**
+             * Block until the UART reports silence after received data
+             * @return false on timeout or once an overflow discarded the pending input
+             */
+            bool waitForFrame(TickType_t timeout = portMAX_DELAY) {
+                uart_event_t event;
+                while (xQueueReceive(events, &event, timeout) == pdTRUE) {
+                    switch (event.type) {
+                        case UART_DATA:
+                            // Chunks delivered because the FIFO filled up belong to a frame still arriving
+                            if (event.timeout_flag) {
+                                eventUs = micros();
+                                return true;
+                            }
+                            break;
+                        case UART_FIFO_OVF:
+                        case UART_BUFFER_FULL:
+                            overflows++;
+                            uart_flush_input(port);
+                            xQueueReset(events);
+                            rxPos = rxEnd = 0;
+                            return false;
+                        case UART_PARITY_ERR:
+                        case UART_FRAME_ERR:
+                            lineErrors++;
+                            break;
+                        default:
+                            break;
+                    }
+                }
+                return false;
+            }
+
+            /**
+             * micros() estimate of when the last byte of the frame ended: the RX timeout
+             * event was taken HCI_RX_TIMEOUT_US of silence after it
+             */
+            unsigned long frameEndUs() const {
+                return eventUs - HCI_RX_TIMEOUT_US;
+            }
+
+            uint32_t getOverflows() const {
+                return overflows;
+            }
+            uint32_t getLineErrors() const {
+                return lineErrors;
+            }
+
+            int available() override {
+                size_t buffered = 0;
+                uart_get_buffered_data_len(port, &buffered);
+                return (rxEnd - rxPos) + buffered;
+            }
+            int read() override {
+                if (rxPos == rxEnd && !fill()) return -1;
+                return rx[rxPos++];
+            }
+            int peek() override {
+                if (rxPos == rxEnd && !fill()) return -1;
+                return rx[rxPos];
+            }
+            size_t write(uint8_t c) override {
+                return write(&c, 1);
+            }
+            size_t write(const uint8_t *buffer, size_t size) override {
+                int written = uart_write_bytes(port, (const char *)buffer, size);
+                return written < 0 ? 0 : written;
+            }
+            void flush() override {
+                uart_wait_tx_done(port, portMAX_DELAY);
+            }
+
+        private:
+            uart_port_t port = HCI_UART;
+            QueueHandle_t events = nullptr;
+            uint8_t rx[HCI_MAX_FRAME];      // bytes taken from the driver in one call
+            uint8_t rxPos = 0;
+            uint8_t rxEnd = 0;
+            unsigned long eventUs = 0;      // RX timeout event taken off the queue
+            uint32_t overflows = 0;
+            uint32_t lineErrors = 0;
+
+            bool fill() {
+                int n = uart_read_bytes(port, rx, sizeof(rx), 0);
+                rxPos = 0;
+                rxEnd = n > 0 ? n : 0;
+                return rxEnd > 0;
+            }
+        };
+#endif
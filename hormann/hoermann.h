@@ -1,18 +1,24 @@
 #ifndef HOERMANN_H_
     #define HOERMANN_H_
-        #define MODBUSRTU_DEBUG 1
 
         #include <Arduino.h>
         #include <Stream.h>
+        #include <stdarg.h>
+        #include <atomic>
         #include "ArduinoJson.h"
-        #include "ModbusRTU.h"
+        #include "hciSlave.h"
+        #include "hciUart.h"
+        #include "commandQueue.h"
+        #include "hciMetrics.h"
+        #include "doorModel.h"
         
         #include "preferencesKeys.h"
         #define SLAVE_ID 2
         #define SIMULATEKEYPRESSDELAYMS 100
         #define DEADREPORTTIMEOUT 60000
 
-        #define RS485 Serial2
+        // Task notification bit sent to the state listener after a change was published
+        #define HOERMANN_NOTIFY_STATE (1 << 0)
 
         // workaround as my Supramatic did not Report the Status 0x0A when it's en vent Position
         // When the door is at position 0x08 and not moving Status get changed to Ventig.
@@ -65,6 +71,36 @@
         const HoermannCommand HoermannCommand::STARTTOGGLELAMP = HoermannCommand(0x0100, 0x0800, 0x0200, 0x0200);
         const HoermannCommand HoermannCommand::WAITING = HoermannCommand(0x0000, 0x0000, 0x0000, 0x0000);
 
+        // State names indexed by HoermannState::State, no String is ever built from them
+        constexpr const char *HOERMANN_STATE_NAMES[] = {
+            "open",         // OPEN
+            "opening",      // OPENING
+            "closed",       // CLOSED
+            "closing",      // CLOSING
+            "open h",       // HALFOPEN
+            "opening v",    // MOVE_VENTING
+            "venting",      // VENT
+            "opening h",    // MOVE_HALF
+            "stopped"       // STOPPED
+        };
+        // Cover state for Home Assistant; STOPPED (nullptr) depends on the position
+        constexpr const char *HOERMANN_COVER_NAMES[] = {
+            "open",         // OPEN
+            "opening",      // OPENING
+            "closed",       // CLOSED
+            "closing",      // CLOSING
+            "open",         // HALFOPEN
+            "opening",      // MOVE_VENTING
+            "open",         // VENT
+            "opening",      // MOVE_HALF
+            nullptr         // STOPPED
+        };
+
+        // Door state. The fields are owned by the Modbus task, which is the only writer,
+        // except gotoPosition: the set_position target is handed in by the MQTT and web
+        // tasks and read by the Modbus task, so it is atomic. After each frame it publishes them with publish() into a seqlock protected
+        // Snapshot; every other task (MQTT, sensors, web server) reads a consistent
+        // copy with snapshot() and detects changes by comparing versions.
         class HoermannState {
         public:
             enum State {
@@ -78,17 +114,49 @@
                 MOVE_HALF,
                 STOPPED
             };
+
+            struct Snapshot {
+                uint32_t version = 0;           // bumps on every published change
+                uint32_t debugVersion = 0;      // bumps on every new debug message
+                float targetPosition = 0;
+                float currentPosition = 0;
+                bool lightOn = false;
+                bool valid = false;
+                State state = CLOSED;
+                const char *translatedState = HOERMANN_STATE_NAMES[CLOSED];
+                const char *coverState = HOERMANN_COVER_NAMES[CLOSED];
+                char debugMessage[64] = "initial";
+
+                /**
+                 * Render the status JSON into buf
+                 * @return length written (truncated to size - 1 if buf is too small)
+                 */
+                size_t toStatusJson(char *buf, size_t size, long responseAge) const {
+                    bool fresh = isFresh(responseAge);
+                    int len = snprintf(buf, size,
+                        "{\"valid\":\"%s\",\"targetPosition\":%d,\"currentPosition\":%d,\"light\":%s,\"state\":\"%s\",\"busResponseAge\":%ld}",
+                        fresh ? "true" : "false",
+                        (int)(this->targetPosition*100),
+                        (int)(this->currentPosition*100),
+                        this->lightOn ? "true" : "false",
+                        this->translatedState,
+                        responseAge);
+                    if (len < 0) return 0;
+                    return (size_t)len < size ? len : size - 1;
+                }
+            };
+
             float targetPosition = 0;
             float currentPosition = 0;
             bool lightOn = false;
             State state = CLOSED;
-            String translatedState = "closed";
-            String coverState = "closed";
-            String debugMessage = "initial";
+            const char *translatedState = HOERMANN_STATE_NAMES[CLOSED];
+            const char *coverState = HOERMANN_COVER_NAMES[CLOSED];
+            char debugMessage[64] = "initial";
+            uint32_t debugVersion = 0;
             unsigned long lastModbusRespone = 0;
-            bool changed = false;
-            bool debMessage = false;
-            float gotoPosition = 0.0f;
+            bool changed = false;               // not yet published, Modbus task only
+            std::atomic<float> gotoPosition{0.0f};  // set_position target, 0 = none
             bool valid = false;
 
             void setTargetPosition(float targetPosition) {
@@ -96,8 +164,17 @@
                 this->changed = true;
             }
             void setGotoPosition(float setPosition) {
-                this->gotoPosition = setPosition;
-                this->changed = true;
+                this->gotoPosition.store(setPosition, std::memory_order_relaxed);
+            }
+            float getGotoPosition() const {
+                return this->gotoPosition.load(std::memory_order_relaxed);
+            }
+            /**
+             * Clear the target once reached, unless another task set a new one meanwhile
+             * @return true if cleared
+             */
+            bool clearGotoPosition(float reached) {
+                return this->gotoPosition.compare_exchange_strong(reached, 0.0f, std::memory_order_relaxed);
             }
             void setCurrentPosition(float currentPosition) {
                 this->currentPosition = currentPosition;
@@ -110,12 +187,13 @@
             void recordModbusResponse() {
                 this->lastModbusRespone = millis();
             }
-            void clearChanged() {
-                this->changed = false;
-            }
-            void clearDebug() {
-                this->debMessage = false;
-                this->debugMessage = "Initial";
+            void setDebug(const char *format, ...) {
+                va_list args;
+                va_start(args, format);
+                vsnprintf(this->debugMessage, sizeof(this->debugMessage), format, args);
+                va_end(args);
+                this->debugVersion++;
+                this->changed = true;
             }
             long responseAge() {
                 if (this->lastModbusRespone == 0) {
@@ -127,6 +205,12 @@
                 }
                 return diff/1000;
             }
+            /**
+             * The bus answered within the last 2 seconds (age from responseAge())
+             */
+            static bool isFresh(long responseAge) {
+                return responseAge >= 0 && responseAge < 2;
+            }
             void setState(State state) {
                 this->state = state;
                 this->translatedState = translateState(state);
@@ -134,83 +218,73 @@
                 this->changed = true;
             }
             void setValid(bool isValid) {
-                this->valid = isValid;
+                if (this->valid != isValid) {
+                    this->valid = isValid;
+                    this->changed = true;
+                }
             }
 
-            //Function not used not clear if it make sense to use.
-            String isValid() {
-                // is valid if age between 0 and 2 second
-                if ((this->responseAge() > 0 && this->responseAge() < 2)) {
-                    return "true";
-                } else {
-                    return "false";
-                }
+            /**
+             * Publish pending changes to readers (Modbus task only)
+             * @return true if something was published
+             */
+            bool publish() {
+                if (!this->changed) return false;
+                this->changed = false;
+
+                uint32_t seq = sequence.load(std::memory_order_relaxed);
+                sequence.store(seq + 1, std::memory_order_relaxed);     // odd: write in progress
+                std::atomic_thread_fence(std::memory_order_release);
+
+                published.version = (seq + 2) / 2;
+                published.debugVersion = this->debugVersion;
+                published.targetPosition = this->targetPosition;
+                published.currentPosition = this->currentPosition;
+                published.lightOn = this->lightOn;
+                published.valid = this->valid;
+                published.state = this->state;
+                published.translatedState = this->translatedState;
+                published.coverState = this->coverState;
+                memcpy(published.debugMessage, this->debugMessage, sizeof(published.debugMessage));
+
+                sequence.store(seq + 2, std::memory_order_release);
+                return true;
             }
 
-            String toStatusJson() {
-                JsonDocument root;
-                root["valid"] = this->isValid();
-                root["targetPosition"] = (int)(this->targetPosition*100);
-                root["currentPosition"] = (int)(this->currentPosition*100);
-                root["light"] = lightOn;
-                root["state"] = translateState(this->state);
-                root["busResponseAge"] = this->responseAge();
+            /**
+             * Consistent copy of the last published state, never blocks the writer
+             */
+            void snapshot(Snapshot &out) const {
+                for (;;) {
+                    uint32_t before = sequence.load(std::memory_order_acquire);
+                    if (before & 1) continue;
+                    memcpy(&out, &published, sizeof(out));
+                    std::atomic_thread_fence(std::memory_order_acquire);
+                    if (sequence.load(std::memory_order_relaxed) == before) return;
+                }
+            }
 
-                String output;
-                serializeJson(root, output);
-                return output;
+            uint32_t version() const {
+                return sequence.load(std::memory_order_acquire) / 2;
             }
 
         private:
-            static String translateState(State stateCode) {
-                switch (stateCode) {
-                    case State::OPENING:
-                        return "opening";
-                    case State::CLOSING:
-                        return "closing";
-                    case State::OPEN:
-                        return "open";
-                    case State::CLOSED:
-                        return "closed";
-                    case State::HALFOPEN:
-                        return "open h";
-                    case State::MOVE_VENTING:
-                        return "opening v";
-                    case State::MOVE_HALF:
-                        return "opening h";
-                    case State::VENT:
-                        return "venting";
-                    default:
-                        return "stopped";
-                }
+            std::atomic<uint32_t> sequence{0};
+            Snapshot published;
+
+            static const char *translateState(State stateCode) {
+                return stateCode <= STOPPED ? HOERMANN_STATE_NAMES[stateCode] : HOERMANN_STATE_NAMES[STOPPED];
             }
-            String translateCoverState(State stateCode) {
-                switch (stateCode) {
-                    case State::OPENING:
-                        return "opening";
-                    case State::CLOSING:
-                        return "closing";
-                    case State::OPEN:
-                        return "open";
-                    case State::CLOSED:
-                        return "closed";
-                    case State::HALFOPEN:
-                        return "open";
-                    case State::MOVE_VENTING:
-                        return "opening";
-                    case State::MOVE_HALF:
-                        return "opening";
-                    case State::VENT:
-                        return "open";
-                    default:
-                        if(this->currentPosition == this->targetPosition && this->currentPosition == 0.0f) {
-                            return "closed";
-                        }else if (this->currentPosition == this->targetPosition && this->currentPosition > 0.0f)
-                        {
-                            return "open";
-                        }else{
-                            return "stopped";
-                        }
+            const char *translateCoverState(State stateCode) {
+                if (stateCode < STOPPED) {
+                    return HOERMANN_COVER_NAMES[stateCode];
+                }
+                if (this->currentPosition == this->targetPosition && this->currentPosition == 0.0f) {
+                    return "closed";
+                } else if (this->currentPosition == this->targetPosition && this->currentPosition > 0.0f) {
+                    return "open";
+                } else {
+                    return "stopped";
                 }
             }
         };
@@ -222,103 +296,177 @@
             HoermannState *state = new HoermannState();
             HoermannGarageEngine(){};
 
-            void setup(Preferences* prefs) {
+            /**
+             * @param config typed settings loaded at boot; the door model keeps its own keys in prefs
+             */
+            void setup(Preferences* prefs, const BridgeConfig &config) {
                 localPrefs = prefs;
-                rs485_pin_txd = localPrefs->getInt(preference_rs485_txd);
-                rs485_pin_rxd = localPrefs->getInt(preference_rs485_rxd);
-                RS485.begin(57600, SERIAL_8E1, rs485_pin_rxd, rs485_pin_txd);
-                mb.begin(&RS485);
-                mb.slave(SLAVE_ID);
+                rs485_pin_txd = config.rs485_txd;
+                rs485_pin_rxd = config.rs485_rxd;
+                doorModel.load(localPrefs);
+                uart.begin(HCI_UART, rs485_pin_rxd, rs485_pin_txd);
+                bus.begin(&uart, SLAVE_ID);
 
                 xTaskCreatePinnedToCore(
                     modbusServeTask, /* Function to implement the task */
                     "ModBusTask",    /* Name of the task */
                     10000,           /* Stack size in words */
                     NULL,            /* Task input parameter */
-                    // 1,  /* Priority of the task */
-                    configMAX_PRIORITIES - 1,
+                    MODBUS_TASK_PRIORITY,
                     &modBusTask, /* Task handle. */
-                    1);          /* Core where the task should run */
+                    MODBUS_TASK_CORE);  /* Core where the task should run */
+            }
+
+            /**
+             * Block until the master finished a frame (UART RX timeout); an overflow
+             * that discarded input counts as a missed request
+             */
+            bool waitForFrame() {
+                uint32_t overflows = uart.getOverflows();
+                bool frame = uart.waitForFrame();
+                if (uart.getOverflows() != overflows) metrics.recordLost();
+                return frame;
+            }
+
+            /**
+             * @param idle the line is known to be quiet (UART RX timeout event), complete
+             *             whatever was received; frames are dated from that event
+             */
+            void handleModbus(bool idle = false) {
+                HciFrame frame;
+                unsigned long endUs = uart.frameEndUs();
+                uint32_t lost = bus.getStats().lost;
+                while (bus.poll(frame, idle, endUs)) {
+                    onFrame(frame);
+                }
+                for (; lost != bus.getStats().lost; lost++) {
+                    metrics.recordLost();
+                }
+            }
+
+            const HciSlaveStats &busStats() const {
+                return bus.getStats();
+            }
 
-                // Required for Write
-                mb.addHreg(0x9C41, 0, 0x03);  // Commands
-                mb.addHreg(0x9D31, 0, 0x09);  // Broadcast
-                // For Read
-                mb.addHreg(0x9CB9, 0, 0x08);  // Internal State (e.g. Button Pressed)
+            const HciUart &busUart() const {
+                return uart;
+            }
 
-                // on Request - Clear/Calc Response data
-                mb.onRequest([this](Modbus::FunctionCode fc, const Modbus::RequestData data) -> Modbus::ResultCode { return this->onRequest(fc, data); });
+            const HciMetrics &busMetrics() const {
+                return metrics;
+            }
 
-                // On Write (update counter in Read Registers)
-                mb.onSet(
-                    HREG(0x9C41 + 0), [this](TRegister *reg, uint16_t val) -> uint16_t { return this->onCounterWrite(reg, val); },
-                    0x01);
-                // Broadcast Changes
-                mb.onSet(
-                    HREG(0x9D31 + 2), [this](TRegister *reg, uint16_t val) -> uint16_t { return this->onCurrentStateChanged(reg, val); },
-                    0x01);
-                mb.onSet(
-                    HREG(0x9D31 + 1), [this](TRegister *reg, uint16_t val) -> uint16_t { return this->onDoorPositonChanged(reg, val); },
-                    0x01);
-                mb.onSet(
-                    HREG(0x9D31 + 6), [this](TRegister *reg, uint16_t val) -> uint16_t { return this->onLampState(reg, val); },
-                    0x01);
+            void busMetricsJson(JsonObject obj) const {
+                metrics.toJson(obj, bus.getStats(), uart.getLineErrors(), uart.getOverflows());
             }
 
-            void handleModbus() {
-                mb.task();
+            void doorModelJson(JsonObject obj) const {
+                doorModel.toJson(obj);
             }
 
             /**
-             * Initialize Response Registers per Request
+             * Persist what the door model learned; writes flash, keep it off the Modbus task
              */
-            Modbus::ResultCode onRequest(Modbus::FunctionCode fc, const Modbus::RequestData data) {
-                this->state->recordModbusResponse();
+            void saveDoorModel() {
+                doorModel.save();
+            }
 
-                // Command Requst (Internal State representation)
-                if (fc == Modbus::FC_READWRITE_REGS && data.regWrite.address == 0x9C41 && data.regWriteCount == 0x02 && data.regRead.address == 0x9CB9 && data.regReadCount == 0x08) {
-                    mb.Reg(HREG(0x9CB9 + 0), (uint16_t)0x0000);
-                    mb.Reg(HREG(0x9CB9 + 1), (uint16_t)0x0001);
-                    setCommandValuesToRead();
-                    // mb.Reg(HREG(0x9CB9+2),(uint16_t)0x0000);
-                    // mb.Reg(HREG(0x9CB9+3),(uint16_t)0x0000);
-                    mb.Reg(HREG(0x9CB9 + 4), (uint16_t)0x0000);
-                    mb.Reg(HREG(0x9CB9 + 5), (uint16_t)0x0000);
-                    mb.Reg(HREG(0x9CB9 + 6), (uint16_t)0x0000);
-                    mb.Reg(HREG(0x9CB9 + 7), (uint16_t)0x0000);
-                }
-                // Empty Command Requst
-                else if (fc == Modbus::FC_READWRITE_REGS && data.regWrite.address == 0x9C41 && data.regWriteCount == 0x02 && data.regRead.address == 0x9CB9 && data.regReadCount == 0x02) {
-                    mb.Reg(HREG(0x9CB9 + 0), (uint16_t)0x0004);
-                    mb.Reg(HREG(0x9CB9 + 1), (uint16_t)0x0000);
-                    ESP_LOGD(TAG_HCI, "executing empty command");
-                }
-                // BusScan
-                else if (fc == Modbus::FC_READWRITE_REGS && data.regWrite.address == 0x9C41 && data.regWriteCount == 0x03 && data.regRead.address == 0x9CB9 && data.regReadCount == 0x05) {
-                    ESP_LOGD(TAG_HCI, "executing busscan");
-                    mb.Reg(HREG(0x9CB9 + 0), (uint16_t)0x0000);
-                    mb.Reg(HREG(0x9CB9 + 1), (uint16_t)0x0005);
-                    mb.Reg(HREG(0x9CB9 + 2), (uint16_t)0x0430);
-                    mb.Reg(HREG(0x9CB9 + 3), (uint16_t)0x10ff);
-                    mb.Reg(HREG(0x9CB9 + 4), (uint16_t)0xa845);
-                } else if (fc == Modbus::FC_WRITE_REGS && data.reg.address == 0x9D31) {
-                    // ESP_LOGD("ON_REQ", "on Status Update (cnt: %d)",data.regCount);
-                } else {
-                    this->state->debugMessage = "unknown function code fc=" + fc;
-                    this->state->debMessage = true;
-                    ESP_LOGW(TAG_HCI, "unknown function code fc=%x", fc);
+            /**
+             * Answer / apply one frame from the master
+             */
+            void onFrame(const HciFrame &frame) {
+                uint16_t reg2;
+                uint16_t reg3;
+
+                metrics.recordFrame(frame);
+                switch (frame.type) {
+                    // Command Request (Internal State representation)
+                    case HciFrameType::COMMAND: {
+                        // Log only after the reply is out, the bus deadline comes first
+                        const char *phase = nextCommandValues(reg2, reg3);
+                        metrics.recordReply(bus.replyCommand(frame, reg2, reg3), frame.type);
+                        if (phase != nullptr) {
+                            ESP_LOGI(TAG_HCI, "command %s %x %x", phase, reg2, reg3);
+                        }
+                        break;
+                    }
+                    // Empty Command Request
+                    case HciFrameType::EMPTY:
+                        metrics.recordReply(bus.replyEmpty(frame), frame.type);
+                        ESP_LOGD(TAG_HCI, "executing empty command");
+                        break;
+                    case HciFrameType::BUSSCAN:
+                        metrics.recordReply(bus.replyBusScan(frame), frame.type);
+                        ESP_LOGD(TAG_HCI, "executing busscan");
+                        break;
+                    case HciFrameType::BROADCAST:
+                        onBroadcast(frame);
+                        break;
+                    case HciFrameType::UNKNOWN:
+                        this->state->setDebug("unknown function code fc=%x", frame.function);
+                        ESP_LOGW(TAG_HCI, "unknown function code fc=%x", frame.function);
+                        break;
+                    case HciFrameType::CRC_ERROR:
+                        if (frame.address == SLAVE_ID) metrics.recordLost();
+                        ESP_LOGD(TAG_HCI, "crc error");
+                        return;
+                    default:
+                        // frame for another slave
+                        return;
                 }
+                doorModel.tick(millis());
+                this->state->recordModbusResponse();
                 this->state->setValid(true);
-                return Modbus::EX_SUCCESS;
+                if (this->state->publish() && stateListener != nullptr) {
+                    xTaskNotify(stateListener, HOERMANN_NOTIFY_STATE, eSetBits);
+                }
+            }
+
+            /**
+             * Wake task with HOERMANN_NOTIFY_STATE whenever a state change was published
+             */
+            void notifyOnChange(TaskHandle_t task) {
+                stateListener = task;
             }
 
             /**
-             * Set the values of the next command to be read from registers
+             * Broadcast on 0x9D31: compare each written register with the last broadcast
              */
-            void setCommandValuesToRead() {
-                uint16_t regPlug2Value = 0x0000;
-                uint16_t regPlug3Value = 0x0000;
+            void onBroadcast(const HciFrame &frame) {
+                for (uint16_t i = 0; i < frame.writeCount; i++) {
+                    uint16_t index = frame.writeAddress - HCI_REG_BROADCAST + i;
+                    if (index >= HCI_BROADCAST_REGS) break;
+                    uint16_t prev = broadcastRegs[index];
+                    uint16_t val = frame.reg(i);
+                    switch (index) {
+                        case 1:
+                            onDoorPositonChanged(prev, val);
+                            break;
+                        case 2:
+                            onCurrentStateChanged(prev, val);
+                            break;
+                        case 6:
+                            onLampState(prev, val);
+                            break;
+                    }
+                    broadcastRegs[index] = val;
+                }
+            }
 
+            /**
+             * Values of the next command to be read from registers 0x9CB9+2 and +3
+             * @return "start" / "dispose" when a command phase is sent, nullptr otherwise
+             */
+            const char *nextCommandValues(uint16_t &regPlug2Value, uint16_t &regPlug3Value) {
+                regPlug2Value = 0x0000;
+                regPlug3Value = 0x0000;
+
+                // Take the next command once the previous one was fully sent
+                if (nextCommand == nullptr) {
+                    uint32_t waitMs;
+                    nextCommand = commandQueue.pop(&waitMs);
+                    if (nextCommand != nullptr) metrics.commandWaitMs.record(waitMs);
+                }
                 // Command was set
                 if (nextCommand != nullptr) {
                     // But not yet sent
@@ -326,49 +474,55 @@
                         // Send it
                         regPlug2Value = nextCommand->commandRegPlus2Value;
                         regPlug3Value = nextCommand->commandRegPlus3Value;
-                        ESP_LOGI(TAG_HCI, "command start %x %x", regPlug2Value, regPlug3Value);
                         commandWrittenOn = millis();
+                        return "start";
                         // It was written and it can be cleared
                     } else if (commandWrittenOn != 0 && (commandWrittenOn + SIMULATEKEYPRESSDELAYMS) < millis()) {
                         regPlug2Value = nextCommand->commandEndPlus2Value;
                         regPlug3Value = nextCommand->commandEndPlus3Value;
-                        ESP_LOGI(TAG_HCI, "command dispose %x %x", regPlug2Value, regPlug3Value);
                         // Reset Variables
                         commandWrittenOn = 0;
                         nextCommand = nullptr;
+                        return "dispose";
                     }
                 }
-                mb.Reg(HREG(0x9CB9 + 2), regPlug2Value);
-                mb.Reg(HREG(0x9CB9 + 3), regPlug3Value);
+                return nullptr;
             }
 
             /**
              * Write on 0x9D31+1 , byte1: target, byte2: current
              */
-            uint16_t onDoorPositonChanged(TRegister *reg, uint16_t val) {
+            void onDoorPositonChanged(uint16_t prev, uint16_t val) {
                 // on First Byte changed (current)
-                if ((reg->value & 0x00FF) != (val & 0x00FF)) {
-                    this->state->setCurrentPosition((float)(val & 0x00FF)/200.0f);
-                    if ((this->state->gotoPosition > 0.0f && this->state->state == HoermannState::State::CLOSING && this->state->gotoPosition >= this->state->currentPosition) ||
-                        (this->state->gotoPosition > 0.0f && this->state->state == HoermannState::State::OPENING && this->state->gotoPosition <= this->state->currentPosition)) {
-                        this->stopDoor();
-                        this->state->setGotoPosition(0.0f);
+                if ((prev & 0x00FF) != (val & 0x00FF)) {
+                    float position = (float)(val & 0x00FF)/200.0f;
+                    this->state->setCurrentPosition(position);
+                    HoermannState::State moving = this->state->state;
+                    if (moving == HoermannState::State::OPENING || moving == HoermannState::State::CLOSING) {
+                        doorModel.onMoving(moving == HoermannState::State::OPENING ? DoorModel::OPENING : DoorModel::CLOSING, position, millis());
+                        // Stop ahead of the target by what the door travels until the stop takes effect
+                        float gotoPosition = this->state->getGotoPosition();
+                        if (gotoPosition > 0.0f && doorModel.shouldStop(position, gotoPosition)
+                            && this->state->clearGotoPosition(gotoPosition)) {
+                            setCommand(true, &HoermannCommand::STARTSTOPDOOR);
+                            doorModel.onStopIssued(position, gotoPosition);
+                        }
+                    } else {
+                        doorModel.onSettlePosition(position);
                     }
                 }
                 // on Second Byte changed (target)
-                if ((reg->value & 0xFF00) != (val & 0xFF00)) {
+                if ((prev & 0xFF00) != (val & 0xFF00)) {
                     this->state->setTargetPosition((float)((val & 0xFF00) >> 8)/200.0f);
                 }
-
-                return val;
             }
             /**
              * Write on 0x9D31+2 , byte1: current state
              */
-            uint16_t onCurrentStateChanged(TRegister *reg, uint16_t val) {
+            void onCurrentStateChanged(uint16_t prev, uint16_t val) {
                 // on First Byte changed
-                if (((reg->value & 0xFF00) != (val & 0xFF00))) {
-                    ESP_LOGI(TAG_HCI, "onCurrentStateChanged. address=%x, value=%x (actual: %x)", reg->address.address, val, (val & 0xFF00) >> 8);
+                if (((prev & 0xFF00) != (val & 0xFF00))) {
+                    ESP_LOGI(TAG_HCI, "onCurrentStateChanged. address=%x, value=%x (actual: %x)", HCI_REG_BROADCAST + 2, val, (val & 0xFF00) >> 8);
 
                     switch ((val & 0xFF00) >> 8) {
                         case 0x1:
@@ -405,55 +559,53 @@
                         default:
                             ESP_LOGW(TAG_HCI, "unknown State %x", (val & 0xFF00) >> 8);
                     }
+                    if (this->state->state != HoermannState::State::OPENING && this->state->state != HoermannState::State::CLOSING) {
+                        doorModel.onStopped(this->state->currentPosition, millis());
+                    }
                 }
-                return val;
             }
 
             /**
              * Write on 0x9D31+6 , byte2: Lamp State
              */
-            uint16_t onLampState(TRegister *reg, uint16_t val) {
+            void onLampState(uint16_t prev, uint16_t val) {
                 // On second byte changed
-                if ((reg->value & 0x00FF) != (val & 0x00FF)) {
-                    ESP_LOGI(TAG_HCI, "onLampState. address=%x, value=%x", reg->address.address, val);
+                if ((prev & 0x00FF) != (val & 0x00FF)) {
+                    ESP_LOGI(TAG_HCI, "onLampState. address=%x, value=%x", HCI_REG_BROADCAST + 6, val);
                     // 14 .. from docs (a indicator for automatic state maby?)
                     // 10 .. on after turn on
                     // 04 .. shut down after inactivy
                     // 00 .. off after turn off
                     this->state->setLigthOn((val & 0x00FF) == 0x14 || (val & 0x00FF) == 0x10);
                 }
-                return val;
             }
 
             /**
-             * Write on 0x9C41 , byte1: counter, byte2: command
-             */
-            uint16_t onCounterWrite(TRegister *reg, uint16_t val) {
-                uint16_t counter = val & 0xFF00;
-                uint16_t command = (val & 0x00FF) << 8;
-                mb.Reg(HREG(0x9CB9 + 0), mb.Reg(HREG(0x9CB9 + 0)) | counter);
-                mb.Reg(HREG(0x9CB9 + 1), mb.Reg(HREG(0x9CB9 + 1)) | command);
-                return val;
-            }
-
-            /**
-             * Helper to set next Command and *not* skip Current Command before end was sent
+             * Helper to queue a Command; the Modbus task sends it after the current one
              */
             void setCommand(bool cond, const HoermannCommand *command) {
                 if (cond) {
-                    if (nextCommand != nullptr) {
-                        ESP_LOGW(TAG_HCI, "Last Command was not yet fetched by modbus!");
-                    } else {
-                        nextCommand = command;
+                    bool lamp = command == &HoermannCommand::STARTTOGGLELAMP;
+                    if (!commandQueue.push(command,
+                                           lamp ? CommandKind::LAMP : CommandKind::DOOR,
+                                           lamp ? COMMAND_LAMP_TTL_MS : COMMAND_DOOR_TTL_MS)) {
+                        ESP_LOGW(TAG_HCI, "Command queue full, command dropped!");
                     }
                 }
             }
 
+            CommandQueueStats commandQueueStats() const {
+                return commandQueue.getStats();
+            }
+
             /**
              * Control Functions
+             * Called from the MQTT, web server and Modbus tasks: they decide on the published snapshot
              */
             void stopDoor() {
-                setCommand(this->state->state == HoermannState::State::CLOSING || this->state->state == HoermannState::State::OPENING, &HoermannCommand::STARTSTOPDOOR);
+                HoermannState::Snapshot current;
+                this->state->snapshot(current);
+                setCommand(current.state == HoermannState::State::CLOSING || current.state == HoermannState::State::OPENING, &HoermannCommand::STARTSTOPDOOR);
             }
             void closeDoor() {
                 setCommand(true, &HoermannCommand::STARTCLOSEDOOR);
@@ -462,8 +614,10 @@
                 setCommand(true, &HoermannCommand::STARTOPENDOOR);
             }
             void toogleDoor() {
-                setCommand(this->state->currentPosition < 1, &HoermannCommand::STARTOPENDOOR);
-                setCommand(this->state->currentPosition >= 1, &HoermannCommand::STARTCLOSEDOOR);
+                HoermannState::Snapshot current;
+                this->state->snapshot(current);
+                setCommand(current.currentPosition < 1, &HoermannCommand::STARTOPENDOOR);
+                setCommand(current.currentPosition >= 1, &HoermannCommand::STARTCLOSEDOOR);
             }
             void halfPositionDoor() {
                 setCommand(true, &HoermannCommand::STARTOPENDOORHALF);
@@ -472,7 +626,9 @@
                 setCommand(true, &HoermannCommand::STARTVENTPOSITION);
             }
             void turnLight(bool on) {
-                setCommand((on && !this->state->lightOn) || (!on && this->state->lightOn), &HoermannCommand::STARTTOGGLELAMP);
+                HoermannState::Snapshot current;
+                this->state->snapshot(current);
+                setCommand((on && !current.lightOn) || (!on && current.lightOn), &HoermannCommand::STARTTOGGLELAMP);
             }
             void toogleLight() {
                 setCommand(true, &HoermannCommand::STARTTOGGLELAMP);
@@ -484,15 +640,24 @@
                 else if (setPosition >= 95)
                     openDoor();
                 else if ((setPosition > 5) && (setPosition < 95)) {
-                    this->state->setGotoPosition(static_cast<float>(setPosition)/100.0f);
-                    setCommand(this->state->currentPosition < this->state->gotoPosition, &HoermannCommand::STARTOPENDOOR);
-                    setCommand(this->state->currentPosition > this->state->gotoPosition, &HoermannCommand::STARTCLOSEDOOR);
+                    HoermannState::Snapshot current;
+                    this->state->snapshot(current);
+                    float gotoPosition = static_cast<float>(setPosition)/100.0f;
+                    this->state->setGotoPosition(gotoPosition);
+                    setCommand(current.currentPosition < gotoPosition, &HoermannCommand::STARTOPENDOOR);
+                    setCommand(current.currentPosition > gotoPosition, &HoermannCommand::STARTCLOSEDOOR);
                 }
             }
 
         private:
-            ModbusRTU mb;                                  // ModbusRTU instance, the man behind the curtain
-            const HoermannCommand *nextCommand = nullptr;  // Next Command to transmit
+            HciUart uart;                                  // RS485 UART, event driven
+            HciSlave bus;                                  // HCI bus slave, the man behind the curtain
+            HciMetrics metrics;                            // Bus timing and health
+            DoorModel doorModel;                           // Learned speed / stop latency for set_position
+            volatile TaskHandle_t stateListener = nullptr; // Publisher woken on state changes
+            uint16_t broadcastRegs[HCI_BROADCAST_REGS] = {0};  // Last broadcast from the master
+            CommandQueue commandQueue;                     // Commands waiting for the master
+            const HoermannCommand *nextCommand = nullptr;  // Command being transmitted
             unsigned long commandWrittenOn = 0;            // When was last command written (wait 100ms before end of command is transmitted)
         };
 
@@ -503,9 +668,11 @@
         }
 
         void modbusServeTask(void *parameter) {
+            // Sleeps on the UART event queue: no CPU between frames, no tick latency
             while (true) {
-                hoermannEngine->handleModbus();
-                vTaskDelay(1);
+                if (hoermannEngine->waitForFrame()) {
+                    hoermannEngine->handleModbus(true);
+                }
             }
             vTaskDelete(NULL);
         }
@@ -11,84 +11,59 @@ extern "C" {
 #include "ArduinoJson.h"
 
 #include "hoermann.h"
+#include "publishQueue.h"
+#include "stateSerializer.h"
+#include "discoveryWriter.h"
+#include "metricsWriter.h"
 #include "preferencesKeys.h"
+#include "sensorDrivers.h"
+#include "sensorReport.h"
 #include "../WebUI/index_html.h"
-
-#ifdef USE_DS18X20
-  #include <OneWire.h>
-  #include <DallasTemperature.h>
-#endif
-
-#ifdef USE_BME
-  #include <Wire.h>
-  #include <Adafruit_Sensor.h>
-  #include <Adafruit_BME280.h>
-#endif
-
-#ifdef USE_DHT22
-  #include <Adafruit_Sensor.h>
-  #include <DHT.h>
-#endif
 #include <WiFi.h>
 
 // webserver on port 80
 AsyncWebServer server(80);
+// live door state for dashboards (Server-Sent Events)
+AsyncEventSource events("/events");
 
 #ifdef SENSORS
-  int     sensor_prox_tresh   = 0;
-  float  sensor_temp_thresh  = 0;
-  int     sensor_hum_thresh   = 0;
-  int     sensor_pres_thresh  = 0;
-  int     sensor_last_update  = 0;
-  int     sensor_force_update_intervall = 7200000;    // force sending sensor updates after amount of time since last update
+  SensorScheduler sensorScheduler;
+  SensorReportSet sensorReports;
 #endif
-
-
 #ifdef USE_DS18X20
-  // Setup a oneWire instance to communicate with any OneWire devices
-  DallasTemperature *ds18x20 = nullptr;
+  Ds18x20Sensor ds18x20Sensor;
+  SensorReport ds18x20TempReport("ds18x20", "temp");
   float ds18x20_temp = -99.99;
-  float ds18x20_last_temp = -99.99;
-  int ds18x20_pin = 0;
 #endif
 #ifdef USE_BME
-  TwoWire I2CBME = TwoWire(0);
-  Adafruit_BME280 bme;
-  unsigned bme_status;
+  Bme280Sensor bmeSensor;
+  SensorReport bmeTempReport("bme280", "temp");
+  SensorReport bmeHumReport("bme280", "hum");
+  SensorReport bmePresReport("bme280", "pres");
   float bme_temp = -99.99;
-  float bme_last_temp = -99.99;
   float bme_hum = -99.99;
-  float bme_last_hum = -99.99;
   float bme_pres = -99.99;
-  float bme_last_pres = -99.99;
   int i2c_onoffpin = 0;
-  int i2c_sdapin = 0;
-  int i2c_sclpin = 0;
 #endif
 
 #ifdef USE_HCSR04
-  long hcsr04_duration = -99.99;
+  Hcsr04Sensor hcsr04Sensor;
+  SensorReport hcsr04DistReport("hcsr04", "dist");
+  SensorReport hcsr04FreeReport("hcsr04", "free");
   int hcsr04_distanceCm = 0;
-  int hcsr04_lastdistanceCm = 0;
-  int hcsr04_maxdistanceCm = 150;
   bool hcsr04_park_available = false;
-  bool hcsr04_lastpark_available = false;
-  int hcsr04_tgpin = 0;
-  int hscr04_ecpin = 0;
 #endif
 
 #ifdef USE_DHT22
-  DHT *dht = nullptr;
+  Dht22Sensor dhtSensor;
+  SensorReport dhtTempReport("dht22", "temp");
+  SensorReport dhtHumReport("dht22", "hum");
   float dht22_temp = -99.99;
-  float dht22_last_temp = -99.99;
   float dht22_hum = -99.99;
-  float dht22_last_hum = -99.99;
-  int dht_data_pin = 0;
 #endif
 
 #ifdef USE_HCSR501
-  int hcsr501stat = 0;
-  bool hcsr501_laststat = false;
+  MotionSensor motionSensor;
 #endif
 
 // sensors
@@ -97,6 +72,18 @@ bool new_sensor_data = false;
 // mqtt
 volatile bool mqttConnected;
 AsyncMqttClient mqttClient;
+PublishQueue publishQueue;      // every outgoing message, sent by mqttTask only
+TaskHandle_t mqttTask = nullptr;
+struct {
+  uint32_t connects;
+  uint32_t disconnects;
+} mqttSessions;
+
+// mqttTask notification bits (HOERMANN_NOTIFY_STATE comes from the engine, PUBLISH_NOTIFY from the publish queue)
+#define NOTIFY_SENSOR (1 << 1)
+#define NOTIFY_CONNECTED (1 << 3)
+#define NOTIFY_DISCOVERY (1 << 4)
+
 TimerHandle_t mqttReconnectTimer;
 TimerHandle_t wifiReconnectTimer;
 
@@ -106,10 +93,12 @@ char lastCommandPayload[64];
 HoermannState::State lastDoorState;
 
 PreferenceHandler prefHandler;
-Preferences *localPrefs = nullptr;
+Preferences *localPrefs = nullptr;       // keys the bridge keeps itself, see preferencesKeys.h
+const BridgeConfig &config = prefHandler.config();
 
 class MqttStrings {    
   public:         
+    char base_topic [64];
     char availability_topic [64];
     char state_topic [64];
     char cmd_topic [64];
@@ -122,6 +111,7 @@ class MqttStrings {
     char step_topic [64];
     char sensor_topic [64];
     char debug_topic [64];
+    char hci_topic [64];
     String st_availability_topic;
     String st_state_topic;
     String st_cmd_topic;
@@ -136,6 +126,7 @@ class MqttStrings {
     String st_step_topic;
     String st_sensor_topic;
     String st_debug_topic;   
+    String st_hci_topic;
 };
 MqttStrings mqttStrings;
 
@@ -160,7 +151,8 @@ const char *ToHA(bool value)
 }
 
 void setuptMqttStrings(){
-  String ftopic = "hormann/" + localPrefs->getString(preference_gd_id);
+  String ftopic = String("hormann/") + config.gd_id;
+  strcpy(mqttStrings.base_topic, ftopic.c_str());
   mqttStrings.st_availability_topic = ftopic + "/availability";
   mqttStrings.st_state_topic = ftopic + "/state";
   mqttStrings.st_cmd_topic = ftopic + "/command";
@@ -175,6 +167,7 @@ void setuptMqttStrings(){
   mqttStrings.st_step_topic = mqttStrings.st_cmd_topic  + "/step";
   mqttStrings.st_sensor_topic = ftopic + "/sensor";
   mqttStrings.st_debug_topic = ftopic + "/debug";
+  mqttStrings.st_hci_topic = ftopic + "/hci";
 
   strcpy(mqttStrings.availability_topic, mqttStrings.st_availability_topic.c_str());
   strcpy(mqttStrings.state_topic, mqttStrings.st_state_topic.c_str());
@@ -188,6 +181,7 @@ void setuptMqttStrings(){
   strcpy(mqttStrings.step_topic, mqttStrings.st_step_topic.c_str());
   strcpy(mqttStrings.sensor_topic, mqttStrings.st_sensor_topic.c_str());
   strcpy(mqttStrings.debug_topic, mqttStrings.st_debug_topic.c_str());
+  strcpy(mqttStrings.hci_topic, mqttStrings.st_hci_topic.c_str());
 }
 void IRAM_ATTR reset_button_change(){
   if (digitalRead(0) == 0)
@@ -218,10 +212,10 @@ void switchLamp(bool on){
 }
 
 void connectToWifi() {
-  if (localPrefs->getString(preference_wifi_ssid) != "")
+  if (config.wifi_ssid[0] != '\0')
   {
     Serial.println("Connecting to Wi-Fi...");
-    WiFi.begin(localPrefs->getString(preference_wifi_ssid).c_str(), localPrefs->getString(preference_wifi_password).c_str(), 0, nullptr, true);
+    WiFi.begin(config.wifi_ssid, config.wifi_pass, 0, nullptr, true);
   } else
   {
     Serial.println("No WiFi Client enabled");
@@ -236,6 +230,7 @@ void connectToMqtt()
 void onMqttDisconnect(AsyncMqttClientDisconnectReason reason)
 {
   mqttConnected = false;
+  mqttSessions.disconnects++;
   #ifdef DEBUG
   switch (reason) {
     case AsyncMqttClientDisconnectReason::TCP_DISCONNECTED: 
@@ -273,47 +268,125 @@ void onMqttDisconnect(AsyncMqttClientDisconnectReason reason)
 }
 
 void onMqttPublish(uint16_t packetId){
+  if (packetId == discoveryLastPacket.load()){
+    discoveryLastAcked.store(true);
+  }
+  // frees an inflight slot and wakes mqttTask to send what waited for it
+  publishQueue.onAck();
 }
 
-void updateDoorStatus(bool forceUpate = false)
+HoermannState::Snapshot publishedState;
+unsigned long lastPositionPublish = 0;
+struct {
+  uint32_t state;       // full state publishes
+  uint32_t position;    // pos_topic publishes
+  uint32_t deferred;    // position-only changes held back while moving
+  uint32_t unchanged;   // changes that left the payloads byte-identical
+} doorPublishes;
+
+// state_topic payload, laid out once in setupStatePayload()
+FixedPayload<7, 192> statePayload;
+CachedText<8> positionPayload;
+struct {
+  uint8_t valid;
+  uint8_t position;
+  uint8_t lamp;
+  uint8_t doorstate;
+  uint8_t detailedState;
+  uint8_t vent;
+  uint8_t half;
+} stateFields;
+
+uint8_t widest(const char *const *names, size_t count, uint8_t width = 0)
 {
-  // onyl send updates when state changed
-  if (hoermannEngine->state->changed || forceUpate){
-    hoermannEngine->state->clearChanged();
-    JsonDocument doc;
-    char payload[1024];
-    const char *venting = HA_CLOSE;
-    const char *half = HA_CLOSE;
-
-    doc["valid"] = hoermannEngine->state->valid;
-    doc["doorposition"] = (int)(hoermannEngine->state->currentPosition * 100);
-    doc["lamp"] = ToHA(hoermannEngine->state->lightOn);
-    doc["doorstate"] = hoermannEngine->state->coverState;
-    doc["detailedState"] = hoermannEngine->state->translatedState;
-    if (hoermannEngine->state->translatedState == HA_VENT){
-      venting = HA_VENT;
+  for (size_t i = 0; i < count; i++){
+    if (names[i] != nullptr && strlen(names[i]) > width){
+      width = strlen(names[i]);
     }
-    doc["vent"] = venting;
-    
-    if (hoermannEngine->state->translatedState == HA_HALFOPEN){
-      half = HA_HALF;
+  }
+  return width;
+}
+
+void setupStatePayload()
+{
+  const char *lamp[] = {HA_ON, HA_OFF};
+  const char *vent[] = {HA_CLOSE, HA_VENT};
+  const char *half[] = {HA_CLOSE, HA_HALF};
+  stateFields.valid = statePayload.field("valid", 5, false);
+  stateFields.position = statePayload.field("doorposition", 3, false);
+  stateFields.lamp = statePayload.field("lamp", widest(lamp, 2), true);
+  // STOPPED has no table entry, its cover state is closed/open/stopped
+  stateFields.doorstate = statePayload.field("doorstate", widest(HOERMANN_COVER_NAMES, HoermannState::State::STOPPED + 1, strlen("stopped")), true);
+  stateFields.detailedState = statePayload.field("detailedState", widest(HOERMANN_STATE_NAMES, HoermannState::State::STOPPED + 1), true);
+  stateFields.vent = statePayload.field("vent", widest(vent, 2), true);
+  stateFields.half = statePayload.field("half", widest(half, 2), true);
+  statePayload.finish();
+}
+
+bool isMoving(HoermannState::State state)
+{
+  return state == HoermannState::State::OPENING || state == HoermannState::State::CLOSING ||
+         state == HoermannState::State::MOVE_VENTING || state == HoermannState::State::MOVE_HALF;
+}
+
+// Publish the door state when it changed. While the door moves, changes of the
+// position alone go out at most POSITION_PUBLISH_HZ times per second; every other
+// change (state, lamp, validity, stop) is sent right away with the latest position.
+// Only the fields of the cached payloads are patched; a payload whose bytes did not
+// change is not published again.
+// Returns the ms until a held back position is due, 0 if nothing is pending.
+unsigned long updateDoorStatus(bool forceUpate = false)
+{
+  HoermannState::Snapshot state;
+  hoermannEngine->state->snapshot(state);
+
+  // onyl send updates when state changed
+  if (state.version == publishedState.version && !forceUpate){
+    return 0;
+  }
+
+  bool positionOnly = state.state == publishedState.state && state.lightOn == publishedState.lightOn &&
+                      state.valid == publishedState.valid && state.coverState == publishedState.coverState &&
+                      state.targetPosition == publishedState.targetPosition;
+  if (positionOnly && !forceUpate && POSITION_PUBLISH_HZ > 0 && isMoving(state.state)){
+    unsigned long period = 1000 / POSITION_PUBLISH_HZ;
+    unsigned long since = millis() - lastPositionPublish;
+    if (since < period){
+      doorPublishes.deferred++;
+      return period - since;
     }
-    doc["half"] = half;
+  }
 
-    serializeJson(doc, payload);
-    mqttClient.publish(mqttStrings.state_topic, 1, true, payload);
+  publishedState = state;
+  int position = (int)(state.currentPosition * 100);
+  statePayload.setBool(stateFields.valid, state.valid);
+  statePayload.setInt(stateFields.position, position);
+  statePayload.setText(stateFields.lamp, ToHA(state.lightOn));
+  statePayload.setText(stateFields.doorstate, state.coverState);
+  statePayload.setText(stateFields.detailedState, state.translatedState);
+  statePayload.setText(stateFields.vent, state.state == HoermannState::State::VENT ? HA_VENT : HA_CLOSE);
+  statePayload.setText(stateFields.half, state.state == HoermannState::State::HALFOPEN ? HA_HALF : HA_CLOSE);
+
+  if (statePayload.take() || forceUpate){
+    publishQueue.push(mqttStrings.state_topic, statePayload.c_str(), 1, true, PublishPriority::STATE);
+    doorPublishes.state++;
+  } else {
+    doorPublishes.unchanged++;
+  }
 
-    sprintf(payload, "%d", (int)(hoermannEngine->state->currentPosition * 100));
-    mqttClient.publish(mqttStrings.pos_topic, 1, true, payload);
+  char payload[8];
+  sprintf(payload, "%d", position);
+  if (positionPayload.take(payload) || forceUpate){
+    publishQueue.push(mqttStrings.pos_topic, payload, 1, true, PublishPriority::STATE);
+    doorPublishes.position++;
+    lastPositionPublish = millis();
   }
+  return 0;
 }
 
 void updateSensors(bool forceUpate = false){
   #ifdef SENSORS
-    if (millis()-sensor_last_update >= sensor_force_update_intervall) {
-      forceUpate = true;
-    }
-    
+    // when to send is decided by the sensor task (sensorReports)
     if (new_sensor_data || forceUpate) {
       new_sensor_data = false;
       JsonDocument doc;    //2048 needed because of BME280 float values!
@@ -347,8 +420,7 @@ void updateSensors(bool forceUpate = false){
         doc["hum"] = buf;
       #endif
       serializeJson(doc, payload);
-      mqttClient.publish(mqttStrings.sensor_topic, 0, false, payload);  //uint16_t publish(const char* topic, uint8_t qos, bool retain, const char* payload = nullptr, size_t length = 0)
-      sensor_last_update = millis();
+      publishQueue.push(mqttStrings.sensor_topic, payload, 0, false, PublishPriority::SENSOR);
     }
   #endif
 }
@@ -390,7 +462,9 @@ void onMqttMessage(char *topic, char *payload, AsyncMqttClientMessageProperties
     }
     else if (strncmp(payload, HA_STEP, len) == 0){
       Serial.println("STEPPING...");
-      HoermannState::State currState = hoermannEngine->state->state;
+      HoermannState::Snapshot state;
+      hoermannEngine->state->snapshot(state);
+      HoermannState::State currState = state.state;
       Serial.println(currState);
       // Step between open/stop/close
       if(currState == HoermannState::State::CLOSED) {
@@ -412,12 +486,18 @@ void onMqttMessage(char *topic, char *payload, AsyncMqttClientMessageProperties
   else if (strcmp(mqttStrings.setpos_topic, topic) == 0){
     hoermannEngine->setPosition(atoi(lastCommandPayload));
   }
+  else if (strcmp(HA_STATUS_TOPIC, topic) == 0){
+    // Home Assistant (re)started and asks for discovery; a retained birth would hit every connect
+    if (strncmp(payload, HA_ONLINE, len) == 0 && !properties.retain){
+      xTaskNotify(mqttTask, NOTIFY_DISCOVERY, eSetBits);
+    }
+  }
 
 }
 
 void sendOnline()
 {
-  mqttClient.publish(mqttStrings.availability_topic, 0, true, HA_ONLINE);
+  publishQueue.push(mqttStrings.availability_topic, HA_ONLINE, 0, true, PublishPriority::STATE);
 }
 
 void setWill()
@@ -430,299 +510,398 @@ void sendDebug(char *key, String value)
   JsonDocument doc;
   char payload[1024];
   doc["reset-reason"] = esp_reset_reason();
-  doc["debug"] = hoermannEngine->state->debugMessage;
+  HoermannState::Snapshot state;
+  hoermannEngine->state->snapshot(state);
+  doc["debug"] = state.debugMessage;
   serializeJson(doc, payload);
-  mqttClient.publish(mqttStrings.debug_topic, 0, false, payload);  //uint16_t publish(const char* topic, uint8_t qos, bool retain, const char* payload = nullptr, size_t length = 0)
+  publishQueue.push(mqttStrings.debug_topic, payload, 0, false, PublishPriority::DIAGNOSTIC);
+}
+
+void sendHciMetrics()
+{
+  JsonDocument doc;
+  char payload[2560];
+  hoermannEngine->busMetricsJson(doc.to<JsonObject>());
+  serializeJson(doc, payload);
+  publishQueue.push(mqttStrings.hci_topic, payload, 0, false, PublishPriority::DIAGNOSTIC);
+}
+
+// Discovery is only sent when the set changed since the last time (FNV-1a hash over
+// every topic and payload, kept in Preferences) or when Home Assistant asks for it.
+// The hash is saved only once the whole set went out and the broker acked its last
+// message; a drop, an eviction or a reconnect before that leaves it cleared, so the
+// next connect sends the set again.
+// Configs use HA's abbreviated keys and "~" for the base topic. Every config carries the
+// full device block: HA may see any of them first, e.g. when a retained one was lost.
+bool discoveryHashOnly = false;     // sendDiscoveryMessage() only hashes
+DigestPrint discoveryDigest;
+struct {
+  uint32_t sent;        // discovery sets queued
+  uint32_t confirmed;   // sets that reached the broker completely
+  uint32_t skipped;     // connects that found the set unchanged
+  uint32_t messages;    // discovery messages in the set
+  uint32_t bytes;       // payload bytes of the set
+} discoveryStats;
+struct {
+  uint32_t hash;        // of the set waiting for confirmation
+  uint32_t lost;        // publishQueue.getLost(DISCOVERY) when it was queued
+  bool active;
+} discoveryPending;    // mqttTask only
+std::atomic<uint16_t> discoveryLastPacket{0};   // packet id of the last discovery message sent
+std::atomic<bool> discoveryLastAcked{false};
+struct {
+  const char *id;       // prefix of the unique ids and discovery topics
+  const char *name;     // also the device identifier
+} discoveryDevice;
+
+void writeDevice(DiscoveryWriter &w)
+{
+  w.open("dev").add("ids", discoveryDevice.name);
+  w.add("name", discoveryDevice.name);
+  w.add("sw", HA_VERSION);
+  w.add("mdl", "Garage Door");
+  w.add("mf", "Hörmann");
+  w.close();
 }
 
-void sendDiscoveryMessageForBinarySensor(const char name[], const char topic[], const char key[], const char off[], const char on[], const JsonDocument& device)
+void writeAvailability(DiscoveryWriter &w)
 {
+  w.topic("avty_t", mqttStrings.availability_topic);
+  w.add("pl_avail", HA_ONLINE);
+  w.add("pl_not_avail", HA_OFFLINE);
+}
+
+// Stream one config: measured and hashed first, then written into discoveryPayload
+// and copied by the publish queue. mqttTask only.
+#define DISCOVERY_PAYLOAD_MAX 1536
+char discoveryPayload[DISCOVERY_PAYLOAD_MAX];
 
+template <typename Body>
+void emitDiscovery(const char *topic, Body body)
+{
+  discoveryDigest.print(topic);
+  size_t start = discoveryDigest.length;
+  DiscoveryWriter digest(discoveryDigest, mqttStrings.base_topic);
+  body(digest);
+  writeDevice(digest);
+  digest.end();
+  size_t length = discoveryDigest.length - start;
+  discoveryStats.messages++;
+  discoveryStats.bytes += length;
+
+  if (!discoveryHashOnly){
+    if (length < sizeof(discoveryPayload)){
+      BufferPrint buffer(discoveryPayload, sizeof(discoveryPayload));
+      DiscoveryWriter w(buffer, mqttStrings.base_topic);
+      body(w);
+      writeDevice(w);
+      w.end();
+      publishQueue.push(topic, discoveryPayload, 1, true, PublishPriority::DISCOVERY);
+    } else {
+      ESP_LOGE("MQTT", "discovery config %s too long (%u bytes)", topic, (unsigned)length);
+      discoveryPending.active = false;    // the set can never be complete
+    }
+  }
+}
+
+void sendDiscoveryMessageForBinarySensor(const char name[], const char topic[], const char key[], const char off[], const char on[])
+{
   char full_topic[64];
-  sprintf(full_topic, HA_DISCOVERY_BIN_SENSOR, localPrefs->getString(preference_gd_id), key);
+  sprintf(full_topic, HA_DISCOVERY_BIN_SENSOR, discoveryDevice.id, key);
 
   char uid[64];
-  sprintf(uid, "%s_binary_sensor_%s", localPrefs->getString(preference_gd_id), key);
+  sprintf(uid, "%s_binary_sensor_%s", discoveryDevice.id, key);
 
   char vtemp[64];
   sprintf(vtemp, "{{ value_json.%s }}", key);
 
-  JsonDocument doc;
-
-  doc["name"] = name;
-  doc["state_topic"] = topic;
-  doc["availability_topic"] = mqttStrings.availability_topic;
-  doc["payload_available"] = HA_ONLINE;
-  doc["payload_not_available"] = HA_OFFLINE;
-  doc["unique_id"] = uid;
-  doc["value_template"] = vtemp;
-  doc["payload_on"] = on;
-  doc["payload_off"] = off;
-  doc["device"] = device;
-
-  char payload[1024];
-  serializeJson(doc, payload);
-  //-//Serial.write(payload);
-  mqttClient.publish(full_topic, 1, true, payload);
+  emitDiscovery(full_topic, [&](DiscoveryWriter &w){
+    w.add("name", name);
+    w.topic("stat_t", topic);
+    writeAvailability(w);
+    w.add("uniq_id", uid);
+    w.add("val_tpl", vtemp);
+    w.add("pl_on", on);
+    w.add("pl_off", off);
+  });
 }
 
-void sendDiscoveryMessageForAVSensor(const JsonDocument& device)
+void sendDiscoveryMessageForAVSensor()
 {
   char full_topic[64];
-  sprintf(full_topic, HA_DISCOVERY_AV_SENSOR, localPrefs->getString(preference_gd_id));
+  sprintf(full_topic, HA_DISCOVERY_AV_SENSOR, discoveryDevice.id);
 
   char uid[64];
-  sprintf(uid, "%s_sensor_availability", localPrefs->getString(preference_gd_id));
-  JsonDocument doc;
-
-  doc["name"] = localPrefs->getString(preference_gd_avail);
-  doc["state_topic"] = mqttStrings.availability_topic;
-  doc["unique_id"] = uid;
-  doc["device"] = device;
+  sprintf(uid, "%s_sensor_availability", discoveryDevice.id);
 
-  char payload[1024];
-  serializeJson(doc, payload);
-  //-//Serial.write(payload);
-  mqttClient.publish(full_topic, 1, true, payload);
+  emitDiscovery(full_topic, [&](DiscoveryWriter &w){
+    w.add("name", config.gd_avail);
+    w.topic("stat_t", mqttStrings.availability_topic);
+    w.add("uniq_id", uid);
+  });
 }
 
-void sendDiscoveryMessageForSensor(const char name[], const char topic[], const char key[], const JsonDocument& device, const char device_class[] = "", const char unit[] = "")
+void sendDiscoveryMessageForSensor(const char name[], const char topic[], const char key[], const char device_class[] = "", const char unit[] = "")
 {
-
   char full_topic[64];
-  sprintf(full_topic, HA_DISCOVERY_SENSOR, localPrefs->getString(preference_gd_id), key);
+  sprintf(full_topic, HA_DISCOVERY_SENSOR, discoveryDevice.id, key);
 
   char uid[64];
-  sprintf(uid, "%s_sensor_%s", localPrefs->getString(preference_gd_id), key);
+  sprintf(uid, "%s_sensor_%s", discoveryDevice.id, key);
+
+  // overwrite device class if special key
+  const char *state_class = nullptr;
+  if (strcmp(key, "hum") == 0) {
+    state_class = "measurement";
+    unit = "%";
+    device_class = "humidity";
+  } else if (strcmp(key, "temp") == 0) {
+    state_class = "measurement";
+    unit = "°C";
+    device_class = "temperature";
+  } else if (strcmp(key, "pres") == 0) {
+    state_class = "measurement";
+    unit = "hPa";
+    device_class = "pressure";
+  }
 
   char vtemp[64];
   //small workaround to get the value as float
-  if (key == "hum" || key == "temp" || key == "pres"){
+  if (state_class != nullptr){
     sprintf(vtemp, "{{ value_json.%s | float }}", key);
   } else {
     sprintf(vtemp, "{{ value_json.%s }}", key);
   }
 
-  JsonDocument doc;
-
-  doc["name"] = name;
-  doc["state_topic"] = topic;
-  doc["availability_topic"] = mqttStrings.availability_topic;
-  doc["payload_available"] = HA_ONLINE;
-  doc["payload_not_available"] = HA_OFFLINE;
-  doc["value_template"] = vtemp;
-  doc["device"] = device;
-  
-  //Only set device class if set
-  if(device_class != "") {
-    doc["device_class"] = device_class;
-  }
-
-  doc["unit_of_measurement"] = unit;
-  doc["unique_id"] = uid;
-  
-  // overwrite device class if special key
-  if (key == "hum") {
-    doc["state_class"] = "measurement";
-    doc["unit_of_measurement"] = "%";
-    doc["device_class"] = "humidity";
-  } else if (key == "temp") {
-    doc["state_class"] = "measurement";
-    doc["unit_of_measurement"] = "°C";
-    doc["device_class"] = "temperature";
-  } else if (key == "pres") {
-    doc["state_class"] = "measurement";
-    doc["unit_of_measurement"] = "hPa";
-    doc["device_class"] = "pressure";
-  }
-
-  char payload[1024];
-  serializeJson(doc, payload);
-  //-//Serial.write(payload);
-  mqttClient.publish(full_topic, 1, true, payload);
+  emitDiscovery(full_topic, [&](DiscoveryWriter &w){
+    w.add("name", name);
+    w.topic("stat_t", topic);
+    writeAvailability(w);
+    w.add("val_tpl", vtemp);
+    //Only set device class and unit if set
+    if (device_class[0] != '\0'){
+      w.add("dev_cla", device_class);
+    }
+    if (unit[0] != '\0'){
+      w.add("unit_of_meas", unit);
+    }
+    if (state_class != nullptr){
+      w.add("stat_cla", state_class);
+    }
+    w.add("uniq_id", uid);
+  });
 }
 
-void sendDiscoveryMessageForDebug(const char name[], const char key[], const JsonDocument& device)
+void sendDiscoveryMessageForDebug(const char name[], const char key[])
 {
-
   char command_topic[64];
   sprintf(command_topic, mqttStrings.st_cmd_topic_var.c_str(), mqttStrings.debug_topic);
 
   char full_topic[64];
-  sprintf(full_topic, HA_DISCOVERY_TEXT, localPrefs->getString(preference_gd_id), key);
+  sprintf(full_topic, HA_DISCOVERY_TEXT, discoveryDevice.id, key);
 
   char uid[64];
-  sprintf(uid, "%s_text_%s", localPrefs->getString(preference_gd_id), key);
+  sprintf(uid, "%s_text_%s", discoveryDevice.id, key);
 
   char vtemp[64];
   sprintf(vtemp, "{{ value_json.%s }}", key);
 
-  JsonDocument doc;
-
-  doc["name"] = name;
-  doc["state_topic"] = mqttStrings.debug_topic;
-  doc["command_topic"] = command_topic;
-  doc["availability_topic"] = mqttStrings.availability_topic;
-  doc["payload_available"] = HA_ONLINE;
-  doc["payload_not_available"] = HA_OFFLINE;
-  doc["unique_id"] = uid;
-  doc["value_template"] = vtemp;
-  doc["device"] = device;
-
-  char payload[1024];
-  serializeJson(doc, payload);
-  //-//Serial.write(payload);
-  mqttClient.publish(full_topic, 1, true, payload);
+  emitDiscovery(full_topic, [&](DiscoveryWriter &w){
+    w.add("name", name);
+    w.topic("stat_t", mqttStrings.debug_topic);
+    w.topic("cmd_t", command_topic);
+    writeAvailability(w);
+    w.add("uniq_id", uid);
+    w.add("val_tpl", vtemp);
+  });
 }
 
-void sendDiscoveryMessageForSwitch(const char name[], const char discovery[], const char topic[], const char off[], const char on[], const char icon[], const JsonDocument& device, bool optimistic = false)
+void sendDiscoveryMessageForSwitch(const char name[], const char discovery[], const char topic[], const char off[], const char on[], const char icon[], bool optimistic = false)
 {
   char command_topic[64];
   sprintf(command_topic, mqttStrings.st_cmd_topic_var.c_str(), topic);
 
   char full_topic[64];
-  sprintf(full_topic, discovery, localPrefs->getString(preference_gd_id), topic);
+  sprintf(full_topic, discovery, discoveryDevice.id, topic);
 
   char value_template[64];
   sprintf(value_template, "{{ value_json.%s }}", topic);
 
   char uid[64];
-  if (discovery == HA_DISCOVERY_LIGHT){
-    sprintf(uid, "%s_light_%s",localPrefs->getString(preference_gd_id), topic);
+  if (strcmp(discovery, HA_DISCOVERY_LIGHT) == 0){
+    sprintf(uid, "%s_light_%s", discoveryDevice.id, topic);
   }
   else{
-    sprintf(uid, "%s_switch_%s",localPrefs->getString(preference_gd_id), topic);
+    sprintf(uid, "%s_switch_%s", discoveryDevice.id, topic);
   }
 
-  JsonDocument doc;
-
-  doc["name"] = name;
-  doc["state_topic"] = mqttStrings.state_topic;
-  doc["command_topic"] = command_topic;
-  doc["payload_on"] = on;
-  doc["payload_off"] = off;
-  doc["icon"] = icon;
-  doc["availability_topic"] = mqttStrings.availability_topic;
-  doc["payload_available"] = HA_ONLINE;
-  doc["payload_not_available"] = HA_OFFLINE;
-  doc["unique_id"] = uid;
-  doc["value_template"] = value_template;
-  doc["optimistic"] = optimistic;
-  doc["device"] = device;
-
-  char payload[1024];
-  serializeJson(doc, payload);
-  //-//Serial.write(payload);
-  mqttClient.publish(full_topic, 1, true, payload);
+  emitDiscovery(full_topic, [&](DiscoveryWriter &w){
+    w.add("name", name);
+    w.topic("stat_t", mqttStrings.state_topic);
+    w.topic("cmd_t", command_topic);
+    w.add("pl_on", on);
+    w.add("pl_off", off);
+    w.add("ic", icon);
+    writeAvailability(w);
+    w.add("uniq_id", uid);
+    w.add("val_tpl", value_template);
+    w.add("opt", optimistic);
+  });
 }
 
-void sendDiscoveryMessageForCover(const char name[], const char topic[], const JsonDocument& device)
+void sendDiscoveryMessageForCover(const char name[], const char topic[])
 {
-
   char command_topic[64];
   sprintf(command_topic, mqttStrings.st_cmd_topic_var.c_str(), topic);
 
   char full_topic[64];
-  sprintf(full_topic, HA_DISCOVERY_COVER, localPrefs->getString(preference_gd_id), topic);
+  sprintf(full_topic, HA_DISCOVERY_COVER, discoveryDevice.id, topic);
 
   char uid[64];
-  sprintf(uid, "%s_cover_%s", localPrefs->getString(preference_gd_id), topic);
-
-  JsonDocument doc;
- //if it didn't work try without state topic.
-  doc["name"] = name;
-  doc["state_topic"] = mqttStrings.state_topic;
-  doc["command_topic"] = command_topic;
-  doc["position_topic"] = mqttStrings.pos_topic;
-  doc["set_position_topic"] = mqttStrings.setpos_topic;
-  doc["position_open"] = 100;
-  doc["position_closed"] = 0;
-
-  doc["payload_open"] = HA_OPEN;
-  doc["payload_close"] = HA_CLOSE;
-  doc["payload_stop"] = HA_STOP;
-  doc["payload_step"] = HA_STEP;
-  #ifdef AlignToOpenHab
-    doc["value_template"] = "{{ value_json.doorposition }}";
-  #else
-    doc["value_template"] = "{{ value_json.doorstate }}";
-  #endif
-  doc["state_open"] = HA_OPEN;
-  doc["state_opening"] = HA_OPENING;
-  doc["state_closed"] = HA_CLOSED;
-  doc["state_closing"] = HA_CLOSING;
-  doc["state_stopped"] = HA_STOP;
-  doc["availability_topic"] = mqttStrings.availability_topic;
-  doc["payload_available"] = HA_ONLINE;
-  doc["payload_not_available"] = HA_OFFLINE;
-  doc["unique_id"] = uid;
-  doc["device_class"] = "garage";
-  doc["device"] = device;
-
-  char payload[1024];
-  serializeJson(doc, payload);
-  //-//Serial.write(payload);
-  mqttClient.publish(full_topic, 1, true, payload);
+  sprintf(uid, "%s_cover_%s", discoveryDevice.id, topic);
+
+  emitDiscovery(full_topic, [&](DiscoveryWriter &w){
+    //if it didn't work try without state topic.
+    w.add("name", name);
+    w.topic("stat_t", mqttStrings.state_topic);
+    w.topic("cmd_t", command_topic);
+    w.topic("pos_t", mqttStrings.pos_topic);
+    w.topic("set_pos_t", mqttStrings.setpos_topic);
+    w.add("pos_open", 100);
+    w.add("pos_clsd", 0);
+
+    w.add("pl_open", HA_OPEN);
+    w.add("pl_cls", HA_CLOSE);
+    w.add("pl_stop", HA_STOP);
+    w.add("payload_step", HA_STEP);   // no abbreviation, not a HA cover option
+    #ifdef AlignToOpenHab
+      w.add("val_tpl", "{{ value_json.doorposition }}");
+    #else
+      w.add("val_tpl", "{{ value_json.doorstate }}");
+    #endif
+    w.add("stat_open", HA_OPEN);
+    w.add("stat_opening", HA_OPENING);
+    w.add("stat_clsd", HA_CLOSED);
+    w.add("stat_closing", HA_CLOSING);
+    w.add("stat_stopped", HA_STOP);
+    writeAvailability(w);
+    w.add("uniq_id", uid);
+    w.add("dev_cla", "garage");
+  });
 }
 
 void sendDiscoveryMessage()
 {
-  //declare json object here for device instead of creating in each methode. 150 bytes should be enough
-  JsonDocument device;
-  device["identifiers"] = localPrefs->getString(preference_gd_name);
-  device["name"] = localPrefs->getString(preference_gd_name);
-  device["sw_version"] = HA_VERSION;
-  device["model"] = "Garage Door";
-  device["manufacturer"] = "Hörmann";
-  
-  sendDiscoveryMessageForAVSensor(device);
+  discoveryDigest.reset();
+  discoveryStats.messages = 0;
+  discoveryStats.bytes = 0;
+  discoveryDevice.id = config.gd_id;
+  discoveryDevice.name = config.gd_name;
+
+  sendDiscoveryMessageForAVSensor();
   //not able to get it working sending the discovery message for light.
-  sendDiscoveryMessageForSwitch(localPrefs->getString(preference_gd_light).c_str(), HA_DISCOVERY_SWITCH, "lamp", HA_OFF, HA_ON, "mdi:lightbulb", device);
-  sendDiscoveryMessageForBinarySensor(localPrefs->getString(preference_gd_light).c_str(), mqttStrings.state_topic, "lamp", HA_OFF, HA_ON, device);
-  sendDiscoveryMessageForSwitch(localPrefs->getString(preference_gd_vent).c_str(), HA_DISCOVERY_SWITCH, "vent", HA_CLOSE, HA_VENT, "mdi:air-filter", device);
-  sendDiscoveryMessageForSwitch(localPrefs->getString(preference_gd_half).c_str(), HA_DISCOVERY_SWITCH, "half", HA_CLOSE, HA_HALF, "mdi:air-filter", device);
-  sendDiscoveryMessageForSwitch(localPrefs->getString(preference_gd_step).c_str(), HA_DISCOVERY_SWITCH, "step", HA_STEP, HA_STEP, "mdi:remote", device);
-  sendDiscoveryMessageForCover(localPrefs->getString(preference_gd_name).c_str(), "door", device);
-
-  sendDiscoveryMessageForSensor(localPrefs->getString(preference_gd_status).c_str(), mqttStrings.state_topic, "doorstate", device, "enum");
-  sendDiscoveryMessageForSensor(localPrefs->getString(preference_gd_det_status).c_str(), mqttStrings.state_topic, "detailedState", device, "enum");
-  sendDiscoveryMessageForSensor(localPrefs->getString(preference_gd_position).c_str(), mqttStrings.state_topic, "doorposition", device);
+  sendDiscoveryMessageForSwitch(config.gd_light, HA_DISCOVERY_SWITCH, "lamp", HA_OFF, HA_ON, "mdi:lightbulb");
+  sendDiscoveryMessageForBinarySensor(config.gd_light, mqttStrings.state_topic, "lamp", HA_OFF, HA_ON);
+  sendDiscoveryMessageForSwitch(config.gd_vent, HA_DISCOVERY_SWITCH, "vent", HA_CLOSE, HA_VENT, "mdi:air-filter");
+  sendDiscoveryMessageForSwitch(config.gd_half, HA_DISCOVERY_SWITCH, "half", HA_CLOSE, HA_HALF, "mdi:air-filter");
+  sendDiscoveryMessageForSwitch(config.gd_step, HA_DISCOVERY_SWITCH, "step", HA_STEP, HA_STEP, "mdi:remote");
+  sendDiscoveryMessageForCover(discoveryDevice.name, "door");
+
+  sendDiscoveryMessageForSensor(config.gd_status, mqttStrings.state_topic, "doorstate", "enum");
+  sendDiscoveryMessageForSensor(config.gd_det_status, mqttStrings.state_topic, "detailedState", "enum");
+  sendDiscoveryMessageForSensor(config.gd_position, mqttStrings.state_topic, "doorposition");
   #ifdef SENSORS
     #if defined(USE_BME)
-      sendDiscoveryMessageForSensor(localPrefs->getString(preference_gs_temp).c_str(), mqttStrings.sensor_topic, "temp", device, "temperature", "°C");
-      sendDiscoveryMessageForSensor(localPrefs->getString(preference_gs_hum).c_str(), mqttStrings.sensor_topic, "hum", device, "humidity", "%");
-      sendDiscoveryMessageForSensor(localPrefs->getString(preference_gs_pres).c_str(), mqttStrings.sensor_topic, "pres", device, "atmospheric_pressure", "hPa");
+      sendDiscoveryMessageForSensor(config.gs_temp, mqttStrings.sensor_topic, "temp", "temperature", "°C");
+      sendDiscoveryMessageForSensor(config.gs_hum, mqttStrings.sensor_topic, "hum", "humidity", "%");
+      sendDiscoveryMessageForSensor(config.gs_pres, mqttStrings.sensor_topic, "pres", "atmospheric_pressure", "hPa");
     #elif defined(USE_DS18X20)
-      sendDiscoveryMessageForSensor(localPrefs->getString(preference_gs_temp).c_str(), mqttStrings.sensor_topic, "temp", device, "temperature", "°C");
+      sendDiscoveryMessageForSensor(config.gs_temp, mqttStrings.sensor_topic, "temp", "temperature", "°C");
     #endif
     #if defined(USE_HCSR04)
-      sendDiscoveryMessageForSensor(localPrefs->getString(preference_gs_free_dist).c_str(), mqttStrings.sensor_topic, "dist", device, "distance", "cm");
-      sendDiscoveryMessageForBinarySensor(localPrefs->getString(preference_gs_park_avail).c_str(), mqttStrings.sensor_topic, "free", HA_OFF, HA_ON, device);
+      sendDiscoveryMessageForSensor(config.gs_free_dist, mqttStrings.sensor_topic, "dist", "distance", "cm");
+      sendDiscoveryMessageForBinarySensor(config.gs_park_avail, mqttStrings.sensor_topic, "free", HA_OFF, HA_ON);
     #endif
     #if defined(USE_DHT22)
-      sendDiscoveryMessageForSensor(localPrefs->getString(preference_gs_temp).c_str(), mqttStrings.sensor_topic, "temp", device, "temperature", "°C");
-      sendDiscoveryMessageForSensor(localPrefs->getString(preference_gs_hum).c_str(), mqttStrings.sensor_topic, "hum", device, "humidity", "%");
+      sendDiscoveryMessageForSensor(config.gs_temp, mqttStrings.sensor_topic, "temp", "temperature", "°C");
+      sendDiscoveryMessageForSensor(config.gs_hum, mqttStrings.sensor_topic, "hum", "humidity", "%");
     #endif
     #if defined(USE_HCSR501)
-      sendDiscoveryMessageForBinarySensor(localPrefs->getString(preference_sensor_sr501).c_str(), mqttStrings.sensor_topic, "motion", HA_OFF, HA_ON, device);
+      sendDiscoveryMessageForBinarySensor(GD_MOTION, mqttStrings.sensor_topic, "motion", HA_OFF, HA_ON);
     #endif
   #endif
   #ifdef DEBUG
-    sendDiscoveryMessageForDebug(localPrefs->getString(preference_gd_debug).c_str(), "debug", device);
-    sendDiscoveryMessageForDebug(localPrefs->getString(preference_gd_debug_restart).c_str(), "reset-reason", device);
+    sendDiscoveryMessageForDebug(config.gd_debug, "debug");
+    sendDiscoveryMessageForDebug(config.gd_debug_restart, "reset-reason");
   #endif
 }
 
+void sendDiscoveryMessageIfChanged(bool requested)
+{
+  discoveryHashOnly = true;
+  sendDiscoveryMessage();
+  discoveryHashOnly = false;
+
+  if (!requested && discoveryDigest.hash == localPrefs->getUInt(preference_discovery_hash, 0)){
+    discoveryStats.skipped++;
+    return;
+  }
+  // the saved set is being replaced, nothing is confirmed until this one arrived
+  if (localPrefs->getUInt(preference_discovery_hash, 0) != 0){
+    localPrefs->putUInt(preference_discovery_hash, 0);
+  }
+  discoveryPending.hash = discoveryDigest.hash;
+  discoveryPending.lost = publishQueue.getLost(PublishPriority::DISCOVERY);
+  discoveryPending.active = true;
+  discoveryLastAcked.store(false);
+  // paced by the publish queue, see DISCOVERY_PACE_MS
+  sendDiscoveryMessage();
+  discoveryStats.sent++;
+}
+
+// Save the hash of the pending set once all of it left the queue and the last message
+// was acked; give up on it when one of its messages was dropped or evicted
+void confirmDiscovery()
+{
+  if (!discoveryPending.active){
+    return;
+  }
+  if (publishQueue.getLost(PublishPriority::DISCOVERY) != discoveryPending.lost){
+    discoveryPending.active = false;
+    return;
+  }
+  if (publishQueue.queued(PublishPriority::DISCOVERY) > 0 || !discoveryLastAcked.load()){
+    return;
+  }
+  localPrefs->putUInt(preference_discovery_hash, discoveryPending.hash);
+  discoveryPending.active = false;
+  discoveryStats.confirmed++;
+}
+
 void onMqttConnect(bool sessionPresent)
 {
   Serial.println("Function on mqtt connect.");
   mqttConnected = true;
+  mqttSessions.connects++;
   xTimerStop(mqttReconnectTimer, 0); // stop timer as we are connected to Mqtt again
+  // The rest runs in mqttTask, the only task that talks to the client
+  if (mqttTask != nullptr){
+    xTaskNotify(mqttTask, NOTIFY_CONNECTED, eSetBits);
+  }
+}
+
+// Runs in mqttTask after a (re)connect
+void onConnected()
+{
+  publishQueue.resetInflight();
+  // acks of a set sent on the old connection never come, it is sent again
+  discoveryPending.active = false;
   sendOnline();
   mqttClient.subscribe(mqttStrings.st_cmd_topic_subs.c_str(), 1);
+  mqttClient.subscribe(HA_STATUS_TOPIC, 1);
   updateDoorStatus(true);
   updateSensors(true);
-  sendDiscoveryMessage();
+  sendDiscoveryMessageIfChanged(false);
   #ifdef DEBUG
     if (boot_Flag){
       int i = esp_reset_reason();
@@ -734,129 +913,446 @@ void onMqttConnect(bool sessionPresent)
   #endif
 }
 
+// Hand queued messages to the client, most important first.
+// Returns the ms until a retry is due when the client pushed back, 0 otherwise.
+unsigned long drainPublishQueue()
+{
+  PublishQueue::Entry *entry;
+  unsigned long pacedMs = 0;
+  while (mqttConnected && (entry = publishQueue.take(&pacedMs)) != nullptr){
+    uint16_t packetId = mqttClient.publish(entry->topic, entry->qos, entry->retain, entry->payload);
+    if (packetId == 0){
+      publishQueue.refused(entry);
+      return PUBLISH_RETRY_MS;
+    }
+    if (entry->priority == PublishPriority::DISCOVERY){
+      discoveryLastAcked.store(false);
+      discoveryLastPacket.store(packetId);
+    }
+    publishQueue.sent(entry);
+  }
+  // waiting for acks wakes us through onMqttPublish, only paced entries need a timer
+  return mqttConnected ? pacedMs : 0;
+}
+
+// /status body, kept pre-serialized. It is rendered again when the door state changed or
+// after STATUS_CACHE_MS, as it also carries ages and counters, but not while a response
+// still streams out of it. The ETag is the FNV-1a hash of that body, so a 304 always means
+// the client holds these exact bytes. Web handlers all run in the async_tcp task, no
+// locking needed.
+#define STATUS_CACHE_MS 1000
+char statusCache[3072];
+size_t statusLength = 0;
+uint8_t statusReaders = 0;
+char statusETag[12] = "";
+uint32_t statusCacheVersion = 0;
+unsigned long statusCacheTime = 0;
+
+void refreshStatusCache()
+{
+  if (statusETag[0] != '\0' && (statusReaders > 0 ||
+      (hoermannEngine->state->version() == statusCacheVersion && millis() - statusCacheTime < STATUS_CACHE_MS))){
+    return;
+  }
+  JsonDocument root;
+  HoermannState::Snapshot state;
+  hoermannEngine->state->snapshot(state);
+  root["doorstate"] = state.translatedState;
+  root["valid"] = state.valid;
+  root["targetPosition"] = (int)(state.targetPosition * 100);
+  root["currentPosition"] = (int)(state.currentPosition * 100);
+  root["light"] = state.lightOn;
+  root["state"] = state.state;
+  root["busResponseAge"] = hoermannEngine->state->responseAge();
+  root["lastModbusRespone"] = hoermannEngine->state->lastModbusRespone;
+  root["swversion"] = HA_VERSION;
+  const HciSlaveStats &bus = hoermannEngine->busStats();
+  root["busReplyUs"] = bus.lastReplyUs;
+  root["busReplyMaxUs"] = bus.maxReplyUs;
+  root["busDeadlineMisses"] = hoermannEngine->busMetrics().deadlineMisses;
+  root["busLineErrors"] = hoermannEngine->busUart().getLineErrors();
+  root["busOverflows"] = hoermannEngine->busUart().getOverflows();
+  JsonObject publishes = root.createNestedObject("doorPublishes");
+  publishes["state"] = doorPublishes.state;
+  publishes["position"] = doorPublishes.position;
+  publishes["deferred"] = doorPublishes.deferred;
+  publishes["unchanged"] = doorPublishes.unchanged;
+  CommandQueueStats queue = hoermannEngine->commandQueueStats();
+  JsonObject commands = root.createNestedObject("commandQueue");
+  commands["depth"] = queue.depth;
+  commands["maxDepth"] = queue.maxDepth;
+  commands["pushed"] = queue.pushed;
+  commands["coalesced"] = queue.coalesced;
+  commands["expired"] = queue.expired;
+  commands["dropped"] = queue.dropped;
+  hoermannEngine->doorModelJson(root.createNestedObject("doorModel"));
+  JsonObject discovery = root.createNestedObject("discovery");
+  discovery["hash"] = discoveryDigest.hash;
+  discovery["messages"] = discoveryStats.messages;
+  discovery["bytes"] = discoveryStats.bytes;
+  discovery["sent"] = discoveryStats.sent;
+  discovery["confirmed"] = discoveryStats.confirmed;
+  discovery["skipped"] = discoveryStats.skipped;
+  PublishQueueStats publish = publishQueue.getStats();
+  JsonObject outbound = root.createNestedObject("publishQueue");
+  outbound["depth"] = publish.depth;
+  outbound["maxDepth"] = publish.maxDepth;
+  outbound["pushed"] = publish.pushed;
+  outbound["sent"] = publish.sent;
+  outbound["coalesced"] = publish.coalesced;
+  outbound["dropped"] = publish.dropped;
+  outbound["evicted"] = publish.evicted;
+  outbound["refused"] = publish.refused;
+  outbound["inflight"] = publish.inflight;
+  #ifdef SENSORS
+    JsonObject sensors  = root.createNestedObject("sensors");
+      char buf[20];
+    #ifdef USE_DS18X20
+      dtostrf(ds18x20_temp,2,1,buf);
+      strcat(buf, " °C");
+      sensors["temp"] = buf;
+    #endif
+    #ifdef USE_BME
+      dtostrf(bme_temp,2,1,buf);
+      strcat(buf, " °C");
+      sensors["temp"] = buf;
+      dtostrf(bme_hum,2,1,buf); 
+      strcat(buf, " %");
+      sensors["hum"] = buf;
+      dtostrf(bme_pres,2,1,buf); 
+      strcat(buf, " mbar");
+      sensors["pres"] = buf;
+    #endif
+    #ifdef USE_DHT22
+      dtostrf(dht22_temp,2,1,buf);
+      strcat(buf, " °C");
+      sensors["temp"] = buf;
+      dtostrf(dht22_hum,2,1,buf); 
+      strcat(buf, " %");
+      sensors["hum"] = buf;
+    #endif
+    #ifdef USE_HCSR04
+      dtostrf(hcsr04_distanceCm,2,0,buf);
+      strcat(buf, " cm");
+      sensors["dist"] = buf;
+      sensors["distBaseline"] = (int)hcsr04Sensor.baselineCm;
+      sensors["distOutliers"] = hcsr04Sensor.outliers;
+    #endif
+    sensorScheduler.toJson(root.createNestedObject("sensorDrivers"));
+    sensorReports.toJson(root.createNestedObject("sensorReports"));
+  #endif
+  //root["debug"] = doorstate.reserved;
+  root["lastCommandTopic"] = lastCommandTopic;
+  root["lastCommandPayload"] = lastCommandPayload;
+  statusLength = serializeJson(root, statusCache, sizeof(statusCache));
+  if (statusLength >= sizeof(statusCache) - 1){
+    ESP_LOGW(TAG_HCI, "status truncated");
+  }
+  DigestPrint digest;
+  digest.write((const uint8_t *)statusCache, statusLength);
+  snprintf(statusETag, sizeof(statusETag), "\"%08x\"", (unsigned)digest.hash);
+  statusCacheVersion = state.version;
+  statusCacheTime = millis();
+}
+
+// Door state event for /events: only the fields that differ from prev, all if prev is nullptr.
+// Returns the length, 0 if nothing changed.
+size_t renderStateEvent(char *buf, size_t size, const HoermannState::Snapshot &state, const HoermannState::Snapshot *prev)
+{
+  int len = snprintf(buf, size, "{\"v\":%u", state.version);
+  size_t start = len;
+  if (prev == nullptr || state.state != prev->state){
+    len += snprintf(buf + len, size - len, ",\"doorstate\":\"%s\"", state.translatedState);
+  }
+  if (prev == nullptr || state.valid != prev->valid){
+    len += snprintf(buf + len, size - len, ",\"valid\":%s", state.valid ? "true" : "false");
+  }
+  if (prev == nullptr || (int)(state.targetPosition * 100) != (int)(prev->targetPosition * 100)){
+    len += snprintf(buf + len, size - len, ",\"targetPosition\":%d", (int)(state.targetPosition * 100));
+  }
+  if (prev == nullptr || (int)(state.currentPosition * 100) != (int)(prev->currentPosition * 100)){
+    len += snprintf(buf + len, size - len, ",\"currentPosition\":%d", (int)(state.currentPosition * 100));
+  }
+  if (prev == nullptr || state.lightOn != prev->lightOn){
+    len += snprintf(buf + len, size - len, ",\"light\":%s", state.lightOn ? "true" : "false");
+  }
+  if ((size_t)len == start) return 0;
+  len += snprintf(buf + len, size - len, "}");
+  return (size_t)len < size ? len : 0;
+}
+
+HoermannState::Snapshot eventState;     // last state pushed to /events
+
+// Push what changed since the last event; one render for any number of clients
+void pushStateEvent()
+{
+  HoermannState::Snapshot state;
+  hoermannEngine->state->snapshot(state);
+  if (state.version == eventState.version){
+    return;
+  }
+  if (events.count() > 0){
+    char payload[192];
+    if (renderStateEvent(payload, sizeof(payload), state, &eventState) > 0){
+      events.send(payload, "state", state.version);
+    }
+  }
+  eventState = state;
+}
+
 void mqttTaskFunc(void *parameter)
 {
+  unsigned long lastHciMetrics = 0;
+  unsigned long lastStatePublish = 0;
+  #ifdef DEBUG
+  uint32_t lastDebugVersion = 0;
+  #endif
+  unsigned long positionDue = 0;
+  unsigned long publishRetry = 0;
   while (true)
   {
+    // Sleep until the engine or a sensor reports news, at the latest when the HCI metrics,
+    // a held back position or a refused or paced publish are due
+    unsigned long sinceMetrics = millis() - lastHciMetrics;
+    unsigned long timeout = sinceMetrics < HCI_METRICS_INTERVAL ? HCI_METRICS_INTERVAL - sinceMetrics : 0;
+    if (positionDue > 0 && positionDue < timeout){
+      timeout = positionDue;
+    }
+    if (publishRetry > 0 && publishRetry < timeout){
+      timeout = publishRetry;
+    }
+    uint32_t events = 0;
+    xTaskNotifyWait(0, UINT32_MAX, &events, pdMS_TO_TICKS(timeout));
+
+    if ((events & HOERMANN_NOTIFY_STATE) && STATE_PUBLISH_MIN_INTERVAL > 0){
+      // Hold back bursts; changes arriving meanwhile go out with this publish
+      unsigned long since = millis() - lastStatePublish;
+      if (since < STATE_PUBLISH_MIN_INTERVAL){
+        vTaskDelay(pdMS_TO_TICKS(STATE_PUBLISH_MIN_INTERVAL - since));
+      }
+    }
+
     if (mqttConnected){
-      updateDoorStatus();
+      if (events & NOTIFY_CONNECTED){
+        onConnected();
+      } else if (events & NOTIFY_DISCOVERY){
+        sendDiscoveryMessageIfChanged(true);
+      }
+      if (events & HOERMANN_NOTIFY_STATE){
+        lastStatePublish = millis();
+      }
+      positionDue = updateDoorStatus();
       updateSensors();
       #ifdef DEBUG
-      if (hoermannEngine->state->debMessage){
-        hoermannEngine->state->clearDebug();
+      HoermannState::Snapshot state;
+      hoermannEngine->state->snapshot(state);
+      if (state.debugVersion != lastDebugVersion){
+        lastDebugVersion = state.debugVersion;
         sendDebug();
       }
       #endif      
     }
-    vTaskDelay(READ_DELAY);     // delay task xxx ms
+    pushStateEvent();
+    // Learned door model goes to flash here, never from the bus task
+    hoermannEngine->saveDoorModel();
+    if (millis() - lastHciMetrics >= HCI_METRICS_INTERVAL){
+      lastHciMetrics = millis();
+      if (mqttConnected){
+        sendHciMetrics();
+      }
+    }
+    publishRetry = drainPublishQueue();
+    confirmDiscovery();
   }
 }
 
-TaskHandle_t mqttTask;
-
+// Sensor task: runs the drivers and turns their readings into publish events
 void SensorCheck(void *parameter){
   while(true){
-    // handle motion sensor at first and send state immediately. Do not 
-    // use updateSensors to avoid unneccessary polling of the other sensors
+    uint32_t idleMs = sensorScheduler.run();
+
+    // motion is sent right away. Do not use updateSensors
+    // to avoid publishing the other sensors with it
     #ifdef USE_HCSR501
-      hcsr501stat = digitalRead(SR501PIN);
-      if (hcsr501stat != hcsr501_laststat) {
-        hcsr501_laststat = hcsr501stat;
+      if (motionSensor.takeReading()) {
         JsonDocument doc;
-        char payload[1024];
-        if (hcsr501stat) {
-          doc["motion"] = HA_ON;
-        }
-        else {
-          doc["motion"] = HA_OFF;
-        }
+        char payload[64];
+        doc["motion"] = motionSensor.motion ? HA_ON : HA_OFF;
         serializeJson(doc, payload);
-        mqttClient.publish(mqttStrings.sensor_topic, 1, true, payload);
+        // every edge counts, never merged with an older one
+        publishQueue.push(mqttStrings.sensor_topic, payload, 1, true, PublishPriority::SENSOR, false);
       }
     #endif
+    unsigned long now = millis();
     #ifdef USE_DS18X20
-      ds18x20_temp = ds18x20->getTempCByIndex(0);
-      if (abs(ds18x20_temp-ds18x20_last_temp) >= sensor_temp_thresh){
-        ds18x20_last_temp = ds18x20_temp;
-        new_sensor_data = true;
+      if (ds18x20Sensor.takeReading()){
+        ds18x20TempReport.sample(ds18x20Sensor.temperature, now);
+        ds18x20_temp = ds18x20TempReport.value();
       }
     #endif
     #ifdef USE_BME
-      if (digitalRead(i2c_onoffpin) == LOW) {
-        digitalWrite(i2c_onoffpin, HIGH);   // activate sensor
-        sleep(10);
-        I2CBME.begin(i2c_sdapin, i2c_sclpin);   // https://randomnerdtutorials.com/esp32-i2c-communication-arduino-ide/
-        bme_status = bme.begin(0x76, &I2CBME);  // check sensor. adreess can be 0x76 or 0x77
-      }
-      if (!bme_status) {
-        bme_status = bme.begin(0x77, &I2CBME);  // check sensor. address can be 0x76 or 0x77
-      }
-      if (!bme_status) {
-        digitalWrite(i2c_onoffpin, LOW);      // deactivate sensor
-      }
-      else {
-        bme_temp = bme.readTemperature();   // round float
-        bme_hum = bme.readHumidity();
-        bme_pres = bme.readPressure()/100;  // convert from pascal to mbar
-        if (bme_hum < 99.9){                   // I2C hung up ...
-          if (abs(bme_temp-bme_last_temp) >= sensor_temp_thresh || abs(bme_hum-bme_last_hum) >= sensor_hum_thresh || abs(bme_pres-bme_last_pres) >= sensor_pres_thresh){
-            bme_last_temp = bme_temp;
-            bme_last_hum = bme_hum;
-            bme_last_pres = bme_pres;
-            new_sensor_data = true;
-          }
-        } else {
-          digitalWrite(i2c_onoffpin, LOW);      // deactivate sensor
-        }
+      if (bmeSensor.takeReading()){
+        bmeTempReport.sample(bmeSensor.temperature, now);
+        bmeHumReport.sample(bmeSensor.humidity, now);
+        bmePresReport.sample(bmeSensor.pressure, now);
+        bme_temp = bmeTempReport.value();
+        bme_hum = bmeHumReport.value();
+        bme_pres = bmePresReport.value();
       }
     #endif
     #ifdef USE_HCSR04
-
-        // Clears the trigPin
-        digitalWrite(hcsr04_tgpin, LOW);
-        delayMicroseconds(2);
-        // Sets the trigPin on HIGH state for 10 micro seconds
-        digitalWrite(hcsr04_tgpin, HIGH);
-        delayMicroseconds(10);
-        digitalWrite(hcsr04_tgpin, LOW);
-        // Reads the echoPin, returns the sound wave travel time in microseconds
-        hcsr04_duration = pulseIn(hscr04_ecpin, HIGH);
-        // Calculate the distance
-        hcsr04_distanceCm = hcsr04_duration * SOUND_SPEED/2;
-        if (hcsr04_distanceCm > hcsr04_maxdistanceCm) {
-          // set new Max
-          hcsr04_maxdistanceCm = hcsr04_distanceCm;
-        }
-        if ((hcsr04_distanceCm + sensor_prox_tresh) > hcsr04_maxdistanceCm ){
-          hcsr04_park_available = true;
-        } else {
-          hcsr04_park_available = false;
-        }
-        if (abs(hcsr04_distanceCm-hcsr04_lastdistanceCm) >= sensor_prox_tresh || hcsr04_park_available != hcsr04_lastpark_available ){
-          hcsr04_lastdistanceCm = hcsr04_distanceCm;
-          hcsr04_lastpark_available = hcsr04_park_available;
-          new_sensor_data = true;
-        }
+      if (hcsr04Sensor.takeReading()){
+        hcsr04DistReport.sample(hcsr04Sensor.distanceCm, now);
+        hcsr04FreeReport.sample(hcsr04Sensor.free, now);
+        hcsr04_distanceCm = lroundf(hcsr04DistReport.value());
+        hcsr04_park_available = hcsr04Sensor.free;
+      }
     #endif
     #ifdef USE_DHT22
-      dht22_temp = dht->readTemperature();
-      dht22_hum = dht->readHumidity();
-      if (!isnan(dht22_temp) && abs(dht22_temp) >= sensor_temp_thresh){
-        dht22_last_temp = dht22_temp;
-        new_sensor_data = true;
-      }
-      if (!isnan(dht22_hum) && abs(dht22_hum) >= sensor_hum_thresh){
-        dht22_last_hum = dht22_hum;
-        new_sensor_data = true;
+      if (dhtSensor.takeReading()){
+        dhtTempReport.sample(dhtSensor.temperature, now);
+        dhtHumReport.sample(dhtSensor.humidity, now);
+        dht22_temp = dhtTempReport.value();
+        dht22_hum = dhtHumReport.value();
       }
     #endif
-    vTaskDelay(localPrefs->getInt(preference_query_interval_sensors)*1000);     // delay task xxx ms if statemachine had nothing to do
-    //vTaskDelay(SENSE_PERIOD);     // TODO take from Preferences
+    // checked every round, also without a reading: a held back change or a
+    // heartbeat can fall due in between
+    if (sensorReports.due(now)){
+      sensorReports.markPublished(now);
+      new_sensor_data = true;
+      xTaskNotify(mqttTask, NOTIFY_SENSOR, eSetBits);
+    }
+    vTaskDelay(pdMS_TO_TICKS(idleMs > 0 ? idleMs : 1));
   }
 }
 
 TaskHandle_t sensorTask;
 
+// /metrics body in Prometheus text format, rendered into a static buffer. The response
+// streams straight out of it, so it is not rendered again while a scrape is still being
+// sent; a concurrent scrape gets the same body.
+char metricsBuf[8192];
+size_t metricsLength = 0;
+uint8_t metricsReaders = 0;
+
+void stackMetric(MetricsWriter &out, const char *task, TaskHandle_t handle)
+{
+  if (handle == nullptr) return;   // nullptr would report the calling task
+  char labels[32];
+  snprintf(labels, sizeof(labels), "task=\"%s\"", task);
+  out.sample("hcpbridge_task_stack_free_bytes", labels, uxTaskGetStackHighWaterMark(handle));
+}
+
+void renderMetrics()
+{
+  MetricsWriter out(metricsBuf, sizeof(metricsBuf));
+  const HciMetrics &metrics = hoermannEngine->busMetrics();
+  const HciSlaveStats &bus = hoermannEngine->busStats();
+  char labels[64];
+
+  out.family("hcpbridge_bus_frames_total", "counter", "Modbus frames seen on the HCI bus by type");
+  for (uint8_t i = 1; i < (uint8_t)HciFrameType::COUNT; i++){
+    snprintf(labels, sizeof(labels), "type=\"%s\"", HCI_FRAME_NAMES[i]);
+    out.sample("hcpbridge_bus_frames_total", labels, metrics.frameCount((HciFrameType)i));
+  }
+  out.family("hcpbridge_bus_errors_total", "counter", "HCI bus receive errors by kind");
+  out.sample("hcpbridge_bus_errors_total", "kind=\"crc\"", bus.frames[(uint8_t)HciFrameType::CRC_ERROR]);
+  out.sample("hcpbridge_bus_errors_total", "kind=\"framing\"", hoermannEngine->busUart().getLineErrors());
+  out.sample("hcpbridge_bus_errors_total", "kind=\"overflow\"", hoermannEngine->busUart().getOverflows() + bus.overruns);
+  out.sample("hcpbridge_bus_errors_total", "kind=\"lost\"", metrics.lostFrames);
+  out.counter("hcpbridge_bus_deadline_misses_total", "Replies started after the master reply deadline or dropped", metrics.deadlineMisses);
+  out.family("hcpbridge_bus_deadline_misses_by_task_total", "counter", "Deadline misses by the task running on the other core");
+  for (uint8_t i = 0; i < metrics.deadlineGuard.culpritCount(); i++){
+    snprintf(labels, sizeof(labels), "task=\"%s\"", metrics.deadlineGuard.culpritName(i));
+    out.sample("hcpbridge_bus_deadline_misses_by_task_total", labels, metrics.deadlineGuard.culpritMisses(i));
+  }
+  out.sample("hcpbridge_bus_deadline_misses_by_task_total", "task=\"other\"", metrics.deadlineGuard.otherMisses());
+  out.histogram("hcpbridge_bus_turnaround_seconds", "End of request to reply handed to the UART", metrics.turnaroundUs, 1e-6);
+  out.histogram("hcpbridge_bus_poll_gap_seconds", "Time between polls addressed to the bridge", metrics.pollGapUs, 1e-6);
+  out.histogram("hcpbridge_command_wait_seconds", "Command queued until fetched by the master", metrics.commandWaitMs, 1e-3);
+
+  CommandQueueStats commands = hoermannEngine->commandQueueStats();
+  out.gauge("hcpbridge_command_queue_depth", "Commands waiting for the master", commands.depth);
+  out.family("hcpbridge_commands_total", "counter", "Commands by outcome");
+  out.sample("hcpbridge_commands_total", "outcome=\"pushed\"", commands.pushed);
+  out.sample("hcpbridge_commands_total", "outcome=\"coalesced\"", commands.coalesced);
+  out.sample("hcpbridge_commands_total", "outcome=\"expired\"", commands.expired);
+  out.sample("hcpbridge_commands_total", "outcome=\"dropped\"", commands.dropped);
+
+  PublishQueueStats publish = publishQueue.getStats();
+  out.gauge("hcpbridge_mqtt_queue_depth", "MQTT messages waiting to be sent", publish.depth);
+  out.gauge("hcpbridge_mqtt_inflight", "MQTT messages waiting for their ack", publish.inflight);
+  out.family("hcpbridge_mqtt_messages_total", "counter", "Outbound MQTT messages by outcome");
+  out.sample("hcpbridge_mqtt_messages_total", "outcome=\"sent\"", publish.sent);
+  out.sample("hcpbridge_mqtt_messages_total", "outcome=\"coalesced\"", publish.coalesced);
+  out.sample("hcpbridge_mqtt_messages_total", "outcome=\"dropped\"", publish.dropped);
+  out.sample("hcpbridge_mqtt_messages_total", "outcome=\"evicted\"", publish.evicted);
+  out.counter("hcpbridge_mqtt_refused_total", "Publishes the client pushed back, retried later", publish.refused);
+  out.counter("hcpbridge_mqtt_connects_total", "MQTT sessions established", mqttSessions.connects);
+  out.counter("hcpbridge_mqtt_disconnects_total", "MQTT sessions lost", mqttSessions.disconnects);
+  out.gauge("hcpbridge_mqtt_connected", "1 while connected to the broker", mqttConnected ? 1 : 0);
+
+  #ifdef SENSORS
+    out.family("hcpbridge_sensor_readings_total", "counter", "Readings taken per sensor");
+    for (uint8_t i = 0; i < sensorScheduler.size(); i++){
+      snprintf(labels, sizeof(labels), "sensor=\"%s\"", sensorScheduler.get(i)->name());
+      out.sample("hcpbridge_sensor_readings_total", labels, sensorScheduler.get(i)->getStats().readings);
+    }
+    out.family("hcpbridge_sensor_failures_total", "counter", "Failed sensor reads and inits");
+    for (uint8_t i = 0; i < sensorScheduler.size(); i++){
+      snprintf(labels, sizeof(labels), "sensor=\"%s\"", sensorScheduler.get(i)->name());
+      out.sample("hcpbridge_sensor_failures_total", labels, sensorScheduler.get(i)->getStats().failures);
+    }
+    out.family("hcpbridge_sensor_poll_max_seconds", "gauge", "Longest single driver step");
+    for (uint8_t i = 0; i < sensorScheduler.size(); i++){
+      snprintf(labels, sizeof(labels), "sensor=\"%s\"", sensorScheduler.get(i)->name());
+      out.sample("hcpbridge_sensor_poll_max_seconds", labels, sensorScheduler.get(i)->getStats().maxPollUs * 1e-6);
+    }
+    out.counter("hcpbridge_sensor_publishes_total", "Sensor payloads sent", sensorReports.getPublishes());
+    out.family("hcpbridge_sensor_report_publishes_total", "counter", "Publishes asked for per quantity, by reason");
+    for (uint8_t i = 0; i < sensorReports.size(); i++){
+      const SensorReport *report = sensorReports.get(i);
+      snprintf(labels, sizeof(labels), "sensor=\"%s\",quantity=\"%s\",reason=\"change\"", report->getSensor(), report->getQuantity());
+      out.sample("hcpbridge_sensor_report_publishes_total", labels, report->getStats().changes);
+      snprintf(labels, sizeof(labels), "sensor=\"%s\",quantity=\"%s\",reason=\"heartbeat\"", report->getSensor(), report->getQuantity());
+      out.sample("hcpbridge_sensor_report_publishes_total", labels, report->getStats().heartbeats);
+    }
+    out.family("hcpbridge_sensor_report_suppressed_total", "counter", "Samples inside the deadband");
+    for (uint8_t i = 0; i < sensorReports.size(); i++){
+      const SensorReport *report = sensorReports.get(i);
+      snprintf(labels, sizeof(labels), "sensor=\"%s\",quantity=\"%s\"", report->getSensor(), report->getQuantity());
+      out.sample("hcpbridge_sensor_report_suppressed_total", labels, report->getStats().suppressed);
+    }
+    out.family("hcpbridge_sensor_report_throttled_total", "counter", "Changes held back by the minimum interval");
+    for (uint8_t i = 0; i < sensorReports.size(); i++){
+      const SensorReport *report = sensorReports.get(i);
+      snprintf(labels, sizeof(labels), "sensor=\"%s\",quantity=\"%s\"", report->getSensor(), report->getQuantity());
+      out.sample("hcpbridge_sensor_report_throttled_total", labels, report->getStats().throttled);
+    }
+  #endif
+
+  out.family("hcpbridge_task_stack_free_bytes", "gauge", "Lowest free stack seen per task (high-water mark)");
+  stackMetric(out, "ModBusTask", modBusTask);
+  stackMetric(out, "MqttTask", mqttTask);
+  #ifdef SENSORS
+    stackMetric(out, "SensorTask", sensorTask);
+  #endif
+  out.gauge("hcpbridge_heap_free_bytes", "Free heap", ESP.getFreeHeap());
+  out.gauge("hcpbridge_heap_min_free_bytes", "Lowest free heap since boot", ESP.getMinFreeHeap());
+  out.gauge("hcpbridge_heap_max_alloc_bytes", "Largest free heap block", ESP.getMaxAllocHeap());
+  // no sample while disconnected: 0 dBm would read as a perfect signal
+  out.family("hcpbridge_wifi_rssi_dbm", "gauge", "WiFi signal strength");
+  if (WiFi.isConnected()){
+    out.sample("hcpbridge_wifi_rssi_dbm", nullptr, WiFi.RSSI());
+  }
+  out.gauge("hcpbridge_uptime_seconds", "Time since boot", millis() / 1000);
+  if (out.truncated()){
+    ESP_LOGW(TAG_HCI, "/metrics truncated at %u bytes", out.length());
+  }
+  metricsLength = out.length();
+}
+
 void WiFiEvent(WiFiEvent_t event) {
     String eventInfo = "No Info";
 
@@ -964,9 +1460,8 @@ const char* generateUniqueID() {
 }
 
 bool requireAuth(AsyncWebServerRequest* request) {
-  String webpass = localPrefs->getString(preference_www_password);
-  if(webpass != "") {
-    if (request->authenticate(WWW_USER, webpass.c_str())) return true;
+  if(config.www_pass[0] != '\0') {
+    if (request->authenticate(WWW_USER, config.www_pass)) return true;
     request->requestAuthentication();   // send 401 + WWW-Authenticate Header
     return false;
   } else {
@@ -984,7 +1479,7 @@ void setup()
   prefHandler.initPreferences();
   localPrefs = prefHandler.getPreferences();
   // setup modbus
-  hoermannEngine->setup(localPrefs);
+  hoermannEngine->setup(localPrefs, config);
 
   //Add interrupts for Factoryreset over Boot button
   pinMode(0, INPUT_PULLUP);
@@ -994,11 +1489,11 @@ void setup()
   // setup wifi
   mqttReconnectTimer = xTimerCreate("mqttTimer", pdMS_TO_TICKS(2000), pdFALSE, (void*)0, reinterpret_cast<TimerCallbackFunction_t>(connectToMqtt));
   wifiReconnectTimer = xTimerCreate("wifiTimer", pdMS_TO_TICKS(2000), pdFALSE, (void*)0, reinterpret_cast<TimerCallbackFunction_t>(connectToWifi));
-  WiFi.setHostname(prefHandler.getPreferencesCache()->hostname);
-  if (localPrefs->getBool(preference_wifi_ap_mode)){
+  WiFi.setHostname(config.hostname);
+  if (config.wifi_ap_mode){
     Serial.println("WIFI AP enabled");
     WiFi.mode(WIFI_AP_STA);
-    WiFi.softAP(prefHandler.getPreferencesCache()->hostname, localPrefs->getString(preference_wifi_ap_password).c_str());
+    WiFi.softAP(config.hostname, config.wifi_ap_pass);
     }
   else{
     WiFi.mode(WIFI_STA);  
@@ -1010,72 +1505,77 @@ void setup()
   const char *uniqueId = generateUniqueID();
 	
   setuptMqttStrings();
+  setupStatePayload();
   mqttClient.onConnect(onMqttConnect);
   mqttClient.onDisconnect(onMqttDisconnect);
   mqttClient.onMessage(onMqttMessage);
   mqttClient.onPublish(onMqttPublish);
 
   mqttClient.setClientId(uniqueId);
-  mqttClient.setServer(prefHandler.getPreferencesCache()->mqtt_server, localPrefs->getInt(preference_mqtt_server_port));
-  mqttClient.setCredentials(prefHandler.getPreferencesCache()->mqtt_user, prefHandler.getPreferencesCache()->mqtt_password);
+  mqttClient.setServer(config.mqtt_server, config.mqtt_port);
+  mqttClient.setCredentials(config.mqtt_user, config.mqtt_pass);
   setWill();
 
   delay(1000);
   
   connectToWifi();
 
+  publishQueue.begin();
+  publishQueue.setPacing(PublishPriority::DISCOVERY, DISCOVERY_PACE_MS);
   xTaskCreatePinnedToCore(
       mqttTaskFunc, /* Function to implement the task */
       "MqttTask",   /* Name of the task */
       10000,        /* Stack size in words */
       NULL,         /* Task input parameter */
-      // 1,  /* Priority of the task */
-      configMAX_PRIORITIES - 3,
+      MQTT_TASK_PRIORITY,
       &mqttTask, /* Task handle. */
-      0);        /* Core where the task should run */
+      MQTT_TASK_CORE);  /* Core where the task should run */
+  hoermannEngine->notifyOnChange(mqttTask);
+  publishQueue.setOwner(mqttTask);
 
 
   #ifdef SENSORS
-    sensor_prox_tresh = localPrefs->getInt(preference_sensor_prox_treshold);
-    sensor_temp_thresh = localPrefs->getDouble(preference_sensor_temp_treshold);
-    sensor_hum_thresh = localPrefs->getInt(preference_sensor_hum_threshold);
-    sensor_pres_thresh = localPrefs->getInt(preference_sensor_pres_threshold);
+    uint32_t sensePeriodMs = config.sensor_interval * 1000;
+    float alpha = config.sensor_ewma_alpha;
+    uint32_t minIntervalMs = config.sensor_min_interval * 1000;
+    uint32_t heartbeatMs = config.sensor_heartbeat * 1000;
     #ifdef USE_DS18X20
-      ds18x20_pin = localPrefs->getInt(preference_sensor_ds18x20_pin);
-      OneWire oneWire(ds18x20_pin);
-      static DallasTemperature static_ds18x20(&oneWire);
-      // save its address.
-      ds18x20 = &static_ds18x20;
-      ds18x20->begin();
+      ds18x20Sensor.begin(config.ds18x20_pin, sensePeriodMs);
+      sensorScheduler.add(&ds18x20Sensor);
+      ds18x20TempReport.begin(config.sensor_temp_thresh, alpha, minIntervalMs, heartbeatMs);
+      sensorReports.add(&ds18x20TempReport);
     #endif
     #ifdef USE_BME
-      i2c_sdapin = localPrefs->getInt(preference_sensor_i2c_sda);
-      i2c_sclpin = localPrefs->getInt(preference_sensor_i2c_scl);
-      pinMode(i2c_onoffpin, OUTPUT);
-      I2CBME.begin(i2c_sdapin, i2c_sclpin);   // https://randomnerdtutorials.com/esp32-i2c-communication-arduino-ide/
-      bme_status = bme.begin(0x76, &I2CBME);  // check sensor. adreess can be 0x76 or 0x77
-      //bme_status = bme.begin();  // check sensor. adreess can be 0x76 or 0x77
-      if (!bme_status) {
-        bme_status = bme.begin(0x77, &I2CBME);  // check sensor. address can be 0x76 or 0x77
-      }
+      // powered and initialized on its first poll
+      bmeSensor.begin(config.i2c_sda, config.i2c_scl, i2c_onoffpin, sensePeriodMs);
+      sensorScheduler.add(&bmeSensor);
+      bmeTempReport.begin(config.sensor_temp_thresh, alpha, minIntervalMs, heartbeatMs);
+      bmeHumReport.begin(config.sensor_hum_thresh, alpha, minIntervalMs, heartbeatMs);
+      bmePresReport.begin(config.sensor_pres_thresh, alpha, minIntervalMs, heartbeatMs);
+      sensorReports.add(&bmeTempReport);
+      sensorReports.add(&bmeHumReport);
+      sensorReports.add(&bmePresReport);
     #endif
     #ifdef USE_HCSR04
-      hcsr04_tgpin = localPrefs->getInt(preference_sensor_sr04_trigpin);
-      hscr04_ecpin = localPrefs->getInt(preference_sensor_sr04_echopin);
-      hcsr04_maxdistanceCm = localPrefs->getInt(preference_sensor_sr04_max_dist);
-      pinMode(hcsr04_tgpin, OUTPUT); // Sets the trigPin as an Output
-      pinMode(hscr04_ecpin, INPUT); // Sets the echoPin as an Input
+      hcsr04Sensor.begin(config.sr04_trigpin, config.sr04_echopin, config.sr04_period_ms, config.sr04_max_dist, config.sensor_prox_thresh);
+      sensorScheduler.add(&hcsr04Sensor);
+      hcsr04DistReport.begin(config.sensor_prox_thresh, alpha, minIntervalMs, heartbeatMs);
+      // the parking spot state is already filtered, every flip is sent as is
+      hcsr04FreeReport.begin(0.5, 1, minIntervalMs, heartbeatMs);
+      sensorReports.add(&hcsr04DistReport);
+      sensorReports.add(&hcsr04FreeReport);
     #endif
     #ifdef USE_HCSR501
-      pinMode(SR501PIN, INPUT); // Sets the trigPin as an Output
-      hcsr501_laststat = digitalRead(SR501PIN); // read first state of sensor
+      motionSensor.begin(config.sr501_pin);
+      sensorScheduler.add(&motionSensor);
     #endif
     #ifdef USE_DHT22
-      dht_data_pin = localPrefs->getInt(preference_sensor_dht_data_pin);
-       static DHT static_dht(dht_data_pin, DHTTYPE);
-      // save its address.
-      dht = &static_dht;
-      dht->begin();
+      dhtSensor.begin(config.dht_pin, sensePeriodMs);
+      sensorScheduler.add(&dhtSensor);
+      dhtTempReport.begin(config.sensor_temp_thresh, alpha, minIntervalMs, heartbeatMs);
+      dhtHumReport.begin(config.sensor_hum_thresh, alpha, minIntervalMs, heartbeatMs);
+      sensorReports.add(&dhtTempReport);
+      sensorReports.add(&dhtHumReport);
     #endif
 
     xTaskCreatePinnedToCore(
@@ -1083,10 +1583,9 @@ void setup()
       "SensorTask",   /* Name of the task */
       10000,        /* Stack size in words */
       NULL,         /* Task input parameter */
-      // 1,  /* Priority of the task */
-      configMAX_PRIORITIES,
+      SENSOR_TASK_PRIORITY,
       &sensorTask, /* Task handle. */
-      0);        /* Core where the task should run */
+      SENSOR_TASK_CORE);  /* Core where the task should run */
   #endif
 
   // setup http server
@@ -1097,65 +1596,51 @@ void setup()
               response->addHeader("Content-Encoding", "deflate");
               request->send(response); });
 
+  server.on("/metrics", HTTP_GET, [](AsyncWebServerRequest *request){
+              if (!requireAuth(request)) return;
+              if (metricsReaders == 0){
+                renderMetrics();
+              }
+              metricsReaders++;
+              request->onDisconnect([](){ metricsReaders--; });
+              AsyncWebServerResponse *response = request->beginResponse_P(200, "text/plain; version=0.0.4", (const uint8_t *)metricsBuf, metricsLength);
+              response->addHeader("Cache-Control", "no-cache");
+              request->send(response); });
+
   server.on("/status", HTTP_GET, [](AsyncWebServerRequest *request){
               if (!requireAuth(request)) return;
-              //const SHCIState &doorstate = emulator.getState();
+              refreshStatusCache();
+              AsyncWebServerResponse *response;
+              // If-None-Match compares weakly: a client may send our tag back as W/"..."
+              String match = request->hasHeader("If-None-Match") ? request->header("If-None-Match") : String();
+              if (match.startsWith("W/")) match.remove(0, 2);
+              if (match == statusETag){
+                response = request->beginResponse(304);
+              } else {
+                // straight from the cache, no String copy; kept until the response is out
+                statusReaders++;
+                request->onDisconnect([](){ statusReaders--; });
+                response = request->beginResponse_P(200, "application/json", (const uint8_t *)statusCache, statusLength);
+              }
+              response->addHeader("ETag", statusETag);
+              response->addHeader("Cache-Control", "no-cache");
+              request->send(response); });
+
+  server.on("/hcistats", HTTP_GET, [](AsyncWebServerRequest *request){
+              if (!requireAuth(request)) return;
               AsyncResponseStream *response = request->beginResponseStream("application/json");
               JsonDocument root;
-              //response->print(hoermannEngine->state->toStatusJson());
-              root["doorstate"] = hoermannEngine->state->translatedState;
-              root["valid"] = hoermannEngine->state->valid;
-              root["targetPosition"] = (int)(hoermannEngine->state->targetPosition * 100);
-              root["currentPosition"] = (int)(hoermannEngine->state->currentPosition * 100);
-              root["light"] = hoermannEngine->state->lightOn;
-              root["state"] = hoermannEngine->state->state;
-              root["busResponseAge"] = hoermannEngine->state->responseAge();
-              root["lastModbusRespone"] = hoermannEngine->state->lastModbusRespone;
-              root["swversion"] = HA_VERSION;
-              #ifdef SENSORS
-                JsonObject sensors  = root.createNestedObject("sensors");
-                  char buf[20];
-                #ifdef USE_DS18X20
-                  dtostrf(ds18x20_temp,2,1,buf);
-                  strcat(buf, " °C");
-                  sensors["temp"] = buf;
-                #endif
-                #ifdef USE_BME
-                  dtostrf(bme_temp,2,1,buf);
-                  strcat(buf, " °C");
-                  sensors["temp"] = buf;
-                  dtostrf(bme_hum,2,1,buf); 
-                  strcat(buf, " %");
-                  sensors["hum"] = buf;
-                  dtostrf(bme_pres,2,1,buf); 
-                  strcat(buf, " mbar");
-                  sensors["pres"] = buf;
-                #endif
-                #ifdef USE_DHT22
-                  dtostrf(dht22_temp,2,1,buf);
-                  strcat(buf, " °C");
-                  sensors["temp"] = buf;
-                  dtostrf(dht22_hum,2,1,buf); 
-                  strcat(buf, " %");
-                  sensors["hum"] = buf;
-                #endif
-                #ifdef USE_HCSR04
-                  dtostrf(hcsr04_distanceCm,2,0,buf);
-                  strcat(buf, " cm");
-                  sensors["dist"] = buf;
-                #endif
-              #endif
-              //root["debug"] = doorstate.reserved;
-              root["lastCommandTopic"] = lastCommandTopic;
-              root["lastCommandPayload"] = lastCommandPayload;
+              hoermannEngine->busMetricsJson(root.to<JsonObject>());
               serializeJson(root, *response);
               request->send(response); });
 
   server.on("/statush", HTTP_GET, [](AsyncWebServerRequest *request){
               if (!requireAuth(request)) return;
-              AsyncResponseStream *response = request->beginResponseStream("application/json");
-              response->print(hoermannEngine->state->toStatusJson());
-              request->send(response); });
+              char payload[256];
+              HoermannState::Snapshot state;
+              hoermannEngine->state->snapshot(state);
+              state.toStatusJson(payload, sizeof(payload), hoermannEngine->state->responseAge());
+              request->send(200, "application/json", payload); });
 
   server.on("/command", HTTP_GET, [](AsyncWebServerRequest *request)
             {
@@ -1252,6 +1737,19 @@ void setup()
           prefHandler.resetPreferences();
           });
 
+  // A new client starts with the full state, then gets deltas from pushStateEvent()
+  if (config.www_pass[0] != '\0'){
+    events.setAuthentication(WWW_USER, config.www_pass);
+  }
+  events.onConnect([](AsyncEventSourceClient *client){
+    HoermannState::Snapshot state;
+    hoermannEngine->state->snapshot(state);
+    char payload[192];
+    renderStateEvent(payload, sizeof(payload), state, nullptr);
+    client->send(payload, "state", state.version);
+  });
+  server.addHandler(&events);
+
   ElegantOTA.begin(&server);
   ElegantOTA.setAutoReboot(true);
   ElegantOTA.setAuth(OTA_USERNAME, OTA_PASSWD);
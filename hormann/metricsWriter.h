@@ -0,0 +1,94 @@
+#ifndef METRICSWRITER_H_
+    #define METRICSWRITER_H_
+
+        #include <Arduino.h>
+        #include <stdarg.h>
+        #include "hciMetrics.h"
+
+        // Prometheus text exposition format (0.0.4) rendered into a fixed buffer,
+        // no heap. Output that does not fit is cut at the last complete line and
+        // flagged, so a scrape never sees half a sample.
+
+        class MetricsWriter {
+        public:
+            MetricsWriter(char *buf, size_t size) : buf(buf), size(size) {
+                buf[0] = '\0';
+            }
+
+            /**
+             * # HELP / # TYPE lines of a metric family
+             */
+            void family(const char *name, const char *type, const char *help) {
+                append("# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+            }
+
+            /**
+             * One sample; labels without braces, e.g. "task=\"ModBusTask\"", or nullptr
+             */
+            void sample(const char *name, const char *labels, double value) {
+                if (labels != nullptr) {
+                    append("%s{%s} %.10g\n", name, labels, value);
+                } else {
+                    append("%s %.10g\n", name, value);
+                }
+            }
+
+            void gauge(const char *name, const char *help, double value) {
+                family(name, "gauge", help);
+                sample(name, nullptr, value);
+            }
+
+            void counter(const char *name, const char *help, double value) {
+                family(name, "counter", help);
+                sample(name, nullptr, value);
+            }
+
+            /**
+             * LogHistogram as a cumulative histogram; le is the upper bound of each
+             * log2 bucket scaled by unit (e.g. 1e-6 for microseconds to seconds). The
+             * top bucket also holds everything clamped into it, so it only shows as +Inf.
+             */
+            void histogram(const char *name, const char *help, const LogHistogram &hist, double unit) {
+                family(name, "histogram", help);
+                uint64_t cumulative = 0;
+                uint8_t last = 0;
+                for (uint8_t i = 0; i < HCI_HIST_BUCKETS - 1; i++) {
+                    if (hist.getBucket(i)) last = i + 1;
+                }
+                for (uint8_t i = 0; i < last; i++) {
+                    cumulative += hist.getBucket(i);
+                    append("%s_bucket{le=\"%.10g\"} %llu\n", name, LogHistogram::bucketLimit(i) * unit, cumulative);
+                }
+                append("%s_bucket{le=\"+Inf\"} %u\n", name, hist.getCount());
+                append("%s_sum %.10g\n", name, hist.getSum() * unit);
+                append("%s_count %u\n", name, hist.getCount());
+            }
+
+            size_t length() const {
+                return len;
+            }
+            bool truncated() const {
+                return overflow;
+            }
+
+        private:
+            char *buf;
+            size_t size;
+            size_t len = 0;
+            bool overflow = false;
+
+            void append(const char *format, ...) {
+                if (overflow) return;
+                va_list args;
+                va_start(args, format);
+                int n = vsnprintf(buf + len, size - len, format, args);
+                va_end(args);
+                if (n < 0 || (size_t)n >= size - len) {
+                    buf[len] = '\0';
+                    overflow = true;
+                    return;
+                }
+                len += n;
+            }
+        };
+#endif
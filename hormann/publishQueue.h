@@ -0,0 +1,364 @@
+#ifndef PUBLISHQUEUE_H_
+    #define PUBLISHQUEUE_H_
+
+        #include <Arduino.h>
+        #include <atomic>
+
+        // Outbound MQTT messages of the bridge. Any task may push; only the MQTT
+        // task (the owner) takes entries and hands them to AsyncMqttClient, so the
+        // client is never entered concurrently.
+        //
+        // Entries leave in priority order, oldest first within a class. A push to a
+        // topic that still has an unsent entry of the same class replaces its
+        // payload (the broker would only keep the newest anyway). When all slots are
+        // taken a push evicts the newest entry of a lower class, otherwise it is
+        // dropped.
+        //
+        // Payloads are copied into a preallocated arena of PUBLISH_PAYLOAD_BLOCK byte
+        // blocks, one contiguous run per entry, so pushing never touches the heap.
+        // When no run is free the same eviction rule makes room, otherwise the
+        // message is dropped.
+        //
+        // Backpressure: the owner stops taking entries while PUBLISH_MAX_INFLIGHT
+        // QoS>0 messages wait for their ack or the client refused a message (TCP
+        // send buffer full); the entry stays at the head and is retried. Acks wake the
+        // owner with PUBLISH_NOTIFY. A class can be paced to one message per interval,
+        // so a burst of it does not hog the link.
+
+        #define PUBLISH_QUEUE_SIZE 32           // discovery alone needs up to 18 slots
+        #define PUBLISH_TOPIC_MAX 64
+        #define PUBLISH_MAX_INFLIGHT 8
+        #define PUBLISH_RETRY_MS 50
+        #define PUBLISH_PAYLOAD_BLOCK 64
+        #define PUBLISH_PAYLOAD_BLOCKS 384      // 24 KB: a discovery set, the HCI metrics and the rest
+
+        // Task notification bit sent to the owner when something was queued or acked
+        #define PUBLISH_NOTIFY (1 << 2)
+
+        enum class PublishPriority : uint8_t {
+            STATE,          // door state, position, availability
+            ACK,            // replies to commands
+            SENSOR,
+            DISCOVERY,
+            DIAGNOSTIC,     // debug messages, bus metrics
+            COUNT
+        };
+
+        struct PublishQueueStats {
+            uint32_t depth;
+            uint32_t maxDepth;
+            uint32_t pushed;
+            uint32_t sent;
+            uint32_t coalesced;     // replaced by a newer payload for the same topic
+            uint32_t dropped;       // no slot or payload blocks left, or too long
+            uint32_t evicted;       // pushed out by a more important message
+            uint32_t refused;       // client did not take the message, retried later
+            uint32_t inflight;
+        };
+
+        class PublishQueue {
+        public:
+            struct Entry {
+                char topic[PUBLISH_TOPIC_MAX];
+                char *payload;      // in the arena
+                uint16_t blocks;
+                uint8_t qos;
+                bool retain;
+                bool coalesce;
+                bool sending;       // taken by the owner, not touched by producers
+                bool used;
+                PublishPriority priority;
+                uint32_t order;
+            };
+
+            void begin() {
+                if (lock == nullptr) lock = xSemaphoreCreateMutex();
+            }
+
+            /**
+             * Task that drains the queue; woken with PUBLISH_NOTIFY on pushes from other tasks
+             */
+            void setOwner(TaskHandle_t owner) {
+                this->owner = owner;
+            }
+
+            /**
+             * Send at most one message of priority per intervalMs, 0 = no pacing
+             */
+            void setPacing(PublishPriority priority, uint16_t intervalMs) {
+                pacing[(uint8_t)priority] = intervalMs;
+            }
+
+            /**
+             * Queue a copy of topic and payload
+             * @param coalesce false keeps every message, e.g. motion edges
+             * @return false if the message was dropped
+             */
+            bool push(const char *topic, const char *payload, uint8_t qos, bool retain,
+                      PublishPriority priority, bool coalesce = true) {
+                size_t size = strlen(payload) + 1;
+                uint16_t blocks = (size + PUBLISH_PAYLOAD_BLOCK - 1) / PUBLISH_PAYLOAD_BLOCK;
+                bool fits = strlen(topic) < PUBLISH_TOPIC_MAX && blocks <= PUBLISH_PAYLOAD_BLOCKS;
+
+                bool queued = false;
+                xSemaphoreTake(lock, portMAX_DELAY);
+                pushed++;
+                Entry *slot = nullptr;
+                bool replace = false;
+                if (fits) {
+                    slot = coalesce ? findPending(topic, priority) : nullptr;
+                    replace = slot != nullptr;
+                    if (replace) {
+                        releasePayload(*slot);          // its blocks may take the new payload
+                    } else {
+                        slot = freeSlot(priority);
+                    }
+                }
+                char *copy = slot != nullptr ? allocPayload(blocks, priority) : nullptr;
+                if (copy != nullptr) {
+                    memcpy(copy, payload, size);
+                    slot->payload = copy;
+                    slot->blocks = blocks;
+                    slot->qos = qos;
+                    slot->retain = retain;
+                    if (replace) {
+                        coalesced++;
+                    } else {
+                        strcpy(slot->topic, topic);
+                        slot->coalesce = coalesce;
+                        slot->sending = false;
+                        slot->priority = priority;
+                        slot->order = nextOrder++;
+                        slot->used = true;
+                        depth++;
+                        if (depth > maxDepth) maxDepth = depth;
+                    }
+                    queued = true;
+                } else {
+                    // a replaced payload is gone already, so is its entry
+                    if (replace) {
+                        slot->used = false;
+                        depth--;
+                    }
+                    dropped++;
+                    lost[(uint8_t)priority]++;
+                }
+                xSemaphoreGive(lock);
+
+                if (queued) notifyOwner();
+                return queued;
+            }
+
+            /**
+             * Owner only: next entry to send, nullptr if empty or backpressured.
+             * Must be followed by sent() or refused().
+             * @param waitMs with nullptr: ms until a paced entry is due, 0 when the queue is
+             *               empty or waits for acks (PUBLISH_NOTIFY follows)
+             */
+            Entry *take(unsigned long *waitMs = nullptr) {
+                if (waitMs != nullptr) *waitMs = 0;
+                if (inflight.load(std::memory_order_relaxed) >= PUBLISH_MAX_INFLIGHT) return nullptr;
+                Entry *next = nullptr;
+                unsigned long now = millis();
+                xSemaphoreTake(lock, portMAX_DELAY);
+                for (uint8_t i = 0; i < PUBLISH_QUEUE_SIZE; i++) {
+                    Entry &e = entries[i];
+                    if (!e.used) continue;
+                    uint8_t cls = (uint8_t)e.priority;
+                    if (pacing[cls] > 0 && now - lastSent[cls] < pacing[cls]) {
+                        unsigned long due = pacing[cls] - (now - lastSent[cls]);
+                        if (waitMs != nullptr && (*waitMs == 0 || due < *waitMs)) *waitMs = due;
+                        continue;
+                    }
+                    if (next == nullptr || e.priority < next->priority ||
+                        (e.priority == next->priority && (int32_t)(e.order - next->order) < 0)) {
+                        next = &e;
+                    }
+                }
+                if (next != nullptr) {
+                    next->sending = true;
+                    if (waitMs != nullptr) *waitMs = 0;
+                }
+                xSemaphoreGive(lock);
+                return next;
+            }
+
+            void sent(Entry *entry) {
+                if (entry->qos > 0) inflight.fetch_add(1, std::memory_order_relaxed);
+                xSemaphoreTake(lock, portMAX_DELAY);
+                releasePayload(*entry);
+                entry->used = false;
+                entry->sending = false;
+                lastSent[(uint8_t)entry->priority] = millis();
+                depth--;
+                sentCount++;
+                xSemaphoreGive(lock);
+            }
+
+            void refused(Entry *entry) {
+                xSemaphoreTake(lock, portMAX_DELAY);
+                entry->sending = false;
+                refusedCount++;
+                xSemaphoreGive(lock);
+            }
+
+            /**
+             * Broker acknowledged a QoS>0 message (AsyncMqttClient onPublish); wakes the owner
+             */
+            void onAck() {
+                uint32_t n = inflight.load(std::memory_order_relaxed);
+                while (n > 0 && !inflight.compare_exchange_weak(n, n - 1, std::memory_order_relaxed)) {
+                }
+                notifyOwner();
+            }
+
+            /**
+             * New connection: acks of the old one never come
+             */
+            void resetInflight() {
+                inflight.store(0, std::memory_order_relaxed);
+            }
+
+            /**
+             * Entries of priority still waiting, including one being sent
+             */
+            uint8_t queued(PublishPriority priority) {
+                uint8_t n = 0;
+                xSemaphoreTake(lock, portMAX_DELAY);
+                for (uint8_t i = 0; i < PUBLISH_QUEUE_SIZE; i++) {
+                    if (entries[i].used && entries[i].priority == priority) n++;
+                }
+                xSemaphoreGive(lock);
+                return n;
+            }
+
+            /**
+             * Messages of priority dropped or evicted so far; a change means one never went out
+             */
+            uint32_t getLost(PublishPriority priority) {
+                xSemaphoreTake(lock, portMAX_DELAY);
+                uint32_t n = lost[(uint8_t)priority];
+                xSemaphoreGive(lock);
+                return n;
+            }
+
+            PublishQueueStats getStats() {
+                PublishQueueStats stats;
+                xSemaphoreTake(lock, portMAX_DELAY);
+                stats.depth = depth;
+                stats.maxDepth = maxDepth;
+                stats.pushed = pushed;
+                stats.sent = sentCount;
+                stats.coalesced = coalesced;
+                stats.dropped = dropped;
+                stats.evicted = evicted;
+                stats.refused = refusedCount;
+                xSemaphoreGive(lock);
+                stats.inflight = inflight.load(std::memory_order_relaxed);
+                return stats;
+            }
+
+        private:
+            Entry entries[PUBLISH_QUEUE_SIZE] = {};
+            char arena[PUBLISH_PAYLOAD_BLOCKS * PUBLISH_PAYLOAD_BLOCK];
+            uint32_t blockUsed[PUBLISH_PAYLOAD_BLOCKS / 32] = {0};
+            SemaphoreHandle_t lock = nullptr;
+            TaskHandle_t owner = nullptr;
+            std::atomic<uint32_t> inflight{0};
+            uint16_t pacing[(uint8_t)PublishPriority::COUNT] = {0};
+            unsigned long lastSent[(uint8_t)PublishPriority::COUNT] = {0};
+            uint32_t nextOrder = 0;
+            uint32_t depth = 0;
+            uint32_t maxDepth = 0;
+            uint32_t pushed = 0;
+            uint32_t sentCount = 0;
+            uint32_t coalesced = 0;
+            uint32_t dropped = 0;
+            uint32_t lost[(uint8_t)PublishPriority::COUNT] = {0};   // dropped or evicted, by class
+            uint32_t evicted = 0;
+            uint32_t refusedCount = 0;
+
+            Entry *findPending(const char *topic, PublishPriority priority) {
+                for (uint8_t i = 0; i < PUBLISH_QUEUE_SIZE; i++) {
+                    Entry &e = entries[i];
+                    if (e.used && !e.sending && e.coalesce && e.priority == priority && strcmp(e.topic, topic) == 0) {
+                        return &e;
+                    }
+                }
+                return nullptr;
+            }
+
+            /**
+             * Empty slot, or the newest entry of the least important class below priority
+             */
+            Entry *freeSlot(PublishPriority priority) {
+                for (uint8_t i = 0; i < PUBLISH_QUEUE_SIZE; i++) {
+                    if (!entries[i].used) return &entries[i];
+                }
+                return evict(priority);
+            }
+
+            /**
+             * Drop the newest entry of the least important class below priority
+             * @return the freed slot, nullptr if there is none to drop
+             */
+            Entry *evict(PublishPriority priority) {
+                Entry *victim = nullptr;
+                for (uint8_t i = 0; i < PUBLISH_QUEUE_SIZE; i++) {
+                    Entry &e = entries[i];
+                    if (!e.used || e.sending || e.priority <= priority) continue;
+                    if (victim == nullptr || e.priority > victim->priority ||
+                        (e.priority == victim->priority && (int32_t)(e.order - victim->order) > 0)) {
+                        victim = &e;
+                    }
+                }
+                if (victim != nullptr) {
+                    releasePayload(*victim);
+                    victim->used = false;
+                    depth--;
+                    evicted++;
+                    lost[(uint8_t)victim->priority]++;
+                }
+                return victim;
+            }
+
+            /**
+             * First run of count free blocks, evicting lower classes until one is free
+             */
+            char *allocPayload(uint16_t count, PublishPriority priority) {
+                do {
+                    uint16_t run = 0;
+                    for (uint16_t i = 0; i < PUBLISH_PAYLOAD_BLOCKS; i++) {
+                        if (blockUsed[i / 32] & (1UL << (i % 32))) {
+                            run = 0;
+                        } else if (++run == count) {
+                            uint16_t first = i + 1 - count;
+                            markBlocks(first, count, true);
+                            return arena + first * PUBLISH_PAYLOAD_BLOCK;
+                        }
+                    }
+                } while (evict(priority) != nullptr);
+                return nullptr;
+            }
+
+            void releasePayload(Entry &entry) {
+                if (entry.payload == nullptr) return;
+                markBlocks((entry.payload - arena) / PUBLISH_PAYLOAD_BLOCK, entry.blocks, false);
+                entry.payload = nullptr;
+                entry.blocks = 0;
+            }
+
+            void markBlocks(uint16_t first, uint16_t count, bool used) {
+                for (uint16_t i = first; i < first + count; i++) {
+                    if (used) blockUsed[i / 32] |= 1UL << (i % 32);
+                    else blockUsed[i / 32] &= ~(1UL << (i % 32));
+                }
+            }
+
+            void notifyOwner() {
+                if (owner != nullptr && xTaskGetCurrentTaskHandle() != owner) {
+                    xTaskNotify(owner, PUBLISH_NOTIFY, eSetBits);
+                }
+            }
+        };
+#endif
@@ -0,0 +1,396 @@
+#ifndef SENSORDRIVERS_H_
+    #define SENSORDRIVERS_H_
+
+        #include <Arduino.h>
+        #include "configuration.h"
+        #include "sensorScheduler.h"
+
+        #ifdef USE_DS18X20
+            #include <OneWire.h>
+            #include <DallasTemperature.h>
+        #endif
+        #ifdef USE_BME
+            #include <Wire.h>
+            #include <Adafruit_Sensor.h>
+            #include <Adafruit_BME280.h>
+        #endif
+        #ifdef USE_HCSR04
+            #include "driver/rmt.h"
+        #endif
+        #ifdef USE_DHT22
+            #include <Adafruit_Sensor.h>
+            #include <DHT.h>
+        #endif
+
+        // Drivers of the optional sensors, run by the SensorScheduler
+
+        #define SENSOR_MOTION_POLL_MS 100
+        #define SENSOR_RETRY_MS 30000           // wait after a failed sensor before trying again
+        #define BME_POWER_UP_MS 10
+        #define SR04_MIN_RANGE_CM 2             // datasheet range
+        #define SR04_MAX_RANGE_CM 400
+        #define SR04_RMT_CHANNEL RMT_CHANNEL_4  // RX capable on the ESP32 and the ESP32-S3
+        #define SR04_RMT_IDLE_US 30000          // a capture ends after this much silence, > longest echo
+        #define SR04_ECHO_WAIT_MS 60            // trigger -> capture complete
+        #define SR04_WINDOW 5                   // median over this many samples
+        #define SR04_OUTLIER_CM 30
+        #define SR04_BASELINE_RISE 0.2f         // EWMA weight of a longer distance
+        #define SR04_BASELINE_DECAY 0.01f       // per sample, towards the configured distance
+
+        #ifdef USE_DS18X20
+        // Conversion is started and collected later (750 ms at 12 bit) instead of
+        // waiting for it in requestTemperatures()
+        class Ds18x20Sensor : public SensorDriver {
+        public:
+            float temperature = -99.99;
+
+            void begin(int pin, uint32_t periodMs) {
+                this->periodMs = periodMs;
+                // owned here: the DallasTemperature keeps a pointer to the bus
+                wire.begin(pin);
+                dallas.setOneWire(&wire);
+                dallas.begin();
+                dallas.setWaitForConversion(false);
+            }
+
+            const char *name() const override {
+                return "ds18x20";
+            }
+
+            uint32_t poll(unsigned long now) override {
+                if (!converting) {
+                    if (!dallas.requestTemperaturesByIndex(0)) {
+                        failure();
+                        return SENSOR_RETRY_MS;
+                    }
+                    converting = true;
+                    return dallas.millisToWaitForConversion(dallas.getResolution());
+                }
+                converting = false;
+                float value = dallas.getTempCByIndex(0);
+                if (value == DEVICE_DISCONNECTED_C) {
+                    failure();
+                } else {
+                    temperature = value;
+                    reading();
+                }
+                return periodMs;
+            }
+
+        private:
+            OneWire wire;
+            DallasTemperature dallas;
+            uint32_t periodMs = 0;
+            bool converting = false;
+        };
+        #endif
+
+        #ifdef USE_BME
+        // Powered through powerPin and initialized on first use; powered off again
+        // after a failed init or a hung bus and retried after SENSOR_RETRY_MS
+        class Bme280Sensor : public SensorDriver {
+        public:
+            float temperature = -99.99;
+            float humidity = -99.99;
+            float pressure = -99.99;        // hPa
+
+            void begin(int sdaPin, int sclPin, int powerPin, uint32_t periodMs) {
+                this->sdaPin = sdaPin;
+                this->sclPin = sclPin;
+                this->powerPin = powerPin;
+                this->periodMs = periodMs;
+                pinMode(powerPin, OUTPUT);
+                digitalWrite(powerPin, LOW);
+            }
+
+            const char *name() const override {
+                return "bme280";
+            }
+
+            uint32_t poll(unsigned long now) override {
+                switch (state) {
+                    case OFF:
+                        digitalWrite(powerPin, HIGH);
+                        state = POWERED;
+                        return BME_POWER_UP_MS;
+                    case POWERED:
+                        wire.begin(sdaPin, sclPin);
+                        // address can be 0x76 or 0x77
+                        if (!bme.begin(0x76, &wire) && !bme.begin(0x77, &wire)) {
+                            powerOff();
+                            return SENSOR_RETRY_MS;
+                        }
+                        state = READY;
+                        return 0;
+                    case READY: {
+                        float t = bme.readTemperature();
+                        float h = bme.readHumidity();
+                        float p = bme.readPressure() / 100;     // convert from pascal to mbar
+                        if (isnan(t) || h >= 99.9) {
+                            // I2C hung up ...
+                            powerOff();
+                            return SENSOR_RETRY_MS;
+                        }
+                        temperature = t;
+                        humidity = h;
+                        pressure = p;
+                        reading();
+                        return periodMs;
+                    }
+                }
+                return periodMs;
+            }
+
+        private:
+            enum State {
+                OFF,
+                POWERED,
+                READY
+            };
+            TwoWire wire = TwoWire(0);
+            Adafruit_BME280 bme;
+            State state = OFF;
+            int sdaPin = 0;
+            int sclPin = 0;
+            int powerPin = 0;
+            uint32_t periodMs = 0;
+
+            void powerOff() {
+                failure();
+                wire.end();
+                digitalWrite(powerPin, LOW);
+                state = OFF;
+            }
+        };
+        #endif
+
+        #ifdef USE_HCSR04
+        // Echo width measured by the RMT receiver at 1 us resolution: poll() sends
+        // the trigger pulse and picks the captured pulse out of the RMT ring buffer
+        // on its next step, nothing waits for the echo. Samples outside the sensor
+        // range are dropped, a jump of more than SR04_OUTLIER_CM is only taken once
+        // the next sample confirms it (the window then restarts at the new level),
+        // and distanceCm is the median of the last SR04_WINDOW samples.
+        // Parking: baselineCm is the distance to the empty floor. It starts at the
+        // configured maximum, follows longer filtered distances with an EWMA (never a
+        // single reading) and decays back towards the configured maximum, so one bad
+        // echo cannot raise it for good. The place is free while the distance is
+        // within freeBandCm of the baseline.
+        class Hcsr04Sensor : public SensorDriver {
+        public:
+            int distanceCm = 0;
+            float baselineCm = SR04_MAXDISTANCECM;
+            bool free = false;
+            uint32_t outliers = 0;
+
+            /**
+             * @param emptyCm configured distance to the floor
+             * @param freeBandCm a distance this close to the baseline counts as free
+             */
+            void begin(int trigPin, int echoPin, uint32_t periodMs, int emptyCm, int freeBandCm) {
+                this->trigPin = trigPin;
+                this->periodMs = periodMs > SR04_ECHO_WAIT_MS ? periodMs : SR04_ECHO_WAIT_MS;
+                this->emptyCm = emptyCm;
+                this->freeBandCm = freeBandCm;
+                baselineCm = emptyCm;
+                pinMode(trigPin, OUTPUT);
+                digitalWrite(trigPin, LOW);
+
+                rmt_config_t rx = RMT_DEFAULT_CONFIG_RX((gpio_num_t)echoPin, SR04_RMT_CHANNEL);
+                rx.clk_div = 80;                                // 1 us ticks
+                rx.rx_config.idle_threshold = SR04_RMT_IDLE_US;
+                rx.rx_config.filter_en = true;
+                rx.rx_config.filter_ticks_thresh = 100;         // ignore glitches < 1.25 us (APB ticks)
+                esp_err_t err = rmt_config(&rx);
+                if (err == ESP_OK) err = rmt_driver_install(SR04_RMT_CHANNEL, 256, 0);
+                if (err == ESP_OK) err = rmt_get_ringbuf_handle(SR04_RMT_CHANNEL, &ring);
+                if (err == ESP_OK) err = rmt_rx_start(SR04_RMT_CHANNEL, true);
+                if (err != ESP_OK) {
+                    ESP_LOGE("SENSOR", "hcsr04 rmt setup failed: %s", esp_err_to_name(err));
+                    ring = nullptr;
+                }
+            }
+
+            const char *name() const override {
+                return "hcsr04";
+            }
+
+            uint32_t poll(unsigned long now) override {
+                if (ring == nullptr) {
+                    failure();
+                    return SENSOR_RETRY_MS;
+                }
+                if (!triggered) {
+                    drain();
+                    // trigger pulse of 10 us
+                    digitalWrite(trigPin, HIGH);
+                    delayMicroseconds(10);
+                    digitalWrite(trigPin, LOW);
+                    triggered = true;
+                    return SR04_ECHO_WAIT_MS;
+                }
+                triggered = false;
+                uint32_t echoUs = receive();
+                float cm = echoUs * SOUND_SPEED / 2;
+                if (echoUs == 0 || cm < SR04_MIN_RANGE_CM || cm > SR04_MAX_RANGE_CM) {
+                    failure();
+                } else if (sample(cm)) {
+                    distanceCm = (int)(median() + 0.5f);
+                    track();
+                    reading();
+                }
+                return periodMs - SR04_ECHO_WAIT_MS;
+            }
+
+        private:
+            int trigPin = 0;
+            uint32_t periodMs = 0;
+            int emptyCm = 0;
+            int freeBandCm = 0;
+            RingbufHandle_t ring = nullptr;
+            bool triggered = false;
+
+            float window[SR04_WINDOW] = {0};
+            uint8_t next = 0;
+            uint8_t filled = 0;
+            bool suspect = false;
+            float suspectCm = 0;
+
+            void drain() {
+                size_t size;
+                void *items;
+                while ((items = xRingbufferReceive(ring, &size, 0)) != nullptr) {
+                    vRingbufferReturnItem(ring, items);
+                }
+            }
+
+            /**
+             * Width of the first high pulse captured since the trigger, 0 if none
+             */
+            uint32_t receive() {
+                size_t size;
+                uint32_t echoUs = 0;
+                rmt_item32_t *items = (rmt_item32_t *)xRingbufferReceive(ring, &size, 0);
+                if (items == nullptr) return 0;
+                for (size_t i = 0; i < size / sizeof(rmt_item32_t) && echoUs == 0; i++) {
+                    if (items[i].level0 == 1) echoUs = items[i].duration0;
+                    else if (items[i].level1 == 1) echoUs = items[i].duration1;
+                }
+                vRingbufferReturnItem(ring, items);
+                return echoUs;
+            }
+
+            /**
+             * Add a sample to the window unless it is an unconfirmed jump
+             */
+            bool sample(float cm) {
+                if (filled > 0 && fabsf(cm - median()) > SR04_OUTLIER_CM) {
+                    if (!suspect || fabsf(cm - suspectCm) > SR04_OUTLIER_CM) {
+                        suspect = true;
+                        suspectCm = cm;
+                        outliers++;
+                        return false;
+                    }
+                    // confirmed, a car really came or left: start over at the new level
+                    filled = 0;
+                    next = 0;
+                    push(suspectCm);
+                }
+                suspect = false;
+                push(cm);
+                return true;
+            }
+
+            void push(float cm) {
+                window[next] = cm;
+                next = (next + 1) % SR04_WINDOW;
+                if (filled < SR04_WINDOW) filled++;
+            }
+
+            float median() const {
+                float sorted[SR04_WINDOW];
+                for (uint8_t i = 0; i < filled; i++) {
+                    uint8_t j = i;
+                    for (; j > 0 && sorted[j - 1] > window[i]; j--) sorted[j] = sorted[j - 1];
+                    sorted[j] = window[i];
+                }
+                return sorted[filled / 2];
+            }
+
+            void track() {
+                if (distanceCm > baselineCm) {
+                    baselineCm += SR04_BASELINE_RISE * (distanceCm - baselineCm);
+                }
+                baselineCm += SR04_BASELINE_DECAY * (emptyCm - baselineCm);
+                free = distanceCm + freeBandCm > baselineCm;
+            }
+        };
+        #endif
+
+        #ifdef USE_DHT22
+        // The DHT library blocks ~25 ms per transfer and caches the result for 2 s,
+        // so one poll costs a single transfer
+        class Dht22Sensor : public SensorDriver {
+        public:
+            float temperature = -99.99;
+            float humidity = -99.99;
+
+            void begin(int pin, uint32_t periodMs) {
+                this->periodMs = periodMs;
+                dht = new DHT(pin, DHTTYPE);
+                dht->begin();
+            }
+
+            const char *name() const override {
+                return "dht22";
+            }
+
+            uint32_t poll(unsigned long now) override {
+                float t = dht->readTemperature();
+                float h = dht->readHumidity();
+                if (isnan(t) || isnan(h)) {
+                    failure();
+                    return periodMs;
+                }
+                temperature = t;
+                humidity = h;
+                reading();
+                return periodMs;
+            }
+
+        private:
+            DHT *dht = nullptr;
+            uint32_t periodMs = 0;
+        };
+        #endif
+
+        #ifdef USE_HCSR501
+        // PIR motion output, every edge is a reading
+        class MotionSensor : public SensorDriver {
+        public:
+            bool motion = false;
+
+            void begin(int pin) {
+                this->pin = pin;
+                pinMode(pin, INPUT);
+                motion = digitalRead(pin);      // first state of the sensor
+            }
+
+            const char *name() const override {
+                return "hcsr501";
+            }
+
+            uint32_t poll(unsigned long now) override {
+                bool state = digitalRead(pin);
+                if (state != motion) {
+                    motion = state;
+                    reading();
+                }
+                return SENSOR_MOTION_POLL_MS;
+            }
+
+        private:
+            int pin = 0;
+        };
+        #endif
+#endif
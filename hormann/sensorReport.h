@@ -0,0 +1,152 @@
+#ifndef SENSORREPORT_H_
+    #define SENSORREPORT_H_
+
+        #include <Arduino.h>
+        #include "ArduinoJson.h"
+
+        // When a measured quantity is worth publishing. Every sample goes through
+        //   EWMA       optional smoothing, alpha 1 passes samples through
+        //   deadband   due once the value moved at least this far from the last
+        //              published value (0 = every sample)
+        //   min gap    a due value waits until minIntervalMs passed since the last
+        //              publish, only the newest value is sent then
+        //   heartbeat  due anyway heartbeatMs after the last publish
+        // All quantities share one sensor payload, so the set publishes as a whole
+        // once any of them is due. Owned by the sensor task, no locking.
+
+        #define SENSOR_MAX_REPORTS 8
+
+        struct SensorReportStats {
+            uint32_t samples = 0;
+            uint32_t changes = 0;           // publishes this quantity asked for
+            uint32_t heartbeats = 0;
+            uint32_t suppressed = 0;        // samples inside the deadband
+            uint32_t throttled = 0;         // changes held back by the min gap
+        };
+
+        class SensorReport {
+        public:
+            SensorReport(const char *sensor, const char *quantity) : sensor(sensor), quantity(quantity) {
+            }
+
+            void begin(float deadband, float alpha, uint32_t minIntervalMs, uint32_t heartbeatMs) {
+                this->deadband = deadband;
+                this->alpha = alpha > 0 && alpha < 1 ? alpha : 1;
+                this->minIntervalMs = minIntervalMs;
+                this->heartbeatMs = heartbeatMs;
+            }
+
+            void sample(float raw, unsigned long now) {
+                stats.samples++;
+                current = valid ? current + alpha * (raw - current) : raw;
+                valid = true;
+                if (!publishedOnce || fabsf(current - published) >= deadband) {
+                    if (!pending && publishedOnce && now - lastPublish < minIntervalMs) stats.throttled++;
+                    pending = true;
+                } else {
+                    stats.suppressed++;
+                }
+            }
+
+            bool due(unsigned long now) const {
+                if (!valid) return false;
+                if (pending) return !publishedOnce || now - lastPublish >= minIntervalMs;
+                return heartbeatMs > 0 && now - lastPublish >= heartbeatMs;
+            }
+
+            /**
+             * The current value went out; heartbeat tells why, for the counters
+             */
+            void markPublished(unsigned long now) {
+                if (!valid) return;
+                if (pending) stats.changes++;
+                else if (due(now)) stats.heartbeats++;
+                published = current;
+                publishedOnce = true;
+                pending = false;
+                lastPublish = now;
+            }
+
+            float value() const {
+                return current;
+            }
+            const char *getSensor() const {
+                return sensor;
+            }
+            const char *getQuantity() const {
+                return quantity;
+            }
+            const SensorReportStats &getStats() const {
+                return stats;
+            }
+
+        private:
+            const char *sensor;
+            const char *quantity;
+            float deadband = 0;
+            float alpha = 1;
+            uint32_t minIntervalMs = 0;
+            uint32_t heartbeatMs = 0;
+
+            float current = 0;
+            bool valid = false;
+            float published = 0;
+            bool publishedOnce = false;
+            bool pending = false;
+            unsigned long lastPublish = 0;
+            SensorReportStats stats;
+        };
+
+        class SensorReportSet {
+        public:
+            bool add(SensorReport *report) {
+                if (count >= SENSOR_MAX_REPORTS) return false;
+                reports[count++] = report;
+                return true;
+            }
+
+            bool due(unsigned long now) const {
+                for (uint8_t i = 0; i < count; i++) {
+                    if (reports[i]->due(now)) return true;
+                }
+                return false;
+            }
+
+            void markPublished(unsigned long now) {
+                for (uint8_t i = 0; i < count; i++) {
+                    reports[i]->markPublished(now);
+                }
+                publishes++;
+            }
+
+            uint8_t size() const {
+                return count;
+            }
+            const SensorReport *get(uint8_t i) const {
+                return reports[i];
+            }
+            uint32_t getPublishes() const {
+                return publishes;
+            }
+
+            void toJson(JsonObject obj) const {
+                obj["publishes"] = publishes;
+                for (uint8_t i = 0; i < count; i++) {
+                    const SensorReportStats &stats = reports[i]->getStats();
+                    JsonObject sensor = obj[reports[i]->getSensor()];
+                    if (sensor.isNull()) sensor = obj.createNestedObject(reports[i]->getSensor());
+                    JsonObject report = sensor.createNestedObject(reports[i]->getQuantity());
+                    report["samples"] = stats.samples;
+                    report["changes"] = stats.changes;
+                    report["heartbeats"] = stats.heartbeats;
+                    report["suppressed"] = stats.suppressed;
+                    report["throttled"] = stats.throttled;
+                }
+            }
+
+        private:
+            SensorReport *reports[SENSOR_MAX_REPORTS] = {nullptr};
+            uint8_t count = 0;
+            uint32_t publishes = 0;
+        };
+#endif
@@ -0,0 +1,128 @@
+#ifndef SENSORSCHEDULER_H_
+    #define SENSORSCHEDULER_H_
+
+        #include <Arduino.h>
+        #include "ArduinoJson.h"
+
+        // Cooperative scheduler of the sensor task. Every sensor is a driver with a
+        // small state machine: poll() does one short step (start a conversion, read
+        // a finished one, ...) and says when it wants to run next. The task sleeps
+        // until the earliest driver is due, so slow sensors never hold up the others
+        // and the task spends its time blocked in vTaskDelay, not in sensor code.
+        // A driver flags a finished reading; the task takes it and turns it into a
+        // publish event.
+
+        #define SENSOR_MAX_DRIVERS 6
+        #define SENSOR_MAX_SLEEP_MS 1000        // upper bound of one task sleep
+
+        struct SensorDriverStats {
+            uint32_t polls = 0;
+            uint32_t readings = 0;
+            uint32_t failures = 0;
+            uint32_t lastPollUs = 0;
+            uint32_t maxPollUs = 0;             // longest single poll() step
+        };
+
+        class SensorDriver {
+        public:
+            virtual ~SensorDriver() {}
+
+            virtual const char *name() const = 0;
+
+            /**
+             * One non-blocking step
+             * @return ms until the driver wants to run again
+             */
+            virtual uint32_t poll(unsigned long now) = 0;
+
+            /**
+             * true once for every new reading
+             */
+            bool takeReading() {
+                bool fresh = pending;
+                pending = false;
+                return fresh;
+            }
+
+            const SensorDriverStats &getStats() const {
+                return stats;
+            }
+
+        protected:
+            void reading() {
+                pending = true;
+                stats.readings++;
+            }
+            void failure() {
+                stats.failures++;
+            }
+
+        private:
+            friend class SensorScheduler;
+            SensorDriverStats stats;
+            volatile bool pending = false;
+            unsigned long due = 0;
+        };
+
+        class SensorScheduler {
+        public:
+            /**
+             * Register a driver, it first runs on the next run()
+             */
+            bool add(SensorDriver *driver) {
+                if (count >= SENSOR_MAX_DRIVERS) return false;
+                driver->due = millis();
+                drivers[count++] = driver;
+                return true;
+            }
+
+            /**
+             * Poll every driver that is due
+             * @return ms until the next driver is due
+             */
+            uint32_t run() {
+                unsigned long now = millis();
+                uint32_t sleep = SENSOR_MAX_SLEEP_MS;
+                for (uint8_t i = 0; i < count; i++) {
+                    SensorDriver *driver = drivers[i];
+                    if ((long)(now - driver->due) >= 0) {
+                        unsigned long start = micros();
+                        uint32_t next = driver->poll(now);
+                        uint32_t took = micros() - start;
+                        SensorDriverStats &stats = driver->stats;
+                        stats.polls++;
+                        stats.lastPollUs = took;
+                        if (took > stats.maxPollUs) stats.maxPollUs = took;
+                        now = millis();
+                        driver->due = now + next;
+                    }
+                    uint32_t wait = (long)(driver->due - now) > 0 ? driver->due - now : 0;
+                    if (wait < sleep) sleep = wait;
+                }
+                return sleep;
+            }
+
+            uint8_t size() const {
+                return count;
+            }
+            const SensorDriver *get(uint8_t i) const {
+                return drivers[i];
+            }
+
+            void toJson(JsonObject obj) const {
+                for (uint8_t i = 0; i < count; i++) {
+                    const SensorDriverStats &stats = drivers[i]->getStats();
+                    JsonObject driver = obj.createNestedObject(drivers[i]->name());
+                    driver["polls"] = stats.polls;
+                    driver["readings"] = stats.readings;
+                    driver["failures"] = stats.failures;
+                    driver["lastPollUs"] = stats.lastPollUs;
+                    driver["maxPollUs"] = stats.maxPollUs;
+                }
+            }
+
+        private:
+            SensorDriver *drivers[SENSOR_MAX_DRIVERS] = {nullptr};
+            uint8_t count = 0;
+        };
+#endif
@@ -0,0 +1,114 @@
+#ifndef STATESERIALIZER_H_
+    #define STATESERIALIZER_H_
+
+        #include <Arduino.h>
+
+        // JSON payload with a fixed layout: every field gets a slot of fixed width,
+        // laid out once. An update only rewrites the slots whose value changed, and
+        // the payload is only due for publishing when a byte actually changed.
+        // Values narrower than their slot are padded with blanks after the value,
+        // which is plain JSON whitespace:
+        //   {"valid":true ,"doorposition":5  ,"doorstate":"open"   }
+
+        template <uint8_t FIELDS, size_t SIZE>
+        class FixedPayload {
+        public:
+            /**
+             * Append a field to the layout, before finish()
+             * @param width widest value; quoted values are wrapped in quotes on top of it
+             * @return field index
+             */
+            uint8_t field(const char *key, uint8_t width, bool quoted) {
+                uint8_t index = count++;
+                int len = snprintf(buf + length, SIZE - length, "%s\"%s\":", index == 0 ? "{" : ",", key);
+                length += len;
+                slots[index].offset = length;
+                slots[index].width = width + (quoted ? 2 : 0);
+                slots[index].quoted = quoted;
+                memset(buf + length, ' ', slots[index].width);
+                length += slots[index].width;
+                return index;
+            }
+
+            void finish() {
+                buf[length++] = '}';
+                buf[length] = '\0';
+            }
+
+            void setText(uint8_t index, const char *value) {
+                const Slot &slot = slots[index];
+                char field[64];
+                uint8_t n = 0;
+                uint8_t width = slot.width < sizeof(field) ? slot.width : sizeof(field);
+                if (slot.quoted) field[n++] = '"';
+                while (*value && n < width - (slot.quoted ? 1 : 0)) field[n++] = *value++;
+                if (slot.quoted) field[n++] = '"';
+                while (n < width) field[n++] = ' ';
+                patch(slot, field);
+            }
+
+            void setInt(uint8_t index, int value) {
+                char text[12];
+                snprintf(text, sizeof(text), "%d", value);
+                setText(index, text);
+            }
+
+            void setBool(uint8_t index, bool value) {
+                setText(index, value ? "true" : "false");
+            }
+
+            /**
+             * true if the bytes differ from the last taken payload; marks them as taken
+             */
+            bool take() {
+                bool due = dirty;
+                dirty = false;
+                return due;
+            }
+
+            const char *c_str() const {
+                return buf;
+            }
+
+        private:
+            struct Slot {
+                uint16_t offset;
+                uint8_t width;
+                bool quoted;
+            };
+            char buf[SIZE];
+            Slot slots[FIELDS];
+            uint8_t count = 0;
+            size_t length = 0;
+            bool dirty = true;
+
+            void patch(const Slot &slot, const char *field) {
+                if (memcmp(buf + slot.offset, field, slot.width) != 0) {
+                    memcpy(buf + slot.offset, field, slot.width);
+                    dirty = true;
+                }
+            }
+        };
+
+        // Last payload sent on a topic with a plain text value
+        template <size_t SIZE>
+        class CachedText {
+        public:
+            /**
+             * true if text differs from the last taken one; it becomes the cached value
+             */
+            bool take(const char *text) {
+                if (strncmp(buf, text, SIZE) == 0) return false;
+                strncpy(buf, text, SIZE - 1);
+                buf[SIZE - 1] = '\0';
+                return true;
+            }
+
+            const char *c_str() const {
+                return buf;
+            }
+
+        private:
+            char buf[SIZE] = {0};
+        };
+#endif
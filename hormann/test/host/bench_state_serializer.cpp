@@ -0,0 +1,132 @@
+// Cost of one door state update: patching the fixed-layout payload
+// (stateSerializer.h) against building and serializing it with ArduinoJson,
+// as updateDoorStatus() did before. The door opens step by step, each step
+// is followed by a repeat of the same state (a snapshot with nothing new).
+// The ArduinoJson side is built with: make bench ARDUINOJSON=<ArduinoJson>/src
+#include <chrono>
+#include <new>
+#include "Arduino.h"
+#include "configuration.h"
+#include "stateSerializer.h"
+#ifdef BENCH_ARDUINOJSON
+    #include <ArduinoJson.h>
+#endif
+
+static unsigned long allocations = 0;
+
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *malloc(size_t size) {
+    allocations++;
+    return __libc_malloc(size);
+}
+void *operator new(size_t size) {
+    void *p = malloc(size);
+    if (p == nullptr) throw std::bad_alloc();
+    return p;
+}
+void operator delete(void *p) noexcept {
+    free(p);
+}
+void operator delete(void *p, size_t) noexcept {
+    free(p);
+}
+
+struct DoorState {
+    bool valid;
+    int position;
+    bool lightOn;
+    const char *coverState;
+    const char *translatedState;
+};
+
+#define STEPS 101
+#define ROUNDS 2000
+static DoorState steps[STEPS * 2];
+static unsigned long published = 0;
+static volatile size_t sink = 0;
+
+static void buildSteps() {
+    for (int i = 0; i < STEPS; i++) {
+        DoorState s = {true, i, i > 10, i < 100 ? "opening" : "open", i < 100 ? "opening" : "open"};
+        steps[2 * i] = s;
+        steps[2 * i + 1] = s;
+    }
+}
+
+FixedPayload<7, 192> fixedPayload;
+uint8_t fields[7];
+
+static void setupFixed() {
+    fields[0] = fixedPayload.field("valid", 5, false);
+    fields[1] = fixedPayload.field("doorposition", 3, false);
+    fields[2] = fixedPayload.field("lamp", 5, true);
+    fields[3] = fixedPayload.field("doorstate", 7, true);
+    fields[4] = fixedPayload.field("detailedState", 9, true);
+    fields[5] = fixedPayload.field("vent", 7, true);
+    fields[6] = fixedPayload.field("half", 5, true);
+    fixedPayload.finish();
+}
+
+static void updateFixed(const DoorState &s) {
+    fixedPayload.setBool(fields[0], s.valid);
+    fixedPayload.setInt(fields[1], s.position);
+    fixedPayload.setText(fields[2], s.lightOn ? HA_ON : HA_OFF);
+    fixedPayload.setText(fields[3], s.coverState);
+    fixedPayload.setText(fields[4], s.translatedState);
+    fixedPayload.setText(fields[5], HA_CLOSE);
+    fixedPayload.setText(fields[6], HA_CLOSE);
+    if (fixedPayload.take()) {
+        published++;
+        sink += strlen(fixedPayload.c_str());
+    }
+}
+
+#ifdef BENCH_ARDUINOJSON
+static void updateArduinoJson(const DoorState &s) {
+    #if ARDUINOJSON_VERSION_MAJOR >= 7
+    JsonDocument doc;
+    #else
+    StaticJsonDocument<256> doc;
+    #endif
+    char payload[1024];
+    doc["valid"] = s.valid;
+    doc["doorposition"] = s.position;
+    doc["lamp"] = s.lightOn ? HA_ON : HA_OFF;
+    doc["doorstate"] = s.coverState;
+    doc["detailedState"] = s.translatedState;
+    doc["vent"] = HA_CLOSE;
+    doc["half"] = HA_CLOSE;
+    sink += serializeJson(doc, payload, sizeof(payload));
+    published++;
+}
+#endif
+
+template <typename Update>
+static void run(const char *name, Update update) {
+    published = 0;
+    allocations = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int round = 0; round < ROUNDS; round++) {
+        for (int i = 0; i < STEPS * 2; i++) {
+            update(steps[i]);
+        }
+    }
+    auto end = std::chrono::steady_clock::now();
+    double updates = (double)ROUNDS * STEPS * 2;
+    double ns = std::chrono::duration<double, std::nano>(end - start).count() / updates;
+    printf("%-12s %8.1f ns/update  %6.3f allocations/update  %5.1f%% published\n",
+           name, ns, allocations / updates, 100.0 * published / updates);
+}
+
+int main() {
+    buildSteps();
+    setupFixed();
+    printf("%d updates, %d state changes per pass\n", STEPS * 2, STEPS);
+    run("FixedPayload", updateFixed);
+#ifdef BENCH_ARDUINOJSON
+    run("ArduinoJson", updateArduinoJson);
+#else
+    printf("ArduinoJson  not built, pass ARDUINOJSON=<ArduinoJson>/src\n");
+#endif
+    return 0;
+}
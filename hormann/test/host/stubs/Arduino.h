@@ -0,0 +1,123 @@
+// Host stand-in for the parts of Arduino-ESP32 / ESP-IDF / FreeRTOS the bridge
+// headers use. Time is a fake clock the tests advance; tasks and queues do nothing.
+#ifndef HOST_ARDUINO_H_
+    #define HOST_ARDUINO_H_
+
+        #include <stdint.h>
+        #include <stddef.h>
+        #include <stdarg.h>
+        #include <stdio.h>
+        #include <stdlib.h>
+        #include <string.h>
+        #include <math.h>
+        #include <string>
+
+        inline unsigned long &hostMicros() {
+            static unsigned long us = 1000000;
+            return us;
+        }
+        inline unsigned long micros() {
+            return hostMicros();
+        }
+        inline unsigned long millis() {
+            return hostMicros() / 1000;
+        }
+        inline void hostAdvanceUs(unsigned long us) {
+            hostMicros() += us;
+        }
+        inline void delay(unsigned long ms) {
+            hostAdvanceUs(ms * 1000);
+        }
+
+        // ESP-IDF
+        typedef int esp_err_t;
+        #define ESP_OK 0
+        #define ESP_FAIL -1
+        inline const char *esp_err_to_name(esp_err_t) {
+            return "host";
+        }
+        #define ESP_LOGE(tag, ...) do {} while (0)
+        #define ESP_LOGW(tag, ...) do {} while (0)
+        #define ESP_LOGI(tag, ...) do {} while (0)
+        #define ESP_LOGD(tag, ...) do {} while (0)
+        #define ESP_LOGV(tag, ...) do {} while (0)
+
+        // FreeRTOS
+        typedef void *TaskHandle_t;
+        typedef void *QueueHandle_t;
+        typedef uint32_t TickType_t;
+        typedef int BaseType_t;
+        typedef unsigned int UBaseType_t;
+        typedef void (*TaskFunction_t)(void *);
+        enum eNotifyAction { eNoAction, eSetBits, eIncrement, eSetValueWithOverwrite };
+        #define configMAX_PRIORITIES 25
+        #define configMAX_TASK_NAME_LEN 16
+        #define portNUM_PROCESSORS 2
+        #define portMAX_DELAY 0xFFFFFFFFU
+        #define pdTRUE 1
+        #define pdFALSE 0
+        #define pdPASS 1
+        #define pdMS_TO_TICKS(ms) (ms)
+        typedef void *SemaphoreHandle_t;
+        inline SemaphoreHandle_t xSemaphoreCreateMutex() {
+            static int mutex;
+            return &mutex;
+        }
+        inline BaseType_t xSemaphoreTake(SemaphoreHandle_t, TickType_t) {
+            return pdTRUE;
+        }
+        inline BaseType_t xSemaphoreGive(SemaphoreHandle_t) {
+            return pdTRUE;
+        }
+        inline TaskHandle_t xTaskGetCurrentTaskHandle() {
+            return nullptr;
+        }
+        inline BaseType_t xTaskCreatePinnedToCore(TaskFunction_t, const char *, uint32_t, void *, UBaseType_t, TaskHandle_t *handle, BaseType_t) {
+            if (handle != nullptr) *handle = nullptr;
+            return pdPASS;
+        }
+        inline BaseType_t xTaskNotify(TaskHandle_t, uint32_t, eNotifyAction) {
+            return pdPASS;
+        }
+        inline void vTaskDelete(TaskHandle_t) {}
+        inline void vTaskDelay(TickType_t ticks) {
+            delay(ticks);
+        }
+        inline BaseType_t xQueueReset(QueueHandle_t) {
+            return pdPASS;
+        }
+        inline TaskHandle_t xTaskGetCurrentTaskHandleForCPU(BaseType_t) {
+            return nullptr;
+        }
+        inline BaseType_t xPortGetCoreID() {
+            return 1;
+        }
+        inline const char *pcTaskGetName(TaskHandle_t) {
+            return "host";
+        }
+
+        inline size_t strlcpy(char *dst, const char *src, size_t size) {
+            size_t len = strlen(src);
+            if (size > 0) {
+                size_t n = len < size - 1 ? len : size - 1;
+                memcpy(dst, src, n);
+                dst[n] = '\0';
+            }
+            return len;
+        }
+
+        struct HostEsp {
+            void restart() {
+                abort();
+            }
+        };
+        static HostEsp ESP;
+
+        // Arduino String, only what the headers touch
+        class String : public std::string {
+        public:
+            String() {}
+            String(const char *s) : std::string(s != nullptr ? s : "") {}
+            String(const std::string &s) : std::string(s) {}
+        };
+#endif
@@ -0,0 +1,47 @@
+// Host Preferences: every key is absent, reads return the caller's default
+#ifndef HOST_PREFERENCES_H_
+    #define HOST_PREFERENCES_H_
+
+        #include <Arduino.h>
+
+        class Preferences {
+        public:
+            bool begin(const char *, bool = false) {
+                return true;
+            }
+            void end() {}
+            bool clear() {
+                return true;
+            }
+            bool isKey(const char *) {
+                return false;
+            }
+            int32_t getInt(const char *, int32_t value = 0) {
+                return value;
+            }
+            bool getBool(const char *, bool value = false) {
+                return value;
+            }
+            float getFloat(const char *, float value = 0) {
+                return value;
+            }
+            double getDouble(const char *, double value = 0) {
+                return value;
+            }
+            String getString(const char *, const String &value = String()) {
+                return value;
+            }
+            size_t putInt(const char *, int32_t) {
+                return 4;
+            }
+            size_t putFloat(const char *, float) {
+                return 4;
+            }
+            size_t putBool(const char *, bool) {
+                return 1;
+            }
+            size_t putString(const char *, const char *value) {
+                return strlen(value);
+            }
+        };
+#endif
@@ -0,0 +1,16 @@
+#ifndef HOST_STREAM_H_
+    #define HOST_STREAM_H_
+
+        #include <Arduino.h>
+
+        class Stream {
+        public:
+            virtual ~Stream() {}
+            virtual int available() = 0;
+            virtual int read() = 0;
+            virtual int peek() = 0;
+            virtual size_t write(uint8_t c) = 0;
+            virtual size_t write(const uint8_t *buffer, size_t size) = 0;
+            virtual void flush() = 0;
+        };
+#endif
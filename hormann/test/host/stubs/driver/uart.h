@@ -0,0 +1,113 @@
+// Host UART: uart_read_bytes() takes bytes the test queued with hostUartFeed(),
+// which also posts the RX timeout event the bus task waits for (xQueueReceive);
+// uart_write_bytes() records the last reply in hostUart().tx.
+#ifndef HOST_DRIVER_UART_H_
+    #define HOST_DRIVER_UART_H_
+
+        #include <Arduino.h>
+
+        typedef int uart_port_t;
+        #define UART_NUM_2 2
+        #define UART_PIN_NO_CHANGE -1
+        enum { UART_DATA_8_BITS };
+        enum { UART_PARITY_EVEN };
+        enum { UART_STOP_BITS_1 };
+        enum { UART_HW_FLOWCTRL_DISABLE };
+        enum uart_event_type_t { UART_DATA, UART_FIFO_OVF, UART_BUFFER_FULL, UART_PARITY_ERR, UART_FRAME_ERR, UART_BREAK };
+
+        struct uart_config_t {
+            int baud_rate;
+            int data_bits;
+            int parity;
+            int stop_bits;
+            int flow_ctrl;
+        };
+        struct uart_event_t {
+            uart_event_type_t type;
+            size_t size;
+            bool timeout_flag;
+        };
+
+        struct HostUart {
+            uint8_t rx[256];
+            size_t rxLen = 0;
+            size_t rxPos = 0;
+            uint8_t tx[64];
+            size_t txLen = 0;
+            bool event = false;
+            bool overflow = false;
+        };
+        inline HostUart &hostUart() {
+            static HostUart uart;
+            return uart;
+        }
+        inline void hostUartFeed(const uint8_t *data, size_t len) {
+            HostUart &u = hostUart();
+            memcpy(u.rx, data, len);
+            u.rxLen = len;
+            u.rxPos = 0;
+            u.event = true;
+        }
+        // Next wait reports a FIFO overflow before the data
+        inline void hostUartOverflow() {
+            hostUart().overflow = true;
+        }
+
+        // The only queue the bridge waits on is the UART event queue
+        inline BaseType_t xQueueReceive(QueueHandle_t, void *item, TickType_t) {
+            HostUart &u = hostUart();
+            uart_event_t *event = (uart_event_t *)item;
+            if (u.overflow) {
+                u.overflow = false;
+                event->type = UART_FIFO_OVF;
+                event->size = 0;
+                event->timeout_flag = false;
+                return pdTRUE;
+            }
+            if (!u.event) return pdFALSE;
+            u.event = false;
+            event->type = UART_DATA;
+            event->size = u.rxLen - u.rxPos;
+            event->timeout_flag = true;
+            return pdTRUE;
+        }
+
+        inline esp_err_t uart_driver_install(uart_port_t, int, int, int, QueueHandle_t *queue, int) {
+            *queue = nullptr;
+            return ESP_OK;
+        }
+        inline esp_err_t uart_param_config(uart_port_t, const uart_config_t *) {
+            return ESP_OK;
+        }
+        inline esp_err_t uart_set_pin(uart_port_t, int, int, int, int) {
+            return ESP_OK;
+        }
+        inline esp_err_t uart_set_rx_timeout(uart_port_t, int) {
+            return ESP_OK;
+        }
+        inline esp_err_t uart_flush_input(uart_port_t) {
+            hostUart().rxPos = hostUart().rxLen;
+            return ESP_OK;
+        }
+        inline esp_err_t uart_get_buffered_data_len(uart_port_t, size_t *size) {
+            *size = hostUart().rxLen - hostUart().rxPos;
+            return ESP_OK;
+        }
+        inline int uart_read_bytes(uart_port_t, uint8_t *buf, uint32_t len, TickType_t) {
+            HostUart &u = hostUart();
+            size_t n = u.rxLen - u.rxPos;
+            if (n > len) n = len;
+            memcpy(buf, u.rx + u.rxPos, n);
+            u.rxPos += n;
+            return (int)n;
+        }
+        inline int uart_write_bytes(uart_port_t, const char *buf, size_t len) {
+            HostUart &u = hostUart();
+            u.txLen = len < sizeof(u.tx) ? len : sizeof(u.tx);
+            memcpy(u.tx, buf, u.txLen);
+            return (int)len;
+        }
+        inline esp_err_t uart_wait_tx_done(uart_port_t, TickType_t) {
+            return ESP_OK;
+        }
+#endif
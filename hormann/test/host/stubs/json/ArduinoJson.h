@@ -0,0 +1,70 @@
+// Compile-only ArduinoJson stand-in for host tests that never render JSON.
+// Every write is discarded and every read is null; the benchmark builds
+// against the real library instead (see ../Makefile).
+#ifndef HOST_ARDUINOJSON_H_
+    #define HOST_ARDUINOJSON_H_
+
+        #include <Arduino.h>
+
+        class JsonObject;
+        class JsonArray;
+
+        class JsonVariantConst {
+        public:
+            bool isNull() const {
+                return true;
+            }
+            template <typename T> T as() const {
+                return T();
+            }
+            template <typename T> bool operator==(const T &) const {
+                return false;
+            }
+        };
+
+        class JsonVariant : public JsonVariantConst {
+        public:
+            template <typename T> JsonVariant &operator=(const T &) {
+                return *this;
+            }
+            template <typename K> JsonVariant operator[](const K &) const {
+                return JsonVariant();
+            }
+            operator JsonObject() const;
+            operator JsonArray() const;
+        };
+
+        class JsonObject : public JsonVariant {
+        public:
+            template <typename K> JsonVariant operator[](const K &) const {
+                return JsonVariant();
+            }
+            template <typename K> JsonObject createNestedObject(const K &) const {
+                return JsonObject();
+            }
+            template <typename K> JsonArray createNestedArray(const K &) const;
+        };
+
+        class JsonArray : public JsonVariant {
+        public:
+            template <typename T> bool add(const T &) const {
+                return true;
+            }
+            JsonObject createNestedObject() const {
+                return JsonObject();
+            }
+        };
+
+        template <typename K> JsonArray JsonObject::createNestedArray(const K &) const {
+            return JsonArray();
+        }
+        inline JsonVariant::operator JsonObject() const {
+            return JsonObject();
+        }
+        inline JsonVariant::operator JsonArray() const {
+            return JsonArray();
+        }
+
+        class JsonDocument : public JsonObject {
+        };
+#endif
@@ -0,0 +1,29 @@
+#ifndef HOST_NVS_H_
+    #define HOST_NVS_H_
+
+        #include <Arduino.h>
+
+        typedef uint32_t nvs_handle_t;
+        enum nvs_open_mode_t { NVS_READONLY, NVS_READWRITE };
+
+        inline esp_err_t nvs_open(const char *, nvs_open_mode_t, nvs_handle_t *handle) {
+            *handle = 1;
+            return ESP_OK;
+        }
+        inline esp_err_t nvs_set_str(nvs_handle_t, const char *, const char *) {
+            return ESP_OK;
+        }
+        inline esp_err_t nvs_set_i32(nvs_handle_t, const char *, int32_t) {
+            return ESP_OK;
+        }
+        inline esp_err_t nvs_set_u8(nvs_handle_t, const char *, uint8_t) {
+            return ESP_OK;
+        }
+        inline esp_err_t nvs_set_blob(nvs_handle_t, const char *, const void *, size_t) {
+            return ESP_OK;
+        }
+        inline esp_err_t nvs_commit(nvs_handle_t) {
+            return ESP_OK;
+        }
+        inline void nvs_close(nvs_handle_t) {}
+#endif
@@ -0,0 +1,150 @@
+// The bus path must not touch the heap once the engine is set up: frames in,
+// replies out, state published, read back and queued for MQTT. Every allocation through
+// operator new or malloc is counted while the master's traffic is replayed.
+#include <stdlib.h>
+#include <stdio.h>
+#include <new>
+#include "hoermann.h"
+#include "publishQueue.h"
+
+static bool counting = false;
+static unsigned long allocations = 0;
+
+void *operator new(size_t size) {
+    if (counting) allocations++;
+    void *p = malloc(size);
+    if (p == nullptr) throw std::bad_alloc();
+    return p;
+}
+void *operator new[](size_t size) {
+    return operator new(size);
+}
+void operator delete(void *p) noexcept {
+    free(p);
+}
+void operator delete[](void *p) noexcept {
+    free(p);
+}
+void operator delete(void *p, size_t) noexcept {
+    free(p);
+}
+void operator delete[](void *p, size_t) noexcept {
+    free(p);
+}
+
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *malloc(size_t size) {
+    if (counting) allocations++;
+    return __libc_malloc(size);
+}
+
+static size_t frame(uint8_t *buf, uint8_t address, uint8_t function, const uint8_t *body, size_t len) {
+    buf[0] = address;
+    buf[1] = function;
+    memcpy(buf + 2, body, len);
+    uint16_t crc = HciSlave::crc16(buf, len + 2);
+    buf[len + 2] = crc & 0xFF;
+    buf[len + 3] = crc >> 8;
+    return len + 4;
+}
+
+// FC 0x17: read `reads` registers at 0x9CB9, write counter/command to 0x9C41
+static size_t readWrite(uint8_t *buf, uint8_t reads, uint8_t writes, uint8_t counter) {
+    uint8_t body[9 + 6] = {0x9C, 0xB9, 0x00, reads, 0x9C, 0x41, 0x00, writes, (uint8_t)(writes * 2), counter, 0x00};
+    return frame(buf, SLAVE_ID, HCI_FC_READWRITE_REGS, body, 9 + writes * 2);
+}
+
+// FC 0x10 broadcast to 0x9D31: position (target, current), state, lamp
+static size_t broadcast(uint8_t *buf, uint8_t target, uint8_t current, uint8_t state, uint8_t lamp) {
+    uint8_t body[5 + 2 * HCI_BROADCAST_REGS] = {0x9D, 0x31, 0x00, HCI_BROADCAST_REGS, 2 * HCI_BROADCAST_REGS};
+    body[5 + 2] = target;
+    body[5 + 3] = current;
+    body[5 + 4] = state;
+    body[5 + 13] = lamp;
+    return frame(buf, 0, HCI_FC_WRITE_REGS, body, sizeof(body));
+}
+
+static void replay(const uint8_t *buf, size_t len) {
+    hostAdvanceUs(len * HCI_CHAR_US + HCI_RX_TIMEOUT_US);
+    hostUartFeed(buf, len);
+    if (hoermannEngine->waitForFrame()) hoermannEngine->handleModbus(true);
+    hostAdvanceUs(10000);
+}
+
+static int failures = 0;
+
+static void check(bool ok, const char *what) {
+    if (!ok) {
+        printf("FAIL %s\n", what);
+        failures++;
+    }
+}
+
+int main() {
+    Preferences prefs;
+    BridgeConfig config = {};
+    hoermannEngine->setup(&prefs, config);
+
+    uint8_t buf[HCI_MAX_FRAME];
+    char json[256];
+    HoermannState::Snapshot snap;
+    uint32_t version = hoermannEngine->state->version();
+    PublishQueue queue;
+    queue.begin();
+    unsigned long published = 0;
+
+    counting = true;
+    for (int cycle = 0; cycle < 200; cycle++) {
+        uint8_t counter = (uint8_t)cycle;
+        if (cycle % 20 == 0) hoermannEngine->openDoor();
+        if (cycle % 50 == 0) hoermannEngine->toogleLight();
+        if (cycle % 30 == 0) hoermannEngine->setPosition(40);
+
+        replay(buf, broadcast(buf, 200, (uint8_t)(cycle % 200), cycle % 2 ? 0x01 : 0x20, cycle % 4 ? 0x10 : 0x00));
+        hostUart().txLen = 0;
+        replay(buf, readWrite(buf, 8, 2, counter));
+        check(hostUart().txLen == 3 + 2 * 8 + 2, "command reply");
+        hostUart().txLen = 0;
+        replay(buf, readWrite(buf, 2, 2, counter));
+        check(hostUart().txLen == 3 + 2 * 2 + 2, "empty reply");
+        hostUart().txLen = 0;
+        replay(buf, readWrite(buf, 5, 3, counter));
+        check(hostUart().txLen == 3 + 2 * 5 + 2, "busscan reply");
+
+        hoermannEngine->state->snapshot(snap);
+        snap.toStatusJson(json, sizeof(json), hoermannEngine->state->responseAge());
+        queue.push("hormann/state", json, 1, true, PublishPriority::STATE);
+        queue.push("hormann/debug", json, 0, false, PublishPriority::DIAGNOSTIC, false);
+        PublishQueue::Entry *entry;
+        while ((entry = queue.take()) != nullptr) {
+            published += strcmp(entry->payload, json) == 0;
+            queue.sent(entry);
+            queue.onAck();
+        }
+    }
+    counting = false;
+
+    // Time between the RX timeout event and reading the frame counts toward the turnaround
+    size_t len = readWrite(buf, 8, 2, 0);
+    hostAdvanceUs(len * HCI_CHAR_US + HCI_RX_TIMEOUT_US);
+    hostUartFeed(buf, len);
+    check(hoermannEngine->waitForFrame(), "RX timeout event");
+    hostAdvanceUs(HCI_REPLY_DEADLINE_US);
+    hoermannEngine->handleModbus(true);
+    check(hoermannEngine->busStats().lastReplyUs >= HCI_REPLY_DEADLINE_US + HCI_RX_TIMEOUT_US, "turnaround from the RX timeout");
+
+    // Requests lost to a UART overflow or torn on the wire count as deadline misses
+    uint32_t misses = hoermannEngine->busMetrics().deadlineMisses;
+    hostUartOverflow();
+    check(!hoermannEngine->waitForFrame(), "overflow wakes the bus task");
+    replay(buf, 3);
+    check(hoermannEngine->busMetrics().lostFrames == 2, "lost requests");
+    check(hoermannEngine->busMetrics().deadlineMisses == misses + 2, "lost requests are deadline misses");
+
+    check(hoermannEngine->state->version() > version, "state published");
+    check(published == 2 * 200, "publish queue");
+    check(hoermannEngine->busStats().frames[(uint8_t)HciFrameType::CRC_ERROR] == 0, "frames decode");
+    check(allocations == 0, "no heap allocation on the bus path");
+    printf("%s: %lu allocations over 200 bus cycles\n", failures == 0 ? "PASS" : "FAIL", allocations);
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,88 @@
+/**
+ * @file asset_pack.h
+ * Fonts and images read in place from the asset pack (built by support/assetpack.py)
+ *
+ * On the device the pack lives in the "assets" flash partition and is mapped with
+ * esp_partition_mmap(); the simulator maps a file with mmap(). Asset data is never
+ * copied: fonts and images point straight into the mapping.
+ */
+
+#ifndef ASSET_PACK_H
+#define ASSET_PACK_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef LV_LVGL_H_INCLUDE_SIMPLE
+#include "lvgl.h"
+#else
+#include "lvgl/lvgl.h"
+#endif
+
+/* Partition label on the device, default file in the simulator (overridden by $LILYPI_ASSETS) */
+#define ASSET_PACK_PARTITION    "assets"
+#ifndef ASSET_PACK_FILE
+#define ASSET_PACK_FILE         "assets.bin"
+#endif
+
+typedef enum {
+    ASSET_TYPE_TTF = 1,     /* TrueType font, rendered by ttf_font */
+    ASSET_TYPE_FONT = 2,    /* LVGL bitmap font (lv_font_fmt_txt) */
+    ASSET_TYPE_IMAGE = 3,   /* LVGL image: lv_img_header_t followed by pixel data */
+} asset_type_t;
+
+typedef struct {
+    const char * name;
+    asset_type_t type;
+    const uint8_t * data;   /* inside the mapping, valid until asset_pack_close() */
+    uint32_t size;
+} asset_t;
+
+/**
+ * Map the asset pack and validate its index
+ * @param path pack file in the simulator, NULL for $LILYPI_ASSETS or ASSET_PACK_FILE (ignored on the device)
+ * @return true if a valid pack is mapped
+ */
+bool asset_pack_open(const char * path);
+
+/**
+ * Unmap the pack. Fonts and images obtained from it must no longer be used.
+ */
+void asset_pack_close(void);
+
+/**
+ * Number of assets in the mapped pack (0 if none)
+ */
+uint16_t asset_pack_count(void);
+
+/**
+ * Look up an asset by name
+ * @return true and fills asset if found
+ */
+bool asset_pack_find(const char * name, asset_t * asset);
+
+/**
+ * Get a font from the pack
+ * Bitmap fonts are returned as packed (px and weight are ignored) and cached, so
+ * repeated calls return the same font. TrueType fonts create a new ttf_font each call.
+ * @param px size in pixels for TrueType fonts
+ * @param weight weight (100..900) for variable TrueType fonts
+ * @return the font or NULL if the asset is missing or not a font
+ */
+const lv_font_t * asset_pack_font(const char * name, uint16_t px, uint16_t weight);
+
+/**
+ * Fill an image descriptor that points into the pack
+ * @return true if the image was found
+ */
+bool asset_pack_image(const char * name, lv_img_dsc_t * dsc);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* ASSET_PACK_H */
@@ -37,6 +37,12 @@
 #define MQTT_SERVER "192.168.1.27"
 #define MQTT_PORT 1883
 #define MQTT_CLIENT_ID "garage-controller"
+#define MQTT_DIAGNOSTICS_TOPIC "lilypi/diagnostics"
+#define DIAG_INTERVAL_MS 60000       // Diagnostics publish interval
+
+// Screen arenas (bytes reserved in the LVGL pool per screen, see screen_manager.h)
+#define WIFI_SCREEN_ARENA 8192
+#define MAIN_SCREEN_ARENA 49152
 
 // Relay GPIO Configuration
 #define GPIO_RELAY1 40
@@ -12,9 +12,11 @@
 #define LV_COLOR_DEPTH     16
 #define LV_COLOR_16_SWAP   0
 
-/* Memory settings */
-#define LV_MEM_CUSTOM      0
-#define LV_MEM_SIZE        (32U * 1024U)
+/* Memory settings: TLSF pool (size set with LV_MEM_TLSF_POOL_SIZE, default 256 KB) */
+#define LV_MEM_CUSTOM      1
+#define LV_MEM_CUSTOM_INCLUDE "lv_mem_tlsf.h"
+#define LV_MEM_CUSTOM_ALLOC   lv_mem_tlsf_alloc
+#define LV_MEM_CUSTOM_FREE    lv_mem_tlsf_free
 
 /* HAL settings */
 #define LV_TICK_CUSTOM     0
@@ -11,6 +11,7 @@
 /*********************
  *      INCLUDES
  *********************/
+#include "lvgl/lvgl.h"
 
 /*********************
  *      DEFINES
@@ -24,6 +25,8 @@
  * GLOBAL PROTOTYPES
  **********************/
 void lv_demo_widgets(void);
+void lv_demo_widgets_build(lv_obj_t *scr);
+void lv_demo_widgets_destroy(void);
 
 /**********************
  *      MACROS
@@ -0,0 +1,80 @@
+/**
+ * @file lv_mem_tlsf.h
+ * LVGL memory backend: a TLSF pool in PSRAM (device) or a heap arena (simulator)
+ *
+ * Hooked in through LV_MEM_CUSTOM:
+ *   LV_MEM_CUSTOM_INCLUDE "lv_mem_tlsf.h"
+ *   LV_MEM_CUSTOM_ALLOC   lv_mem_tlsf_alloc
+ *   LV_MEM_CUSTOM_FREE    lv_mem_tlsf_free
+ */
+
+#ifndef LV_MEM_TLSF_H
+#define LV_MEM_TLSF_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include "tlsf.h"
+
+/* Pool size in bytes, reserved on the first allocation */
+#ifndef LV_MEM_TLSF_POOL_SIZE
+#ifdef ESP_PLATFORM
+#define LV_MEM_TLSF_POOL_SIZE   (512U * 1024U)
+#else
+#define LV_MEM_TLSF_POOL_SIZE   (256U * 1024U)
+#endif
+#endif
+
+/* Arenas that can exist at the same time (live and retired) */
+#ifndef LV_MEM_TLSF_MAX_ARENAS
+#define LV_MEM_TLSF_MAX_ARENAS  4
+#endif
+
+/**
+ * Allocate from the LVGL pool (creates the pool on first use)
+ */
+void * lv_mem_tlsf_alloc(size_t size);
+
+/**
+ * Return memory to the LVGL pool
+ */
+void lv_mem_tlsf_free(void * ptr);
+
+/**
+ * Reserve an arena inside the LVGL pool (one allocation)
+ * While an arena is active (lv_mem_tlsf_set_arena) LVGL allocations come from it,
+ * spilling over to the main pool when it is full.
+ * @return the arena or NULL if the pool has no room or all arena slots are taken
+ */
+tlsf_t * lv_mem_tlsf_arena_create(size_t bytes);
+
+/**
+ * Release an arena in one operation
+ * If blocks are still allocated from it, it is retired instead and released when the last one is freed.
+ */
+void lv_mem_tlsf_arena_release(tlsf_t * arena);
+
+/**
+ * Route allocations to an arena, NULL for the main pool
+ * @return the previously active arena
+ */
+tlsf_t * lv_mem_tlsf_set_arena(tlsf_t * arena);
+
+/**
+ * Allocations that did not fit the active arena and went to the main pool
+ */
+uint32_t lv_mem_tlsf_arena_spills(void);
+
+/**
+ * Fill pool figures: used, free, largest free block, fragmentation
+ * @return false if the pool has not been created yet
+ */
+bool lv_mem_tlsf_monitor(tlsf_monitor_t * mon);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* LV_MEM_TLSF_H */
@@ -0,0 +1,78 @@
+/**
+ * @file screen_manager.h
+ * Screens built into their own allocation arena, loaded and destroyed as a unit
+ *
+ * Each screen reserves its arena from the LVGL pool when it is built; every object,
+ * style map and label text created while building comes from that arena. Deleting the
+ * screen releases the whole arena in one operation, so switching screens does not
+ * leave holes in the shared pool.
+ */
+
+#ifndef SCREEN_MANAGER_H
+#define SCREEN_MANAGER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef LV_LVGL_H_INCLUDE_SIMPLE
+#include "lvgl.h"
+#else
+#include "lvgl/lvgl.h"
+#endif
+
+#ifdef USE_LV_MEM_TLSF
+#include "lv_mem_tlsf.h"
+#endif
+
+typedef struct screen {
+    const char * name;
+    size_t arena_size;                  /* bytes reserved for the screen's objects and styles */
+    void (*build)(lv_obj_t * scr);      /* create the screen's widgets on scr */
+    void (*destroy)(void);              /* drop globals and styles after the objects were deleted */
+
+    /* Runtime state, managed by screen_manager */
+    lv_obj_t * scr;
+#ifdef USE_LV_MEM_TLSF
+    tlsf_t * arena;
+#endif
+    lv_task_t * preload_task;
+    uint32_t builds;
+    size_t arena_peak;                  /* largest arena usage seen when the screen was destroyed */
+} screen_t;
+
+/* Static initializer: SCREEN_DEFINE(my_screen, "name", 8192, build_fn, destroy_fn); */
+#define SCREEN_DEFINE(var, name, arena_size, build, destroy) \
+    screen_t var = { name, arena_size, build, destroy }
+
+/**
+ * Show a screen, building it first unless it was preloaded
+ * The previously shown screen is deleted and its arena released.
+ */
+void screen_show(screen_t * s);
+
+/**
+ * Build a screen in the background (low priority LVGL task) so that the next
+ * screen_show() only has to load it
+ */
+void screen_preload(screen_t * s);
+
+/**
+ * Delete a screen's objects and release its arena (no-op if not built)
+ */
+void screen_destroy(screen_t * s);
+
+/**
+ * The screen currently shown, NULL before the first screen_show()
+ */
+screen_t * screen_active(void);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* SCREEN_MANAGER_H */
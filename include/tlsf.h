@@ -0,0 +1,79 @@
+/**
+ * @file tlsf.h
+ * Two-Level Segregated Fit allocator: O(1) malloc/free over a caller-provided pool
+ */
+
+#ifndef TLSF_H
+#define TLSF_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct tlsf tlsf_t;
+
+/* Pool figures, filled by tlsf_monitor() */
+typedef struct {
+    size_t total;           /* usable bytes in the pool */
+    size_t used;            /* bytes in allocated blocks, including block headers */
+    size_t free;            /* bytes in free blocks */
+    size_t largest_free;    /* biggest free block */
+    size_t max_used;        /* high-water mark of used */
+    uint32_t free_blocks;   /* number of free blocks (1 = no fragmentation) */
+    uint32_t allocs;        /* live allocations */
+    uint32_t failed;        /* allocations that found no block */
+    uint8_t frag_pct;       /* 100 - largest_free * 100 / free */
+} tlsf_monitor_t;
+
+/**
+ * Create an allocator in a memory region; the control structure is placed at its start
+ * @param mem region, pointer aligned
+ * @param bytes size of the region
+ * @return the allocator, NULL if the region is too small
+ */
+tlsf_t * tlsf_create(void * mem, size_t bytes);
+
+/**
+ * Allocate a block, NULL if no free block is big enough
+ */
+void * tlsf_malloc(tlsf_t * tlsf, size_t size);
+
+/**
+ * Free a block returned by tlsf_malloc() (NULL is ignored)
+ */
+void tlsf_free(tlsf_t * tlsf, void * ptr);
+
+/**
+ * Usable size of an allocated block
+ */
+size_t tlsf_block_size(const void * ptr);
+
+/**
+ * true if ptr points into the pool of this allocator
+ */
+bool tlsf_owns(const tlsf_t * tlsf, const void * ptr);
+
+/**
+ * Number of live allocations (O(1))
+ */
+uint32_t tlsf_alloc_count(const tlsf_t * tlsf);
+
+/**
+ * Walk the pool and fill the monitor figures (O(blocks), for diagnostics only)
+ */
+void tlsf_monitor(const tlsf_t * tlsf, tlsf_monitor_t * mon);
+
+/**
+ * Control structure overhead in bytes, to size regions passed to tlsf_create()
+ */
+size_t tlsf_overhead(void);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* TLSF_H */
@@ -0,0 +1,80 @@
+/**
+ * @file ttf_font.h
+ * Runtime TrueType fonts for LVGL with an LRU glyph cache
+ */
+
+#ifndef TTF_FONT_H
+#define TTF_FONT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef LV_LVGL_H_INCLUDE_SIMPLE
+#include "lvgl.h"
+#else
+#include "lvgl/lvgl.h"
+#endif
+
+/* Glyph cache budget in bytes (rasterized 8 bpp bitmaps, PSRAM on the device) */
+#ifndef TTF_CACHE_BUDGET
+#define TTF_CACHE_BUDGET (128U * 1024U)
+#endif
+
+/* Glyph cache counters, read with ttf_font_get_stats() */
+typedef struct {
+    uint32_t hits;              /* glyph lookups served from the cache */
+    uint32_t misses;            /* glyph lookups that had to rasterize */
+    uint32_t evictions;         /* glyphs dropped to stay within the budget */
+    uint32_t glyphs;            /* glyphs currently cached */
+    uint32_t cache_bytes;       /* bytes currently used by cached glyphs */
+    uint32_t cache_budget;      /* configured budget in bytes */
+    uint32_t raster_count;      /* glyphs rasterized since boot */
+    uint64_t raster_us_total;   /* total rasterization time */
+    uint32_t raster_us_max;     /* slowest single glyph */
+} ttf_font_stats_t;
+
+/**
+ * Create an LVGL font that rasterizes glyphs from a TrueType file on demand
+ * @param data TTF file contents, must stay valid for the lifetime of the font (no copy is made)
+ * @param size length of data in bytes
+ * @param px font size in pixels (em size)
+ * @param weight requested weight (100..900), only used for variable fonts with a wght axis
+ * @return the font or NULL if the data is not a usable TrueType font
+ */
+lv_font_t * ttf_font_create(const uint8_t * data, size_t size, uint16_t px, uint16_t weight);
+
+#ifndef USE_ASSET_PACK
+/**
+ * Create a Montserrat font from the variable face embedded in fonts/
+ * Not available with USE_ASSET_PACK, the face is only in the pack then (asset_pack_font()).
+ * @param px font size in pixels
+ * @param weight requested weight (100..900)
+ */
+lv_font_t * ttf_font_montserrat(uint16_t px, uint16_t weight);
+#endif
+
+/**
+ * Release a font created by ttf_font_create() and drop its cached glyphs
+ */
+void ttf_font_destroy(lv_font_t * font);
+
+/**
+ * Change the glyph cache budget, evicting least recently used glyphs if needed
+ */
+void ttf_font_set_cache_budget(size_t bytes);
+
+/**
+ * Copy the glyph cache counters
+ */
+void ttf_font_get_stats(ttf_font_stats_t * stats);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* TTF_FONT_H */
@@ -3,11 +3,11 @@
 
 #include "lvgl/lvgl.h"
 
-// Initialize and show the WiFi connection screen
-void wifi_screen_create(void);
+// Build the WiFi connection screen on scr (a screen object owned by the screen manager)
+void wifi_screen_build(lv_obj_t *scr);
 
-// Hide the WiFi screen and show the main UI
-void wifi_screen_hide(void);
+// Release the screen's task and styles after its objects were deleted
+void wifi_screen_destroy(void);
 
 // Update the WiFi connection status message
 void wifi_screen_update_status(const char* message);
@@ -0,0 +1,327 @@
+/**
+ * @file asset_pack.c
+ * Asset pack reader: maps the pack once and hands out fonts and images that point into it
+ */
+
+#if !defined(ESP_PLATFORM) && !defined(_DEFAULT_SOURCE)
+#define _DEFAULT_SOURCE     /* mmap() with -std=c11 */
+#endif
+
+#include "asset_pack.h"
+#include "ttf_font.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef ESP_PLATFORM
+#include "esp_partition.h"
+#include "esp_spi_flash.h"
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#define PACK_MAGIC          "LPAK"
+#define PACK_VERSION        1
+#define PACK_NAME_MAX       24
+#define PACK_MAX_FONTS      16      /* bitmap fonts kept resolved at the same time */
+
+/* On-flash layout, little endian (see support/assetpack.py) */
+typedef struct {
+    char magic[4];
+    uint16_t version;
+    uint16_t count;
+    uint32_t size;
+    uint32_t index_crc;
+} pack_header_t;
+
+typedef struct {
+    char name[PACK_NAME_MAX];
+    uint8_t type;
+    uint8_t reserved[3];
+    uint32_t offset;
+    uint32_t size;
+    uint32_t crc;
+} pack_entry_t;
+
+/* ASSET_TYPE_FONT blob header, offsets are relative to the blob */
+typedef struct {
+    uint16_t line_height;
+    int16_t base_line;
+    uint8_t bpp;
+    uint8_t bitmap_format;
+    int8_t underline_position;
+    int8_t underline_thickness;
+    uint16_t cmap_num;
+    uint16_t glyph_count;
+    uint32_t glyph_dsc_ofs;
+    uint32_t cmaps_ofs;
+    uint32_t bitmap_ofs;
+} pack_font_t;
+
+typedef struct {
+    uint32_t range_start;
+    uint16_t range_length;
+    uint16_t glyph_id_start;
+    uint32_t unicode_list_ofs;
+    uint32_t glyph_id_ofs_list_ofs;
+    uint16_t list_length;
+    uint8_t type;
+    uint8_t reserved;
+} pack_cmap_t;
+
+/* A resolved bitmap font: only the descriptors live in RAM */
+typedef struct {
+    lv_font_t font;
+    lv_font_fmt_txt_dsc_t dsc;
+    uint16_t entry;
+    lv_font_fmt_txt_cmap_t cmaps[];
+} packed_font_t;
+
+static const uint8_t * pack;
+static const pack_header_t * header;
+static const pack_entry_t * entries;
+static packed_font_t * fonts[PACK_MAX_FONTS];
+
+#ifdef ESP_PLATFORM
+static spi_flash_mmap_handle_t map_handle;
+#else
+static size_t map_size;
+#endif
+
+static uint32_t crc32(const uint8_t * data, size_t len)
+{
+    uint32_t crc = 0xFFFFFFFFU;
+    while(len--) {
+        crc ^= *data++;
+        for(int i = 0; i < 8; i++) crc = (crc >> 1) ^ (0xEDB88320U & -(crc & 1));
+    }
+    return ~crc;
+}
+
+static bool validate(const uint8_t * data, size_t size)
+{
+    const pack_header_t * h = (const pack_header_t *)data;
+    if(size < sizeof(pack_header_t) || memcmp(h->magic, PACK_MAGIC, 4) != 0 || h->version != PACK_VERSION) {
+        printf("Asset pack: no valid pack found\n");
+        return false;
+    }
+    size_t index_size = (size_t)h->count * sizeof(pack_entry_t);
+    if(h->size > size || sizeof(pack_header_t) + index_size > h->size) {
+        printf("Asset pack: truncated (%u bytes, %u mapped)\n", (unsigned)h->size, (unsigned)size);
+        return false;
+    }
+    if(crc32(data + sizeof(pack_header_t), index_size) != h->index_crc) {
+        printf("Asset pack: index checksum mismatch\n");
+        return false;
+    }
+    const pack_entry_t * e = (const pack_entry_t *)(data + sizeof(pack_header_t));
+    for(uint16_t i = 0; i < h->count; i++) {
+        if(e[i].offset > h->size || e[i].size > h->size - e[i].offset || (e[i].offset & 3) != 0) {
+            printf("Asset pack: entry %u out of bounds\n", i);
+            return false;
+        }
+    }
+    return true;
+}
+
+#ifdef ESP_PLATFORM
+
+bool asset_pack_open(const char * path)
+{
+    (void)path;
+    if(pack) return true;
+
+    const esp_partition_t * part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY,
+                                                            ASSET_PACK_PARTITION);
+    if(part == NULL) {
+        printf("Asset pack: partition '%s' not found\n", ASSET_PACK_PARTITION);
+        return false;
+    }
+
+    /* Map only what the pack uses, not the whole partition */
+    pack_header_t h;
+    if(esp_partition_read(part, 0, &h, sizeof(h)) != ESP_OK) return false;
+    if(memcmp(h.magic, PACK_MAGIC, 4) != 0 || h.size < sizeof(h) || h.size > part->size) {
+        printf("Asset pack: partition '%s' is empty\n", ASSET_PACK_PARTITION);
+        return false;
+    }
+
+    const void * ptr;
+    if(esp_partition_mmap(part, 0, h.size, SPI_FLASH_MMAP_DATA, &ptr, &map_handle) != ESP_OK) {
+        printf("Asset pack: mmap of %u bytes failed\n", (unsigned)h.size);
+        return false;
+    }
+    if(!validate(ptr, h.size)) {
+        spi_flash_munmap(map_handle);
+        return false;
+    }
+    pack = ptr;
+    header = (const pack_header_t *)pack;
+    entries = (const pack_entry_t *)(pack + sizeof(pack_header_t));
+    printf("Asset pack: %u assets, %u bytes mapped\n", header->count, (unsigned)header->size);
+    return true;
+}
+
+static void unmap(void)
+{
+    spi_flash_munmap(map_handle);
+}
+
+#else
+
+bool asset_pack_open(const char * path)
+{
+    if(pack) return true;
+    if(path == NULL) path = getenv("LILYPI_ASSETS");
+    if(path == NULL) path = ASSET_PACK_FILE;
+
+    int fd = open(path, O_RDONLY);
+    if(fd < 0) {
+        printf("Asset pack: %s not found\n", path);
+        return false;
+    }
+    struct stat st;
+    void * ptr = MAP_FAILED;
+    if(fstat(fd, &st) == 0 && st.st_size > 0) {
+        ptr = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if(ptr == MAP_FAILED) {
+        printf("Asset pack: mmap of %s failed\n", path);
+        return false;
+    }
+    if(!validate(ptr, (size_t)st.st_size)) {
+        munmap(ptr, (size_t)st.st_size);
+        return false;
+    }
+    map_size = (size_t)st.st_size;
+    pack = ptr;
+    header = (const pack_header_t *)pack;
+    entries = (const pack_entry_t *)(pack + sizeof(pack_header_t));
+    printf("Asset pack: %u assets from %s\n", header->count, path);
+    return true;
+}
+
+static void unmap(void)
+{
+    munmap((void *)pack, map_size);
+}
+
+#endif
+
+void asset_pack_close(void)
+{
+    if(pack == NULL) return;
+    for(int i = 0; i < PACK_MAX_FONTS; i++) {
+        free(fonts[i]);
+        fonts[i] = NULL;
+    }
+    unmap();
+    pack = NULL;
+    header = NULL;
+    entries = NULL;
+}
+
+uint16_t asset_pack_count(void)
+{
+    return header ? header->count : 0;
+}
+
+static const pack_entry_t * find_entry(const char * name)
+{
+    if(pack == NULL) return NULL;
+    for(uint16_t i = 0; i < header->count; i++) {
+        if(strncmp(entries[i].name, name, PACK_NAME_MAX) == 0) return &entries[i];
+    }
+    return NULL;
+}
+
+bool asset_pack_find(const char * name, asset_t * asset)
+{
+    const pack_entry_t * e = find_entry(name);
+    if(e == NULL) return false;
+    asset->name = e->name;
+    asset->type = (asset_type_t)e->type;
+    asset->data = pack + e->offset;
+    asset->size = e->size;
+    return true;
+}
+
+static const lv_font_t * load_bitmap_font(const pack_entry_t * e)
+{
+    uint16_t index = (uint16_t)(e - entries);
+    int slot = -1;
+    for(int i = 0; i < PACK_MAX_FONTS; i++) {
+        if(fonts[i] && fonts[i]->entry == index) return &fonts[i]->font;
+        if(fonts[i] == NULL && slot < 0) slot = i;
+    }
+    if(slot < 0 || e->size < sizeof(pack_font_t)) return NULL;
+
+    const uint8_t * blob = pack + e->offset;
+    const pack_font_t * pf = (const pack_font_t *)blob;
+    if(pf->cmaps_ofs + (uint32_t)pf->cmap_num * sizeof(pack_cmap_t) > e->size ||
+       pf->glyph_dsc_ofs + (uint32_t)pf->glyph_count * sizeof(lv_font_fmt_txt_glyph_dsc_t) > e->size ||
+       pf->bitmap_ofs > e->size) {
+        printf("Asset pack: font '%.*s' is corrupt\n", PACK_NAME_MAX, e->name);
+        return NULL;
+    }
+
+    packed_font_t * f = calloc(1, sizeof(packed_font_t) + pf->cmap_num * sizeof(lv_font_fmt_txt_cmap_t));
+    if(f == NULL) return NULL;
+
+    /* Cmap descriptors hold pointers, so they are rebuilt in RAM; the lists stay in flash */
+    const pack_cmap_t * pc = (const pack_cmap_t *)(blob + pf->cmaps_ofs);
+    for(uint16_t i = 0; i < pf->cmap_num; i++) {
+        lv_font_fmt_txt_cmap_t * c = &f->cmaps[i];
+        c->range_start = pc[i].range_start;
+        c->range_length = pc[i].range_length;
+        c->glyph_id_start = pc[i].glyph_id_start;
+        c->unicode_list = pc[i].unicode_list_ofs ? (const uint16_t *)(blob + pc[i].unicode_list_ofs) : NULL;
+        c->glyph_id_ofs_list = pc[i].glyph_id_ofs_list_ofs ? blob + pc[i].glyph_id_ofs_list_ofs : NULL;
+        c->list_length = pc[i].list_length;
+        c->type = (lv_font_fmt_txt_cmap_type_t)pc[i].type;
+    }
+
+    f->dsc.glyph_bitmap = blob + pf->bitmap_ofs;
+    f->dsc.glyph_dsc = (const lv_font_fmt_txt_glyph_dsc_t *)(blob + pf->glyph_dsc_ofs);
+    f->dsc.cmaps = f->cmaps;
+    f->dsc.cmap_num = pf->cmap_num;
+    f->dsc.bpp = pf->bpp;
+    f->dsc.bitmap_format = pf->bitmap_format;
+
+    f->font.get_glyph_dsc = lv_font_get_glyph_dsc_fmt_txt;
+    f->font.get_glyph_bitmap = lv_font_get_bitmap_fmt_txt;
+    f->font.line_height = pf->line_height;
+    f->font.base_line = pf->base_line;
+    f->font.subpx = LV_FONT_SUBPX_NONE;
+    f->font.underline_position = pf->underline_position;
+    f->font.underline_thickness = pf->underline_thickness;
+    f->font.dsc = &f->dsc;
+    f->entry = index;
+
+    fonts[slot] = f;
+    return &f->font;
+}
+
+const lv_font_t * asset_pack_font(const char * name, uint16_t px, uint16_t weight)
+{
+    const pack_entry_t * e = find_entry(name);
+    if(e == NULL) return NULL;
+    if(e->type == ASSET_TYPE_FONT) return load_bitmap_font(e);
+    if(e->type == ASSET_TYPE_TTF) return ttf_font_create(pack + e->offset, e->size, px, weight);
+    return NULL;
+}
+
+bool asset_pack_image(const char * name, lv_img_dsc_t * dsc)
+{
+    const pack_entry_t * e = find_entry(name);
+    if(e == NULL || e->type != ASSET_TYPE_IMAGE || e->size < sizeof(lv_img_header_t)) return false;
+
+    memcpy(&dsc->header, pack + e->offset, sizeof(lv_img_header_t));
+    dsc->data = pack + e->offset + sizeof(lv_img_header_t);
+    dsc->data_size = e->size - sizeof(lv_img_header_t);
+    return true;
+}
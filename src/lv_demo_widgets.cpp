@@ -1,6 +1,12 @@
 #include "lvgl/lvgl.h"
 #include <stdio.h>
 #include <string.h>
+#ifdef USE_TTF_FONTS
+#include "ttf_font.h"
+#endif
+#ifdef USE_ASSET_PACK
+#include "asset_pack.h"
+#endif
 
 // Declare lightbulb functions with C linkage
 extern "C" {
@@ -9,9 +15,21 @@ extern "C" {
     bool lightbulb_get_state(void);
 }
 
+#ifdef USE_ASSET_PACK
+// FontAwesome icons are read from the asset pack; without a pack the UI is never
+// built (assets missing screen), the Montserrat fallback only avoids a NULL font
+static const lv_font_t *pack_font(const char *name)
+{
+    const lv_font_t *font = asset_pack_font(name, 0, 0);
+    return font ? font : &lv_font_montserrat_32;
+}
+#define FONT_ICON_32 pack_font("fontawesome_32")
+#else
 // Declare FontAwesome fonts
 LV_FONT_DECLARE(lv_font_fontawesome_16);
 LV_FONT_DECLARE(lv_font_fontawesome_32);
+#define FONT_ICON_32 (&lv_font_fontawesome_32)
+#endif
 
 // Declare Montserrat fonts for temperature values
 LV_FONT_DECLARE(lv_font_montserrat_22);
@@ -57,20 +75,55 @@ static lv_style_t style_lightbulb_off;
 static lv_style_t style_button_active;
 static lv_style_t style_button_inactive;
 
+// Layout and text styles
+static lv_style_t style_transparent;
+static lv_style_t style_garage_btn;
+static lv_style_t style_button_text;
+static lv_style_t style_stop_text;
+static lv_style_t style_data_panel;
+static lv_style_t style_temp_value;
+
+// Every style above, reset when the screen is destroyed so no style data outlives its arena
+static lv_style_t *const screen_styles[] = {
+    &style_lightbulb_on, &style_lightbulb_off, &style_button_active, &style_button_inactive,
+    &style_transparent, &style_garage_btn, &style_button_text, &style_stop_text,
+    &style_data_panel, &style_temp_value,
+};
+
 void lv_demo_widgets(void)
+{
+    lv_demo_widgets_build(lv_scr_act());
+}
+
+void lv_demo_widgets_destroy(void)
+{
+    g_lightbulb_label = NULL;
+    g_up_btn = NULL;
+    g_stop_btn = NULL;
+    g_down_btn = NULL;
+    g_entrance_switch = NULL;
+    g_catdoor_switch = NULL;
+    g_outdoor_temp_label = NULL;
+    g_indoor_temp_label = NULL;
+
+    for (size_t i = 0; i < sizeof(screen_styles) / sizeof(screen_styles[0]); i++) {
+        lv_style_reset(screen_styles[i]);
+    }
+}
+
+void lv_demo_widgets_build(lv_obj_t *scr)
 {
     // Declare variables at the beginning (C requirement)
     int row_height;
     int panel_width;
 
     // Create LEFT panel - "garage" (50% width) - full height, no top bar
-    lv_obj_t *garage_panel = lv_cont_create(lv_scr_act(), NULL);
+    lv_obj_t *garage_panel = lv_cont_create(scr, NULL);
     lv_obj_set_size(garage_panel, LV_HOR_RES / 2 - 5, LV_VER_RES);
     lv_obj_set_pos(garage_panel, 0, 0);
     lv_cont_set_layout(garage_panel, LV_LAYOUT_CENTER);
 
     // Remove panel background and borders
-    static lv_style_t style_transparent;
     lv_style_init(&style_transparent);
     lv_style_set_bg_opa(&style_transparent, LV_STATE_DEFAULT, LV_OPA_TRANSP);
     lv_style_set_border_width(&style_transparent, LV_STATE_DEFAULT, 0);
@@ -78,7 +131,6 @@ void lv_demo_widgets(void)
     lv_obj_add_style(garage_panel, LV_CONT_PART_MAIN, &style_transparent);
 
     // Style for garage buttons with rounded borders - set border for all states
-    static lv_style_t style_garage_btn;
     lv_style_init(&style_garage_btn);
     lv_style_set_radius(&style_garage_btn, LV_STATE_DEFAULT, 15);
     lv_style_set_border_width(&style_garage_btn, LV_STATE_DEFAULT, 2);
@@ -116,7 +168,6 @@ void lv_demo_widgets(void)
     lv_style_set_pad_all(&style_button_inactive, LV_STATE_DEFAULT, 20);
 
     // Style for button text (dark gray for visibility on white background)
-    static lv_style_t style_button_text;
     lv_style_init(&style_button_text);
     lv_style_set_text_font(&style_button_text, LV_STATE_DEFAULT, &lv_font_montserrat_32);
     lv_style_set_text_color(&style_button_text, LV_STATE_DEFAULT, lv_color_hex(0x2A2A2A));  // Dark gray
@@ -133,7 +184,6 @@ void lv_demo_widgets(void)
     g_up_btn = btn1;  // Store button reference
 
     // Style for STOP button text (red color)
-    static lv_style_t style_stop_text;
     lv_style_init(&style_stop_text);
     lv_style_set_text_font(&style_stop_text, LV_STATE_DEFAULT, &lv_font_montserrat_32);
     lv_style_set_text_color(&style_stop_text, LV_STATE_DEFAULT, lv_color_hex(0xB81509));  // Red
@@ -151,11 +201,11 @@ void lv_demo_widgets(void)
 
     // Initialize lightbulb color styles
     lv_style_init(&style_lightbulb_on);
-    lv_style_set_text_font(&style_lightbulb_on, LV_STATE_DEFAULT, &lv_font_fontawesome_32);
+    lv_style_set_text_font(&style_lightbulb_on, LV_STATE_DEFAULT, FONT_ICON_32);
     lv_style_set_text_color(&style_lightbulb_on, LV_STATE_DEFAULT, lv_color_hex(0xFFEB3B));  // Light yellow
     
     lv_style_init(&style_lightbulb_off);
-    lv_style_set_text_font(&style_lightbulb_off, LV_STATE_DEFAULT, &lv_font_fontawesome_32);
+    lv_style_set_text_font(&style_lightbulb_off, LV_STATE_DEFAULT, FONT_ICON_32);
     lv_style_set_text_color(&style_lightbulb_off, LV_STATE_DEFAULT, lv_color_hex(0x9E9E9E));  // Gray
 
     // Button 3: Lightbulb icon - optimized for vertical fit using FontAwesome
@@ -191,13 +241,12 @@ void lv_demo_widgets(void)
     g_down_btn = btn4;  // Store button reference
 
     // Create RIGHT panel - "data" (50% width) - full height
-    lv_obj_t *data_panel = lv_cont_create(lv_scr_act(), NULL);
+    lv_obj_t *data_panel = lv_cont_create(scr, NULL);
     lv_obj_set_size(data_panel, (LV_HOR_RES / 2 - 5) * 0.9, LV_VER_RES);  // 10% narrower, full height
     lv_obj_set_pos(data_panel, LV_HOR_RES / 2 + 5, 0);
     lv_cont_set_layout(data_panel, LV_LAYOUT_COLUMN_LEFT);
 
     // Add padding and reduce spacing between rows
-    static lv_style_t style_data_panel;
     lv_style_init(&style_data_panel);
     lv_style_set_bg_opa(&style_data_panel, LV_STATE_DEFAULT, LV_OPA_TRANSP);
     lv_style_set_border_width(&style_data_panel, LV_STATE_DEFAULT, 0);
@@ -235,9 +284,21 @@ void lv_demo_widgets(void)
     lv_obj_align(outdoor_label, row2, LV_ALIGN_IN_LEFT_MID, 5, 0);
 
     // Create temperature value label with degree symbol (positioned at right edge)
-    static lv_style_t style_temp_value;
     lv_style_init(&style_temp_value);
+#ifdef USE_TTF_FONTS
+    // Rendered from the Montserrat TTF (Medium, like the built-in fonts)
+    static const lv_font_t *temp_font = NULL;
+    if (temp_font == NULL) {
+#ifdef USE_ASSET_PACK
+        temp_font = asset_pack_font("montserrat", 22, 500);
+#else
+        temp_font = ttf_font_montserrat(22, 500);
+#endif
+    }
+    lv_style_set_text_font(&style_temp_value, LV_STATE_DEFAULT, temp_font ? temp_font : &lv_font_montserrat_22);
+#else
     lv_style_set_text_font(&style_temp_value, LV_STATE_DEFAULT, &lv_font_montserrat_22);
+#endif
     
     lv_obj_t *outdoor_value = lv_label_create(row2, NULL);
     lv_label_set_text(outdoor_value, "-");  // Default to "-" until MQTT data received
@@ -411,20 +472,9 @@ static void update_lightbulb_color(lv_obj_t *label, bool is_on)
         return;
     }
     
-    // Create a local style to modify the text color
-    static lv_style_t style_local;
-    lv_style_init(&style_local);
-    lv_style_set_text_font(&style_local, LV_STATE_DEFAULT, &lv_font_fontawesome_32);
-    
-    // Set color based on state
-    if (is_on) {
-        lv_style_set_text_color(&style_local, LV_STATE_DEFAULT, lv_color_hex(0xFFEB3B));  // Light yellow
-    } else {
-        lv_style_set_text_color(&style_local, LV_STATE_DEFAULT, lv_color_hex(0x9E9E9E));  // Gray
-    }
-    
-    // Apply the style
-    lv_obj_add_style(label, LV_LABEL_PART_MAIN, &style_local);
+    // Swap the prebuilt on/off styles instead of allocating a new style per update
+    lv_obj_remove_style(label, LV_LABEL_PART_MAIN, is_on ? &style_lightbulb_off : &style_lightbulb_on);
+    lv_obj_add_style(label, LV_LABEL_PART_MAIN, is_on ? &style_lightbulb_on : &style_lightbulb_off);
 }
 
 static void update_button_background(lv_obj_t *btn, bool is_active)
@@ -0,0 +1,137 @@
+/**
+ * @file lv_mem_tlsf.c
+ * LVGL memory backend on a TLSF pool, with screen arenas carved out of it
+ */
+
+#include "lv_mem_tlsf.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef LV_LVGL_H_INCLUDE_SIMPLE
+#include "lvgl.h"
+#else
+#include "lvgl/lvgl.h"
+#endif
+
+/* The LV_MEM_CUSTOM* build flags only reach LVGL if its lv_conf.h leaves them undefined.
+ * Otherwise LVGL keeps its built-in heap and this pool would be reserved for nothing. */
+#if defined(USE_LV_MEM_TLSF) && !LV_MEM_CUSTOM
+#error "USE_LV_MEM_TLSF is set but LVGL is built with LV_MEM_CUSTOM 0: lv_conf.h overrides the TLSF hook"
+#endif
+
+#ifdef ESP_PLATFORM
+#include "esp_heap_caps.h"
+#endif
+
+typedef struct {
+    tlsf_t * tlsf;
+    bool retired;       /* released while blocks were still allocated */
+} arena_slot_t;
+
+static tlsf_t * pool;
+static tlsf_t * active;
+static arena_slot_t arenas[LV_MEM_TLSF_MAX_ARENAS];
+static uint32_t spills;
+
+static void pool_init(void)
+{
+#ifdef ESP_PLATFORM
+    void * mem = heap_caps_malloc(LV_MEM_TLSF_POOL_SIZE, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if(mem == NULL) {
+        /* No PSRAM: fall back to a smaller pool in internal RAM */
+        mem = heap_caps_malloc(LV_MEM_TLSF_POOL_SIZE / 8, MALLOC_CAP_8BIT);
+        pool = tlsf_create(mem, LV_MEM_TLSF_POOL_SIZE / 8);
+    } else {
+        pool = tlsf_create(mem, LV_MEM_TLSF_POOL_SIZE);
+    }
+#else
+    void * mem = malloc(LV_MEM_TLSF_POOL_SIZE);
+    pool = tlsf_create(mem, LV_MEM_TLSF_POOL_SIZE);
+#endif
+    if(pool == NULL) printf("lv_mem_tlsf: could not reserve the LVGL pool\n");
+}
+
+void * lv_mem_tlsf_alloc(size_t size)
+{
+    if(pool == NULL) pool_init();
+    if(pool == NULL) return NULL;
+
+    if(active) {
+        void * p = tlsf_malloc(active, size);
+        if(p) return p;
+        spills++;
+    }
+    return tlsf_malloc(pool, size);
+}
+
+void lv_mem_tlsf_free(void * ptr)
+{
+    if(ptr == NULL || pool == NULL) return;
+
+    /* Arenas live inside the pool, so check them first */
+    for(int i = 0; i < LV_MEM_TLSF_MAX_ARENAS; i++) {
+        arena_slot_t * a = &arenas[i];
+        if(a->tlsf && tlsf_owns(a->tlsf, ptr)) {
+            tlsf_free(a->tlsf, ptr);
+            if(a->retired && tlsf_alloc_count(a->tlsf) == 0) {
+                tlsf_free(pool, a->tlsf);
+                a->tlsf = NULL;
+                a->retired = false;
+            }
+            return;
+        }
+    }
+    tlsf_free(pool, ptr);
+}
+
+tlsf_t * lv_mem_tlsf_arena_create(size_t bytes)
+{
+    if(pool == NULL) pool_init();
+    if(pool == NULL) return NULL;
+
+    for(int i = 0; i < LV_MEM_TLSF_MAX_ARENAS; i++) {
+        if(arenas[i].tlsf) continue;
+        void * mem = tlsf_malloc(pool, bytes + tlsf_overhead());
+        arenas[i].tlsf = tlsf_create(mem, bytes + tlsf_overhead());
+        if(arenas[i].tlsf == NULL) tlsf_free(pool, mem);
+        arenas[i].retired = false;
+        return arenas[i].tlsf;
+    }
+    return NULL;
+}
+
+void lv_mem_tlsf_arena_release(tlsf_t * arena)
+{
+    if(arena == NULL) return;
+    if(active == arena) active = NULL;
+
+    for(int i = 0; i < LV_MEM_TLSF_MAX_ARENAS; i++) {
+        if(arenas[i].tlsf != arena) continue;
+        if(tlsf_alloc_count(arena) == 0) {
+            tlsf_free(pool, arena);
+            arenas[i].tlsf = NULL;
+        } else {
+            arenas[i].retired = true;
+        }
+        return;
+    }
+}
+
+tlsf_t * lv_mem_tlsf_set_arena(tlsf_t * arena)
+{
+    tlsf_t * prev = active;
+    active = arena;
+    return prev;
+}
+
+uint32_t lv_mem_tlsf_arena_spills(void)
+{
+    return spills;
+}
+
+bool lv_mem_tlsf_monitor(tlsf_monitor_t * mon)
+{
+    if(pool == NULL) return false;
+    tlsf_monitor(pool, mon);
+    return true;
+}
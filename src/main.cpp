@@ -3,7 +3,17 @@
 #include "wifi_manager.h"
 #include "wifi_screen.h"
 #include "mqtt_manager.h"
+#include "screen_manager.h"
 #include <ArduinoJson.h>
+#ifdef USE_TTF_FONTS
+#include "ttf_font.h"
+#endif
+#ifdef USE_ASSET_PACK
+#include "asset_pack.h"
+#endif
+#ifdef USE_LV_MEM_TLSF
+#include "lv_mem_tlsf.h"
+#endif
 
 extern "C" {
     #include "../fonts/lightbulb.h"
@@ -15,6 +25,24 @@ MQTTManager mqttManager;
 bool wifi_connected = false;
 bool mqtt_connected = false;
 bool main_ui_loaded = false;
+unsigned long last_diag_ms = 0;
+
+// Screens, each built into its own arena of the LVGL pool
+SCREEN_DEFINE(wifi_screen, "wifi", WIFI_SCREEN_ARENA, wifi_screen_build, wifi_screen_destroy);
+SCREEN_DEFINE(main_screen, "main", MAIN_SCREEN_ARENA, lv_demo_widgets_build, lv_demo_widgets_destroy);
+
+#ifdef USE_ASSET_PACK
+// Shown instead of the UI when the assets partition holds no valid pack: the icon
+// fonts only exist in the pack, every icon would be a missing-glyph box
+static void assets_missing_build(lv_obj_t *scr)
+{
+    lv_obj_t *label = lv_label_create(scr, NULL);
+    lv_label_set_align(label, LV_LABEL_ALIGN_CENTER);
+    lv_label_set_text(label, "Assets missing\n\nFlash the asset pack:\npio run -t uploadassets");
+    lv_obj_align(label, scr, LV_ALIGN_CENTER, 0, 0);
+}
+SCREEN_DEFINE(assets_missing_screen, "assets", 2048, assets_missing_build, NULL);
+#endif
 
 // Forward declarations for relay/utility functions
 void relayTurnOn(void);
@@ -228,6 +256,60 @@ float getVoltage()
     return ttgo->getVoltage();
 }
 
+// Publish runtime diagnostics (heap, glyph cache) as JSON
+void publishDiagnostics()
+{
+    StaticJsonDocument<896> doc;
+    doc["uptime"] = millis() / 1000;
+    doc["free_heap"] = ESP.getFreeHeap();
+    doc["free_psram"] = ESP.getFreePsram();
+
+#ifdef USE_TTF_FONTS
+    ttf_font_stats_t stats;
+    ttf_font_get_stats(&stats);
+    uint32_t lookups = stats.hits + stats.misses;
+    JsonObject glyphs = doc.createNestedObject("glyph_cache");
+    glyphs["hits"] = stats.hits;
+    glyphs["misses"] = stats.misses;
+    glyphs["hit_rate"] = lookups ? (float)stats.hits / lookups : 0.0f;
+    glyphs["evictions"] = stats.evictions;
+    glyphs["glyphs"] = stats.glyphs;
+    glyphs["bytes"] = stats.cache_bytes;
+    glyphs["budget"] = stats.cache_budget;
+    glyphs["raster_us_avg"] = stats.raster_count ? (uint32_t)(stats.raster_us_total / stats.raster_count) : 0;
+    glyphs["raster_us_max"] = stats.raster_us_max;
+#endif
+
+#ifdef USE_LV_MEM_TLSF
+    tlsf_monitor_t mon;
+    if (lv_mem_tlsf_monitor(&mon)) {
+        JsonObject heap = doc.createNestedObject("lvgl_heap");
+        heap["total"] = mon.total;
+        heap["used"] = mon.used;
+        heap["free"] = mon.free;
+        heap["largest_free"] = mon.largest_free;
+        heap["max_used"] = mon.max_used;
+        heap["free_blocks"] = mon.free_blocks;
+        heap["frag_pct"] = mon.frag_pct;
+        heap["failed"] = mon.failed;
+        heap["arena_spills"] = lv_mem_tlsf_arena_spills();
+
+        JsonObject screens = heap.createNestedObject("screens");
+        const screen_t* all[] = { &wifi_screen, &main_screen };
+        for (const screen_t* s : all) {
+            JsonObject o = screens.createNestedObject(s->name);
+            o["arena"] = s->arena_size;
+            o["peak"] = s->arena_peak;
+            o["builds"] = s->builds;
+        }
+    }
+#endif
+
+    char payload[896];
+    serializeJson(doc, payload, sizeof(payload));
+    mqttManager.publish(MQTT_DIAGNOSTICS_TOPIC, payload, false);
+}
+
 void setup()
 {
     Serial.begin(115200);
@@ -256,9 +338,25 @@ void setup()
     ttgo->lvgl_begin();
     Serial.println("✓ LVGL initialized in landscape mode");
 
+#ifdef USE_ASSET_PACK
+    // Map fonts and icons from the assets partition before any screen uses them
+    if (asset_pack_open(NULL)) {
+        Serial.printf("✓ Asset pack mapped (%u assets)\n", asset_pack_count());
+    } else {
+        Serial.println("✗ Asset pack: NOT FOUND (run: pio run -t uploadassets)");
+        screen_show(&assets_missing_screen);
+        while (true) {
+            lv_task_handler();
+            delay(5);
+        }
+    }
+#endif
+
     // Show WiFi connection screen FIRST
     Serial.println("✓ Creating WiFi connection screen...");
-    wifi_screen_create();
+    screen_show(&wifi_screen);
+    // Build the main UI in idle time while WiFi and MQTT connect
+    screen_preload(&main_screen);
     
     // Force screen to render immediately
     lv_task_handler();
@@ -332,11 +430,8 @@ void loop()
     
     // Once WiFi and MQTT are connected, load main UI
     if (wifi_connected && mqtt_connected && !main_ui_loaded) {
-        Serial.println("✓ Hiding WiFi screen and loading main UI...");
-        wifi_screen_hide();
-        
-        Serial.println("✓ Starting LVGL demo widgets...");
-        lv_demo_widgets();
+        Serial.println("✓ Loading main UI (WiFi screen arena released)...");
+        screen_show(&main_screen);
         
         main_ui_loaded = true;
         Serial.println("\n✓✓✓ ALL READY - Full screen landscape with WiFi and MQTT! ✓✓✓\n");
@@ -350,6 +445,11 @@ void loop()
     // Handle MQTT messages
     if (mqtt_connected) {
         mqttManager.loop();
+
+        if (millis() - last_diag_ms >= DIAG_INTERVAL_MS) {
+            last_diag_ms = millis();
+            publishDiagnostics();
+        }
     }
     
     // Handle LVGL display refresh
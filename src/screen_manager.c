@@ -0,0 +1,97 @@
+/**
+ * @file screen_manager.c
+ * Screens built into their own allocation arena, loaded and destroyed as a unit
+ */
+
+#include "screen_manager.h"
+#include <stdio.h>
+
+/* Arenas only hold LVGL objects when LVGL allocates through lv_mem_tlsf_alloc */
+#if defined(USE_LV_MEM_TLSF) && !LV_MEM_CUSTOM
+#error "USE_LV_MEM_TLSF is set but LVGL is built with LV_MEM_CUSTOM 0: screen arenas would stay empty"
+#endif
+
+static screen_t * active;
+
+static void build(screen_t * s)
+{
+    if(s->scr) return;
+
+#ifdef USE_LV_MEM_TLSF
+    s->arena = lv_mem_tlsf_arena_create(s->arena_size);
+    if(s->arena == NULL) printf("screen %s: no arena, building in the shared pool\n", s->name);
+    tlsf_t * prev = lv_mem_tlsf_set_arena(s->arena);
+#endif
+
+    s->scr = lv_obj_create(NULL, NULL);
+    s->build(s->scr);
+    s->builds++;
+
+#ifdef USE_LV_MEM_TLSF
+    lv_mem_tlsf_set_arena(prev);
+#endif
+}
+
+static void preload_cb(lv_task_t * task)
+{
+    screen_t * s = task->user_data;
+    s->preload_task = NULL;     /* lv_task_once deletes the task after this call */
+    build(s);
+}
+
+void screen_destroy(screen_t * s)
+{
+    if(s->preload_task) {
+        lv_task_del(s->preload_task);
+        s->preload_task = NULL;
+    }
+    if(s->scr == NULL) return;
+
+    lv_obj_del(s->scr);
+    s->scr = NULL;
+    if(s->destroy) s->destroy();
+
+#ifdef USE_LV_MEM_TLSF
+    if(s->arena) {
+        tlsf_monitor_t mon;
+        tlsf_monitor(s->arena, &mon);
+        if(mon.max_used > s->arena_peak) s->arena_peak = mon.max_used;
+
+        /* Cached draw buffers may have been taken from the arena while it was active */
+        _lv_mem_buf_free_all();
+        lv_mem_tlsf_arena_release(s->arena);
+        s->arena = NULL;
+    }
+#endif
+
+    if(active == s) active = NULL;
+}
+
+void screen_show(screen_t * s)
+{
+    if(s == active) return;
+
+    if(s->preload_task) {
+        lv_task_del(s->preload_task);
+        s->preload_task = NULL;
+    }
+    build(s);
+    lv_scr_load(s->scr);
+
+    screen_t * prev = active;
+    active = s;
+    if(prev) screen_destroy(prev);
+}
+
+void screen_preload(screen_t * s)
+{
+    if(s->scr || s->preload_task) return;
+
+    s->preload_task = lv_task_create(preload_cb, 0, LV_TASK_PRIO_LOWEST, s);
+    lv_task_once(s->preload_task);
+}
+
+screen_t * screen_active(void)
+{
+    return active;
+}
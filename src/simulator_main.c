@@ -16,6 +16,9 @@
 #include "lv_conf_sim.h"
 #include "lvgl.h"
 #include "hal/hal.h"
+#ifdef USE_ASSET_PACK
+#include "asset_pack.h"
+#endif
 
 /* Import the demo widgets function */
 extern void lv_demo_widgets(void);
@@ -34,6 +37,15 @@ int main(int argc, char **argv)
     /* Using 320x480 to match the LilyPi display size */
     sdl_hal_init(320, 480);
 
+#ifdef USE_ASSET_PACK
+    /* Map the same asset pack the device reads from flash; icons only exist in it */
+    if(!asset_pack_open(argc > 1 ? argv[1] : NULL)) {
+        printf("Asset pack missing, build it with: pio run -e simulator (or pass a pack path)\n");
+        SDL_Quit();
+        return 1;
+    }
+#endif
+
     /* Run the demo widgets (same as on the real device) */
     lv_demo_widgets();
 
@@ -0,0 +1,422 @@
+/**
+ * @file tlsf.c
+ * Two-Level Segregated Fit allocator
+ *
+ * Free blocks are kept in segregated lists indexed by a first level (power of
+ * two) and a second level (16 linear subdivisions of it); two bitmaps tell
+ * which lists are non-empty, so finding a fitting block and freeing with
+ * immediate coalescing of physical neighbours are both constant time.
+ *
+ * Block layout: the header is {prev_phys, size|flags}; prev_phys is only valid
+ * while the previous block is free and overlaps the last word of its payload.
+ * Free blocks additionally hold the free-list links in their payload.
+ */
+
+#include "tlsf.h"
+#include <string.h>
+
+#define SL_INDEX_COUNT_LOG2 4
+#define ALIGN_SIZE          sizeof(void *)
+#define ALIGN_SIZE_LOG2     (sizeof(void *) == 8 ? 3 : 2)
+#define FL_INDEX_MAX        26      /* largest block: 64 MB */
+#define SL_INDEX_COUNT      (1 << SL_INDEX_COUNT_LOG2)
+#define FL_INDEX_SHIFT      (SL_INDEX_COUNT_LOG2 + ALIGN_SIZE_LOG2)
+#define FL_INDEX_COUNT      (FL_INDEX_MAX - FL_INDEX_SHIFT + 1)
+#define SMALL_BLOCK_SIZE    ((size_t)1 << FL_INDEX_SHIFT)
+
+#define BLOCK_FREE_BIT      ((size_t)1)
+#define BLOCK_PREV_FREE_BIT ((size_t)2)
+
+typedef struct block {
+    struct block * prev_phys;
+    size_t size;
+    struct block * next_free;
+    struct block * prev_free;
+} block_t;
+
+#define BLOCK_OVERHEAD      sizeof(size_t)
+#define BLOCK_START_OFFSET  (offsetof(block_t, size) + sizeof(size_t))
+#define BLOCK_SIZE_MIN      (sizeof(block_t) - sizeof(block_t *))
+#define BLOCK_SIZE_MAX      ((size_t)1 << FL_INDEX_MAX)
+
+struct tlsf {
+    block_t null_block;     /* empty list sentinel */
+    uint32_t fl_bitmap;
+    uint32_t sl_bitmap[FL_INDEX_COUNT];
+    block_t * blocks[FL_INDEX_COUNT][SL_INDEX_COUNT];
+    uint8_t * pool_start;
+    uint8_t * pool_end;
+    size_t total;
+    size_t used;
+    size_t max_used;
+    uint32_t allocs;
+    uint32_t failed;
+};
+
+/*
+ * Bit helpers
+ */
+
+static inline int tlsf_ffs(uint32_t word)
+{
+    return word ? __builtin_ctz(word) : -1;
+}
+
+static inline int tlsf_fls(size_t size)
+{
+    if(size == 0) return -1;
+#if SIZE_MAX > 0xFFFFFFFFU
+    return 63 - __builtin_clzll((unsigned long long)size);
+#else
+    return 31 - __builtin_clz((unsigned int)size);
+#endif
+}
+
+/*
+ * Block helpers
+ */
+
+static inline size_t block_size(const block_t * b)
+{
+    return b->size & ~(BLOCK_FREE_BIT | BLOCK_PREV_FREE_BIT);
+}
+
+static inline void block_set_size(block_t * b, size_t size)
+{
+    b->size = size | (b->size & (BLOCK_FREE_BIT | BLOCK_PREV_FREE_BIT));
+}
+
+static inline bool block_is_free(const block_t * b)
+{
+    return (b->size & BLOCK_FREE_BIT) != 0;
+}
+
+static inline bool block_is_prev_free(const block_t * b)
+{
+    return (b->size & BLOCK_PREV_FREE_BIT) != 0;
+}
+
+static inline void block_set_free(block_t * b, bool free)
+{
+    b->size = free ? (b->size | BLOCK_FREE_BIT) : (b->size & ~BLOCK_FREE_BIT);
+}
+
+static inline void block_set_prev_free(block_t * b, bool free)
+{
+    b->size = free ? (b->size | BLOCK_PREV_FREE_BIT) : (b->size & ~BLOCK_PREV_FREE_BIT);
+}
+
+static inline block_t * block_from_ptr(const void * ptr)
+{
+    return (block_t *)((uint8_t *)ptr - BLOCK_START_OFFSET);
+}
+
+static inline void * block_to_ptr(const block_t * b)
+{
+    return (uint8_t *)b + BLOCK_START_OFFSET;
+}
+
+static inline block_t * offset_to_block(const void * ptr, ptrdiff_t offset)
+{
+    return (block_t *)((uint8_t *)ptr + offset);
+}
+
+static inline block_t * block_next(const block_t * b)
+{
+    return offset_to_block(block_to_ptr(b), (ptrdiff_t)(block_size(b) - BLOCK_OVERHEAD));
+}
+
+static inline block_t * block_link_next(block_t * b)
+{
+    block_t * next = block_next(b);
+    next->prev_phys = b;
+    return next;
+}
+
+static inline void block_mark_as_free(block_t * b)
+{
+    block_t * next = block_link_next(b);
+    block_set_prev_free(next, true);
+    block_set_free(b, true);
+}
+
+static inline void block_mark_as_used(block_t * b)
+{
+    block_t * next = block_next(b);
+    block_set_prev_free(next, false);
+    block_set_free(b, false);
+}
+
+static inline size_t align_up(size_t x)
+{
+    return (x + (ALIGN_SIZE - 1)) & ~(ALIGN_SIZE - 1);
+}
+
+static inline size_t align_down(size_t x)
+{
+    return x - (x & (ALIGN_SIZE - 1));
+}
+
+static size_t adjust_request_size(size_t size)
+{
+    if(size == 0 || size > BLOCK_SIZE_MAX) return 0;
+    size_t aligned = align_up(size);
+    return aligned < BLOCK_SIZE_MIN ? align_up(BLOCK_SIZE_MIN) : aligned;
+}
+
+/*
+ * Size class mapping
+ */
+
+static void mapping_insert(size_t size, int * fli, int * sli)
+{
+    if(size < SMALL_BLOCK_SIZE) {
+        *fli = 0;
+        *sli = (int)(size / (SMALL_BLOCK_SIZE / SL_INDEX_COUNT));
+    } else {
+        int fl = tlsf_fls(size);
+        *sli = (int)(size >> (fl - SL_INDEX_COUNT_LOG2)) ^ (1 << SL_INDEX_COUNT_LOG2);
+        *fli = fl - (FL_INDEX_SHIFT - 1);
+    }
+}
+
+/* Round up to the next list so any block found there is big enough */
+static void mapping_search(size_t size, int * fli, int * sli)
+{
+    if(size >= SMALL_BLOCK_SIZE) {
+        size += ((size_t)1 << (tlsf_fls(size) - SL_INDEX_COUNT_LOG2)) - 1;
+    }
+    mapping_insert(size, fli, sli);
+}
+
+static block_t * search_suitable_block(tlsf_t * t, int * fli, int * sli)
+{
+    int fl = *fli;
+    int sl = *sli;
+    uint32_t sl_map = t->sl_bitmap[fl] & (~0U << sl);
+    if(!sl_map) {
+        uint32_t fl_map = fl + 1 < 32 ? t->fl_bitmap & (~0U << (fl + 1)) : 0;
+        if(!fl_map) return NULL;
+        fl = tlsf_ffs(fl_map);
+        *fli = fl;
+        sl_map = t->sl_bitmap[fl];
+    }
+    sl = tlsf_ffs(sl_map);
+    *sli = sl;
+    return t->blocks[fl][sl];
+}
+
+/*
+ * Free lists
+ */
+
+static void remove_free_block(tlsf_t * t, block_t * b, int fl, int sl)
+{
+    block_t * prev = b->prev_free;
+    block_t * next = b->next_free;
+    next->prev_free = prev;
+    prev->next_free = next;
+
+    if(t->blocks[fl][sl] == b) {
+        t->blocks[fl][sl] = next;
+        if(next == &t->null_block) {
+            t->sl_bitmap[fl] &= ~(1U << sl);
+            if(!t->sl_bitmap[fl]) t->fl_bitmap &= ~(1U << fl);
+        }
+    }
+}
+
+static void insert_free_block(tlsf_t * t, block_t * b, int fl, int sl)
+{
+    block_t * current = t->blocks[fl][sl];
+    b->next_free = current;
+    b->prev_free = &t->null_block;
+    current->prev_free = b;
+    t->blocks[fl][sl] = b;
+    t->fl_bitmap |= 1U << fl;
+    t->sl_bitmap[fl] |= 1U << sl;
+}
+
+static void block_remove(tlsf_t * t, block_t * b)
+{
+    int fl, sl;
+    mapping_insert(block_size(b), &fl, &sl);
+    remove_free_block(t, b, fl, sl);
+}
+
+static void block_insert(tlsf_t * t, block_t * b)
+{
+    int fl, sl;
+    mapping_insert(block_size(b), &fl, &sl);
+    insert_free_block(t, b, fl, sl);
+}
+
+/*
+ * Split and merge
+ */
+
+static block_t * block_split(block_t * b, size_t size)
+{
+    block_t * remaining = offset_to_block(block_to_ptr(b), (ptrdiff_t)(size - BLOCK_OVERHEAD));
+    size_t remain_size = block_size(b) - (size + BLOCK_OVERHEAD);
+    remaining->size = 0;
+    block_set_size(remaining, remain_size);
+    block_set_size(b, size);
+    block_mark_as_free(remaining);
+    return remaining;
+}
+
+static block_t * block_absorb(block_t * prev, block_t * b)
+{
+    prev->size += block_size(b) + BLOCK_OVERHEAD;
+    block_link_next(prev);
+    return prev;
+}
+
+static block_t * block_merge_prev(tlsf_t * t, block_t * b)
+{
+    if(block_is_prev_free(b)) {
+        block_t * prev = b->prev_phys;
+        block_remove(t, prev);
+        b = block_absorb(prev, b);
+    }
+    return b;
+}
+
+static block_t * block_merge_next(tlsf_t * t, block_t * b)
+{
+    block_t * next = block_next(b);
+    if(block_is_free(next)) {
+        block_remove(t, next);
+        b = block_absorb(b, next);
+    }
+    return b;
+}
+
+static void block_trim_free(tlsf_t * t, block_t * b, size_t size)
+{
+    if(block_size(b) >= sizeof(block_t) + size) {
+        block_t * remaining = block_split(b, size);
+        block_link_next(b);
+        block_set_prev_free(remaining, true);
+        block_insert(t, remaining);
+    }
+}
+
+/*
+ * Public API
+ */
+
+size_t tlsf_overhead(void)
+{
+    /* Control structure plus the first block's header and the end sentinel */
+    return align_up(sizeof(tlsf_t)) + 2 * BLOCK_OVERHEAD;
+}
+
+tlsf_t * tlsf_create(void * mem, size_t bytes)
+{
+    if(mem == NULL || ((uintptr_t)mem & (ALIGN_SIZE - 1)) != 0) return NULL;
+    if(bytes < tlsf_overhead() + BLOCK_SIZE_MIN) return NULL;
+
+    tlsf_t * t = mem;
+    memset(t, 0, sizeof(*t));
+    t->null_block.next_free = &t->null_block;
+    t->null_block.prev_free = &t->null_block;
+    for(int i = 0; i < FL_INDEX_COUNT; i++) {
+        for(int j = 0; j < SL_INDEX_COUNT; j++) t->blocks[i][j] = &t->null_block;
+    }
+
+    uint8_t * pool = (uint8_t *)mem + align_up(sizeof(tlsf_t));
+    size_t pool_bytes = align_down(bytes - align_up(sizeof(tlsf_t)) - 2 * BLOCK_OVERHEAD);
+    if(pool_bytes > BLOCK_SIZE_MAX) pool_bytes = BLOCK_SIZE_MAX;
+
+    /* The first block's prev_phys lies before the pool; it is never read since prev is "used" */
+    block_t * b = offset_to_block(pool, -(ptrdiff_t)BLOCK_OVERHEAD);
+    b->size = 0;
+    block_set_size(b, pool_bytes);
+    block_set_free(b, true);
+    block_set_prev_free(b, false);
+    block_insert(t, b);
+
+    /* Zero-sized used sentinel at the end stops merging */
+    block_t * sentinel = block_link_next(b);
+    sentinel->size = 0;
+    block_set_free(sentinel, false);
+    block_set_prev_free(sentinel, true);
+
+    t->pool_start = pool;
+    t->pool_end = pool + pool_bytes + BLOCK_OVERHEAD;
+    t->total = pool_bytes;
+    return t;
+}
+
+void * tlsf_malloc(tlsf_t * t, size_t size)
+{
+    size_t adjusted = adjust_request_size(size);
+    if(adjusted == 0) return NULL;
+
+    int fl, sl;
+    mapping_search(adjusted, &fl, &sl);
+    block_t * b = fl < FL_INDEX_COUNT ? search_suitable_block(t, &fl, &sl) : NULL;
+    if(b == NULL || b == &t->null_block) {
+        t->failed++;
+        return NULL;
+    }
+    remove_free_block(t, b, fl, sl);
+    block_trim_free(t, b, adjusted);
+    block_mark_as_used(b);
+
+    t->used += block_size(b) + BLOCK_OVERHEAD;
+    if(t->used > t->max_used) t->max_used = t->used;
+    t->allocs++;
+    return block_to_ptr(b);
+}
+
+void tlsf_free(tlsf_t * t, void * ptr)
+{
+    if(ptr == NULL) return;
+    block_t * b = block_from_ptr(ptr);
+    t->used -= block_size(b) + BLOCK_OVERHEAD;
+    t->allocs--;
+
+    block_mark_as_free(b);
+    b = block_merge_prev(t, b);
+    b = block_merge_next(t, b);
+    block_insert(t, b);
+}
+
+size_t tlsf_block_size(const void * ptr)
+{
+    return ptr ? block_size(block_from_ptr(ptr)) : 0;
+}
+
+bool tlsf_owns(const tlsf_t * t, const void * ptr)
+{
+    return t && (const uint8_t *)ptr >= t->pool_start && (const uint8_t *)ptr < t->pool_end;
+}
+
+uint32_t tlsf_alloc_count(const tlsf_t * t)
+{
+    return t->allocs;
+}
+
+void tlsf_monitor(const tlsf_t * t, tlsf_monitor_t * mon)
+{
+    memset(mon, 0, sizeof(*mon));
+    mon->total = t->total;
+    mon->used = t->used;
+    mon->max_used = t->max_used;
+    mon->allocs = t->allocs;
+    mon->failed = t->failed;
+
+    const block_t * b = offset_to_block(t->pool_start, -(ptrdiff_t)BLOCK_OVERHEAD);
+    while(block_size(b) != 0) {
+        if(block_is_free(b)) {
+            mon->free += block_size(b);
+            mon->free_blocks++;
+            if(block_size(b) > mon->largest_free) mon->largest_free = block_size(b);
+        }
+        b = block_next(b);
+    }
+    if(mon->free) mon->frag_pct = (uint8_t)(100 - mon->largest_free * 100 / mon->free);
+}
@@ -0,0 +1,1172 @@
+/**
+ * @file ttf_font.c
+ * Runtime TrueType fonts for LVGL with an LRU glyph cache
+ *
+ * Glyph outlines are read straight from the TTF data (no copy), variable
+ * fonts are instanced through gvar/avar for the requested weight, and the
+ * outline is rasterized to an 8 bpp coverage bitmap with a signed-area
+ * accumulation scanline. Bitmaps are kept in a byte-budgeted LRU cache that
+ * lives in PSRAM on the device, so repeated text costs one hash lookup.
+ */
+
+#if !defined(ESP_PLATFORM) && !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 199309L     /* clock_gettime() with -std=c11 */
+#endif
+
+#include "ttf_font.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef ESP_PLATFORM
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#else
+#include <time.h>
+#endif
+
+#ifndef USE_ASSET_PACK
+#include "../fonts/montserrat_embedded.h"
+#endif
+
+#define TTF_CACHE_BUCKETS   128     /* power of two */
+#define TTF_MAX_COMPONENTS  32      /* components per composite glyph */
+#define TTF_MAX_DEPTH       4       /* nested composite glyphs */
+#define TTF_MAX_AXES        4
+
+/* Simple glyph flags */
+#define FLAG_ON_CURVE       0x01
+#define FLAG_X_SHORT        0x02
+#define FLAG_Y_SHORT        0x04
+#define FLAG_REPEAT         0x08
+#define FLAG_X_SAME         0x10
+#define FLAG_Y_SAME         0x20
+
+/* Composite glyph flags */
+#define COMP_ARG_WORDS      0x0001
+#define COMP_ARGS_XY        0x0002
+#define COMP_SCALE          0x0008
+#define COMP_MORE           0x0020
+#define COMP_XY_SCALE       0x0040
+#define COMP_2X2            0x0080
+
+typedef struct {
+    const uint8_t * data;
+    size_t size;
+    uint32_t cmap;          /* selected cmap subtable */
+    uint32_t loca;
+    uint32_t glyf;
+    uint32_t hmtx;
+    uint32_t gvar;
+    uint32_t avar;
+    uint16_t units_per_em;
+    uint16_t num_hmetrics;
+    uint16_t num_glyphs;
+    int16_t loc_format;
+    int16_t ascender;
+    int16_t descender;
+    uint16_t axis_count;
+    int16_t wght_axis;      /* index of the wght axis, -1 if none */
+    float wght_min;
+    float wght_def;
+    float wght_max;
+} ttf_face_t;
+
+typedef struct {
+    ttf_face_t face;
+    float scale;            /* pixels per font unit */
+    float wght;             /* normalized wght coordinate (-1..1) */
+    uint8_t id;
+} ttf_font_dsc_t;
+
+typedef struct {
+    float x;
+    float y;
+    uint8_t on;
+} ttf_point_t;
+
+typedef struct _ttf_glyph {
+    struct _ttf_glyph * hash_next;
+    struct _ttf_glyph * lru_prev;
+    struct _ttf_glyph * lru_next;
+    uint32_t letter;
+    uint8_t font_id;
+    uint8_t box_w;
+    uint8_t box_h;
+    int8_t ofs_x;
+    int8_t ofs_y;
+    uint16_t adv_w;
+    uint32_t size;
+    uint8_t bitmap[];
+} ttf_glyph_t;
+
+/* Outline scratch, reused for every glyph */
+static ttf_point_t * pts;
+static uint16_t pts_cap;
+static uint16_t n_pts;
+static uint16_t * ends;
+static uint16_t ends_cap;
+static uint16_t n_ends;
+
+/* Variation scratch */
+static ttf_point_t * orig;
+static int16_t * vdx;
+static int16_t * vdy;
+static float * tdx;
+static float * tdy;
+static uint16_t * slist;    /* shared point numbers of the glyph */
+static uint16_t * vlist;    /* private point numbers of the current tuple */
+static uint8_t * touched;
+static uint16_t var_cap;
+
+/* Raster scratch */
+static float * acc;
+static uint32_t acc_cap;
+
+/* Glyph cache */
+static ttf_glyph_t * buckets[TTF_CACHE_BUCKETS];
+static ttf_glyph_t * lru_head;  /* most recently used */
+static ttf_glyph_t * lru_tail;  /* least recently used */
+static ttf_glyph_t * last_glyph;
+static ttf_font_stats_t stats = { .cache_budget = TTF_CACHE_BUDGET };
+static uint8_t next_font_id = 1;
+
+/*
+ * Platform helpers
+ */
+
+static void * cache_alloc(size_t size)
+{
+#ifdef ESP_PLATFORM
+    void * p = heap_caps_malloc(size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    return p ? p : malloc(size);
+#else
+    return malloc(size);
+#endif
+}
+
+static uint64_t now_us(void)
+{
+#ifdef ESP_PLATFORM
+    return (uint64_t)esp_timer_get_time();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000ULL;
+#endif
+}
+
+static bool grow(void ** buf, uint32_t * cap, uint32_t need, size_t elem)
+{
+    if(need <= *cap) return true;
+    uint32_t new_cap = *cap ? *cap : 64;
+    while(new_cap < need) new_cap *= 2;
+    void * p = realloc(*buf, new_cap * elem);
+    if(p == NULL) return false;
+    *buf = p;
+    *cap = new_cap;
+    return true;
+}
+
+static bool grow16(void ** buf, uint16_t * cap, uint32_t need, size_t elem)
+{
+    uint32_t cap32 = *cap;
+    if(need > 0xFFFF || !grow(buf, &cap32, need, elem)) return false;
+    *cap = cap32 > 0xFFFF ? 0xFFFF : (uint16_t)cap32;
+    return true;
+}
+
+/*
+ * Big-endian readers
+ */
+
+static inline uint16_t rd16(const uint8_t * p)
+{
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+static inline int16_t rds16(const uint8_t * p)
+{
+    return (int16_t)rd16(p);
+}
+
+static inline uint32_t rd32(const uint8_t * p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static inline float f2dot14(const uint8_t * p)
+{
+    return (float)rds16(p) / 16384.0f;
+}
+
+/*
+ * Face parsing
+ */
+
+static uint32_t find_table(const uint8_t * data, size_t size, const char * tag)
+{
+    uint16_t num_tables = rd16(data + 4);
+    for(uint16_t i = 0; i < num_tables; i++) {
+        const uint8_t * rec = data + 12 + 16 * i;
+        if(memcmp(rec, tag, 4) == 0) {
+            uint32_t offset = rd32(rec + 8);
+            return offset < size ? offset : 0;
+        }
+    }
+    return 0;
+}
+
+static bool face_init(ttf_face_t * face, const uint8_t * data, size_t size)
+{
+    memset(face, 0, sizeof(*face));
+    if(size < 12 || (rd32(data) != 0x00010000 && memcmp(data, "true", 4) != 0)) return false;
+
+    face->data = data;
+    face->size = size;
+    uint32_t head = find_table(data, size, "head");
+    uint32_t hhea = find_table(data, size, "hhea");
+    uint32_t maxp = find_table(data, size, "maxp");
+    uint32_t cmap = find_table(data, size, "cmap");
+    face->loca = find_table(data, size, "loca");
+    face->glyf = find_table(data, size, "glyf");
+    face->hmtx = find_table(data, size, "hmtx");
+    if(!head || !hhea || !maxp || !cmap || !face->loca || !face->glyf || !face->hmtx) return false;
+
+    face->units_per_em = rd16(data + head + 18);
+    face->loc_format = rds16(data + head + 50);
+    face->ascender = rds16(data + hhea + 4);
+    face->descender = rds16(data + hhea + 6);
+    face->num_hmetrics = rd16(data + hhea + 34);
+    face->num_glyphs = rd16(data + maxp + 4);
+
+    /* Prefer the full Unicode table (format 12), fall back to the BMP table (format 4) */
+    uint16_t num_sub = rd16(data + cmap + 2);
+    for(uint16_t i = 0; i < num_sub; i++) {
+        const uint8_t * rec = data + cmap + 4 + 8 * i;
+        uint16_t platform = rd16(rec);
+        uint16_t encoding = rd16(rec + 2);
+        uint32_t sub = cmap + rd32(rec + 4);
+        uint16_t format = rd16(data + sub);
+        if(format == 12 && (platform == 0 || (platform == 3 && encoding == 10))) {
+            face->cmap = sub;
+            break;
+        }
+        if(format == 4 && (platform == 0 || (platform == 3 && encoding == 1)) && face->cmap == 0) {
+            face->cmap = sub;
+        }
+    }
+    if(face->cmap == 0) return false;
+
+    /* Variable font: only the wght axis is instanced */
+    face->wght_axis = -1;
+    uint32_t fvar = find_table(data, size, "fvar");
+    if(fvar) {
+        uint16_t axes_offset = rd16(data + fvar + 4);
+        face->axis_count = rd16(data + fvar + 8);
+        uint16_t axis_size = rd16(data + fvar + 10);
+        for(uint16_t i = 0; i < face->axis_count && i < TTF_MAX_AXES; i++) {
+            const uint8_t * axis = data + fvar + axes_offset + axis_size * i;
+            if(memcmp(axis, "wght", 4) == 0) {
+                face->wght_axis = (int16_t)i;
+                face->wght_min = (float)(int32_t)rd32(axis + 4) / 65536.0f;
+                face->wght_def = (float)(int32_t)rd32(axis + 8) / 65536.0f;
+                face->wght_max = (float)(int32_t)rd32(axis + 12) / 65536.0f;
+            }
+        }
+        if(face->axis_count <= TTF_MAX_AXES && face->wght_axis >= 0) {
+            face->gvar = find_table(data, size, "gvar");
+            face->avar = find_table(data, size, "avar");
+        }
+    }
+    return true;
+}
+
+static uint16_t glyph_index(const ttf_face_t * face, uint32_t letter)
+{
+    const uint8_t * sub = face->data + face->cmap;
+
+    if(rd16(sub) == 12) {
+        uint32_t lo = 0;
+        uint32_t hi = rd32(sub + 12);
+        while(lo < hi) {
+            uint32_t mid = (lo + hi) / 2;
+            const uint8_t * group = sub + 16 + 12 * mid;
+            if(letter < rd32(group)) hi = mid;
+            else if(letter > rd32(group + 4)) lo = mid + 1;
+            else return (uint16_t)(rd32(group + 8) + letter - rd32(group));
+        }
+        return 0;
+    }
+
+    if(letter > 0xFFFF) return 0;
+    uint16_t seg_count = rd16(sub + 6) / 2;
+    const uint8_t * end_codes = sub + 14;
+    const uint8_t * start_codes = end_codes + 2 * seg_count + 2;
+    const uint8_t * deltas = start_codes + 2 * seg_count;
+    const uint8_t * range_offsets = deltas + 2 * seg_count;
+    uint16_t lo = 0;
+    uint16_t hi = seg_count;
+    while(lo < hi) {
+        uint16_t mid = (lo + hi) / 2;
+        if(letter > rd16(end_codes + 2 * mid)) lo = mid + 1;
+        else hi = mid;
+    }
+    if(lo >= seg_count || letter < rd16(start_codes + 2 * lo)) return 0;
+    uint16_t range_offset = rd16(range_offsets + 2 * lo);
+    if(range_offset == 0) return (uint16_t)(letter + rd16(deltas + 2 * lo));
+    const uint8_t * gp = range_offsets + 2 * lo + range_offset + 2 * (letter - rd16(start_codes + 2 * lo));
+    uint16_t gid = rd16(gp);
+    return gid ? (uint16_t)(gid + rd16(deltas + 2 * lo)) : 0;
+}
+
+static void glyph_range(const ttf_face_t * face, uint16_t gid, uint32_t * start, uint32_t * end)
+{
+    const uint8_t * loca = face->data + face->loca;
+    if(face->loc_format == 0) {
+        *start = face->glyf + 2U * rd16(loca + 2 * gid);
+        *end = face->glyf + 2U * rd16(loca + 2 * gid + 2);
+    } else {
+        *start = face->glyf + rd32(loca + 4 * gid);
+        *end = face->glyf + rd32(loca + 4 * gid + 4);
+    }
+}
+
+static void glyph_metrics(const ttf_face_t * face, uint16_t gid, uint16_t * adv, int16_t * lsb)
+{
+    const uint8_t * hmtx = face->data + face->hmtx;
+    if(gid < face->num_hmetrics) {
+        *adv = rd16(hmtx + 4 * gid);
+        *lsb = rds16(hmtx + 4 * gid + 2);
+    } else {
+        *adv = rd16(hmtx + 4 * (face->num_hmetrics - 1));
+        *lsb = rds16(hmtx + 4 * face->num_hmetrics + 2 * (gid - face->num_hmetrics));
+    }
+}
+
+/*
+ * Variations (gvar)
+ */
+
+static float normalize_weight(const ttf_face_t * face, float weight)
+{
+    if(weight < face->wght_min) weight = face->wght_min;
+    if(weight > face->wght_max) weight = face->wght_max;
+
+    float n = 0.0f;
+    if(weight < face->wght_def && face->wght_def > face->wght_min) {
+        n = -(face->wght_def - weight) / (face->wght_def - face->wght_min);
+    } else if(weight > face->wght_def && face->wght_max > face->wght_def) {
+        n = (weight - face->wght_def) / (face->wght_max - face->wght_def);
+    }
+
+    if(face->avar) {
+        const uint8_t * p = face->data + face->avar + 6;
+        for(int16_t axis = 0; axis < face->wght_axis; axis++) p += 2 + 4 * rd16(p);
+        uint16_t count = rd16(p);
+        const uint8_t * map = p + 2;
+        for(uint16_t i = 1; i < count; i++) {
+            float from0 = f2dot14(map + 4 * (i - 1));
+            float from1 = f2dot14(map + 4 * i);
+            if(n <= from1) {
+                float to0 = f2dot14(map + 4 * (i - 1) + 2);
+                float to1 = f2dot14(map + 4 * i + 2);
+                n = from1 > from0 ? to0 + (n - from0) * (to1 - to0) / (from1 - from0) : to1;
+                break;
+            }
+        }
+    }
+    return n;
+}
+
+static const uint8_t * read_point_numbers(const uint8_t * p, uint16_t * list, uint16_t max, uint16_t * count, bool * all)
+{
+    uint16_t n = *p++;
+    if(n & 0x80) n = (uint16_t)(((n & 0x7F) << 8) | *p++);
+    *all = (n == 0);
+    *count = 0;
+    uint16_t point = 0;
+    while(*count < n) {
+        uint8_t control = *p++;
+        uint8_t run = (uint8_t)((control & 0x7F) + 1);
+        for(uint8_t i = 0; i < run && *count < n; i++) {
+            if(control & 0x80) {
+                point = (uint16_t)(point + rd16(p));
+                p += 2;
+            } else {
+                point = (uint16_t)(point + *p++);
+            }
+            if(*count < max) list[*count] = point;
+            (*count)++;
+        }
+    }
+    return p;
+}
+
+/**
+ * Read count packed deltas, storing the first max of them
+ * The whole run is always consumed so the y stream starts where the x stream ends.
+ */
+static const uint8_t * read_deltas(const uint8_t * p, int16_t * out, uint16_t count, uint16_t max)
+{
+    uint16_t i = 0;
+    while(i < count) {
+        uint8_t control = *p++;
+        uint8_t run = (uint8_t)((control & 0x3F) + 1);
+        for(uint8_t j = 0; j < run && i < count; j++, i++) {
+            int16_t d;
+            if(control & 0x80) {
+                d = 0;
+            } else if(control & 0x40) {
+                d = rds16(p);
+                p += 2;
+            } else {
+                d = (int8_t)*p++;
+            }
+            if(i < max) out[i] = d;
+        }
+    }
+    return p;
+}
+
+static float interpolate_delta(float x, float x1, float d1, float x2, float d2)
+{
+    if(x1 == x2) return d1 == d2 ? d1 : 0.0f;
+    if(x1 > x2) {
+        float t = x1; x1 = x2; x2 = t;
+        t = d1; d1 = d2; d2 = t;
+    }
+    if(x <= x1) return d1;
+    if(x >= x2) return d2;
+    return d1 + (x - x1) * (d2 - d1) / (x2 - x1);
+}
+
+/* Infer deltas of untouched points from their touched neighbours (IUP) */
+static void interpolate_untouched(uint16_t first, uint16_t last)
+{
+    uint16_t touched_count = 0;
+    uint16_t single = first;
+    for(uint16_t i = first; i <= last; i++) {
+        if(touched[i]) {
+            touched_count++;
+            single = i;
+        }
+    }
+    if(touched_count == 0 || touched_count == (uint16_t)(last - first + 1)) return;
+
+    for(uint16_t i = first; i <= last; i++) {
+        if(touched[i]) continue;
+        if(touched_count == 1) {
+            tdx[i] = tdx[single];
+            tdy[i] = tdy[single];
+            continue;
+        }
+        uint16_t prev = i;
+        do prev = prev == first ? last : (uint16_t)(prev - 1); while(!touched[prev]);
+        uint16_t next = i;
+        do next = next == last ? first : (uint16_t)(next + 1); while(!touched[next]);
+        tdx[i] = interpolate_delta(orig[i].x, orig[prev].x, tdx[prev], orig[next].x, tdx[next]);
+        tdy[i] = interpolate_delta(orig[i].y, orig[prev].y, tdy[prev], orig[next].y, tdy[next]);
+    }
+}
+
+static bool reserve_variations(uint16_t n)
+{
+    if(n <= var_cap) return true;
+    uint16_t cap = var_cap ? var_cap : 64;
+    while(cap < n) cap = cap > 0x7FFF ? 0xFFFF : (uint16_t)(cap * 2);
+
+    void * p;
+#define VAR_REALLOC(buf, elem) \
+    if((p = realloc(buf, (size_t)cap * (elem))) == NULL) return false; \
+    buf = p;
+    VAR_REALLOC(orig, sizeof(ttf_point_t))
+    VAR_REALLOC(vdx, sizeof(int16_t))
+    VAR_REALLOC(vdy, sizeof(int16_t))
+    VAR_REALLOC(tdx, sizeof(float))
+    VAR_REALLOC(tdy, sizeof(float))
+    VAR_REALLOC(slist, sizeof(uint16_t))
+    VAR_REALLOC(vlist, sizeof(uint16_t))
+    VAR_REALLOC(touched, sizeof(uint8_t))
+#undef VAR_REALLOC
+    var_cap = cap;
+    return true;
+}
+
+static float tuple_scalar(const ttf_font_dsc_t * f, const uint8_t * peak, const uint8_t * start, const uint8_t * end)
+{
+    float scalar = 1.0f;
+    for(uint16_t axis = 0; axis < f->face.axis_count; axis++) {
+        float p = f2dot14(peak + 2 * axis);
+        if(p == 0.0f) continue;
+        float c = (int16_t)axis == f->face.wght_axis ? f->wght : 0.0f;
+        if(c == 0.0f) return 0.0f;
+        float s = start ? f2dot14(start + 2 * axis) : (p < 0.0f ? p : 0.0f);
+        float e = end ? f2dot14(end + 2 * axis) : (p > 0.0f ? p : 0.0f);
+        if(c < s || c > e) return 0.0f;
+        if(c < p) scalar *= (c - s) / (p - s);
+        else if(c > p) scalar *= (e - c) / (e - p);
+    }
+    return scalar;
+}
+
+/**
+ * Apply the glyph's variation deltas to its points
+ * @param p points of the glyph (outline points or component offsets) followed by 4 phantom points
+ * @param n number of points including the phantom points
+ * @param contour_ends last point index of each contour (relative to p)
+ */
+static void apply_variations(const ttf_font_dsc_t * f, uint16_t gid, ttf_point_t * p, uint16_t n,
+                             const uint16_t * contour_ends, uint16_t contours)
+{
+    const ttf_face_t * face = &f->face;
+    if(face->gvar == 0 || f->wght == 0.0f) return;
+
+    const uint8_t * g = face->data + face->gvar;
+    if(rd16(g + 4) != face->axis_count || gid >= rd16(g + 12)) return;
+    const uint8_t * shared_tuples = g + rd32(g + 8);
+    uint16_t flags = rd16(g + 14);
+    uint32_t o0;
+    uint32_t o1;
+    if(flags & 1) {
+        o0 = rd32(g + 20 + 4 * gid);
+        o1 = rd32(g + 24 + 4 * gid);
+    } else {
+        o0 = 2U * rd16(g + 20 + 2 * gid);
+        o1 = 2U * rd16(g + 22 + 2 * gid);
+    }
+    if(o1 <= o0) return;
+
+    if(!reserve_variations(n)) return;
+    memcpy(orig, p, n * sizeof(ttf_point_t));
+
+    const uint8_t * var = g + rd32(g + 16) + o0;
+    uint16_t tuple_count = rd16(var);
+    const uint8_t * header = var + 4;
+    const uint8_t * serialized = var + rd16(var + 2);
+
+    uint16_t shared_count = 0;
+    bool shared_all = true;
+    if(tuple_count & 0x8000) {
+        serialized = read_point_numbers(serialized, slist, n, &shared_count, &shared_all);
+    }
+
+    for(uint16_t t = 0; t < (tuple_count & 0x0FFF); t++) {
+        uint16_t data_size = rd16(header);
+        uint16_t tuple_index = rd16(header + 2);
+        header += 4;
+        const uint8_t * peak = shared_tuples + 2U * face->axis_count * (tuple_index & 0x0FFF);
+        const uint8_t * start = NULL;
+        const uint8_t * end = NULL;
+        if(tuple_index & 0x8000) {
+            peak = header;
+            header += 2 * face->axis_count;
+        }
+        if(tuple_index & 0x4000) {
+            start = header;
+            end = header + 2 * face->axis_count;
+            header += 4 * face->axis_count;
+        }
+        const uint8_t * data = serialized;
+        serialized += data_size;
+
+        float scalar = tuple_scalar(f, peak, start, end);
+        if(scalar == 0.0f) continue;
+
+        uint16_t count = shared_count;
+        bool all = shared_all;
+        const uint16_t * list = slist;
+        if(tuple_index & 0x2000) {
+            data = read_point_numbers(data, vlist, n, &count, &all);
+            list = vlist;
+        }
+        if(all) count = n;
+        data = read_deltas(data, vdx, count, n);
+        read_deltas(data, vdy, count, n);
+        /* A list longer than the glyph (malformed font) only contributes its first n points */
+        if(count > n) count = n;
+
+        if(all) {
+            for(uint16_t i = 0; i < n; i++) {
+                p[i].x += scalar * vdx[i];
+                p[i].y += scalar * vdy[i];
+            }
+            continue;
+        }
+
+        memset(touched, 0, n);
+        memset(tdx, 0, n * sizeof(float));
+        memset(tdy, 0, n * sizeof(float));
+        for(uint16_t i = 0; i < count; i++) {
+            if(list[i] >= n) continue;
+            touched[list[i]] = 1;
+            tdx[list[i]] = vdx[i];
+            tdy[list[i]] = vdy[i];
+        }
+        uint16_t first = 0;
+        for(uint16_t c = 0; c < contours; c++) {
+            interpolate_untouched(first, contour_ends[c]);
+            first = (uint16_t)(contour_ends[c] + 1);
+        }
+        for(uint16_t i = 0; i < n; i++) {
+            p[i].x += scalar * tdx[i];
+            p[i].y += scalar * tdy[i];
+        }
+    }
+}
+
+/*
+ * Outline loading
+ */
+
+/**
+ * Append the outline of a glyph, transformed by m, to the scratch outline
+ * @param m affine transform in font units: x' = m0*x + m2*y + m4, y' = m1*x + m3*y + m5
+ * @param adv receives the (varied) advance width in font units, may be NULL
+ */
+static bool load_glyph(const ttf_font_dsc_t * f, uint16_t gid, const float m[6], int depth, float * adv)
+{
+    const ttf_face_t * face = &f->face;
+    if(gid >= face->num_glyphs || depth > TTF_MAX_DEPTH) return false;
+
+    uint16_t adv_w;
+    int16_t lsb;
+    glyph_metrics(face, gid, &adv_w, &lsb);
+
+    uint32_t start;
+    uint32_t end;
+    glyph_range(face, gid, &start, &end);
+    if(end <= start) {
+        /* Empty glyph (e.g. space): only the advance can vary */
+        ttf_point_t phantom[4] = {{0, 0, 0}, {(float)adv_w, 0, 0}, {0, 0, 0}, {0, 0, 0}};
+        apply_variations(f, gid, phantom, 4, NULL, 0);
+        if(adv) *adv = phantom[1].x - phantom[0].x;
+        return true;
+    }
+
+    const uint8_t * g = face->data + start;
+    int16_t contours = rds16(g);
+    float x_min = rds16(g + 2);
+    ttf_point_t phantom[4] = {{x_min - lsb, 0, 0}, {x_min - lsb + adv_w, 0, 0}, {0, 0, 0}, {0, 0, 0}};
+
+    if(contours >= 0) {
+        const uint8_t * p = g + 10;
+        uint16_t base = n_pts;
+        uint16_t count = contours ? (uint16_t)(rd16(p + 2 * (contours - 1)) + 1) : 0;
+        uint32_t need = (uint32_t)base + count + 4;
+        if(!grow16((void **)&pts, &pts_cap, need, sizeof(ttf_point_t))) return false;
+        if(!grow16((void **)&ends, &ends_cap, (uint32_t)n_ends + contours, sizeof(uint16_t))) return false;
+
+        for(int16_t c = 0; c < contours; c++) ends[n_ends + c] = rd16(p + 2 * c);
+        p += 2 * contours;
+        p += 2 + rd16(p);   /* skip instructions */
+
+        /* Flags, then x and y coordinates */
+        const uint8_t * flags = p;
+        uint16_t i = 0;
+        while(i < count) {
+            uint8_t flag = *p++;
+            uint8_t repeat = (flag & FLAG_REPEAT) ? *p++ : 0;
+            for(uint16_t r = 0; r <= repeat && i < count; r++) pts[base + i++].on = flag & FLAG_ON_CURVE;
+        }
+        const uint8_t * xs = p;
+        int32_t x = 0;
+        uint16_t fi = 0;
+        for(i = 0; i < count;) {
+            uint8_t flag = flags[fi++];
+            uint8_t repeat = (flag & FLAG_REPEAT) ? flags[fi++] : 0;
+            for(uint16_t r = 0; r <= repeat && i < count; r++, i++) {
+                if(flag & FLAG_X_SHORT) x += (flag & FLAG_X_SAME) ? *xs++ : -(int32_t)*xs++;
+                else if(!(flag & FLAG_X_SAME)) {
+                    x += rds16(xs);
+                    xs += 2;
+                }
+                pts[base + i].x = (float)x;
+            }
+        }
+        const uint8_t * ys = xs;
+        int32_t y = 0;
+        fi = 0;
+        for(i = 0; i < count;) {
+            uint8_t flag = flags[fi++];
+            uint8_t repeat = (flag & FLAG_REPEAT) ? flags[fi++] : 0;
+            for(uint16_t r = 0; r <= repeat && i < count; r++, i++) {
+                if(flag & FLAG_Y_SHORT) y += (flag & FLAG_Y_SAME) ? *ys++ : -(int32_t)*ys++;
+                else if(!(flag & FLAG_Y_SAME)) {
+                    y += rds16(ys);
+                    ys += 2;
+                }
+                pts[base + i].y = (float)y;
+            }
+        }
+
+        /* Vary the outline together with the phantom points, then transform in place */
+        memcpy(&pts[base + count], phantom, sizeof(phantom));
+        apply_variations(f, gid, &pts[base], (uint16_t)(count + 4), &ends[n_ends], (uint16_t)contours);
+        if(adv) *adv = pts[base + count + 1].x - pts[base + count].x;
+
+        for(i = 0; i < count; i++) {
+            ttf_point_t * pt = &pts[base + i];
+            float px = pt->x;
+            pt->x = m[0] * px + m[2] * pt->y + m[4];
+            pt->y = m[1] * px + m[3] * pt->y + m[5];
+        }
+        for(int16_t c = 0; c < contours; c++) ends[n_ends + c] = (uint16_t)(ends[n_ends + c] + base);
+        n_ends = (uint16_t)(n_ends + contours);
+        n_pts = (uint16_t)(base + count);
+        return true;
+    }
+
+    /* Composite glyph: collect components, vary their offsets, then load each */
+    uint16_t comp_gid[TTF_MAX_COMPONENTS];
+    float comp_m[TTF_MAX_COMPONENTS][4];
+    ttf_point_t comp_ofs[TTF_MAX_COMPONENTS + 4];
+    uint16_t n_comp = 0;
+    const uint8_t * p = g + 10;
+    uint16_t flags;
+    do {
+        flags = rd16(p);
+        uint16_t child = rd16(p + 2);
+        p += 4;
+        float dx;
+        float dy;
+        if(flags & COMP_ARG_WORDS) {
+            dx = rds16(p);
+            dy = rds16(p + 2);
+            p += 4;
+        } else {
+            dx = (int8_t)p[0];
+            dy = (int8_t)p[1];
+            p += 2;
+        }
+        float a = 1.0f, b = 0.0f, c = 0.0f, d = 1.0f;
+        if(flags & COMP_SCALE) {
+            a = d = f2dot14(p);
+            p += 2;
+        } else if(flags & COMP_XY_SCALE) {
+            a = f2dot14(p);
+            d = f2dot14(p + 2);
+            p += 4;
+        } else if(flags & COMP_2X2) {
+            a = f2dot14(p);
+            b = f2dot14(p + 2);
+            c = f2dot14(p + 4);
+            d = f2dot14(p + 6);
+            p += 8;
+        }
+        if(n_comp >= TTF_MAX_COMPONENTS) break;
+        comp_gid[n_comp] = child;
+        comp_m[n_comp][0] = a;
+        comp_m[n_comp][1] = b;
+        comp_m[n_comp][2] = c;
+        comp_m[n_comp][3] = d;
+        /* Point-matched anchoring is not supported, such components are placed at the origin */
+        comp_ofs[n_comp].x = (flags & COMP_ARGS_XY) ? dx : 0.0f;
+        comp_ofs[n_comp].y = (flags & COMP_ARGS_XY) ? dy : 0.0f;
+        comp_ofs[n_comp].on = 1;
+        n_comp++;
+    } while(flags & COMP_MORE);
+
+    memcpy(&comp_ofs[n_comp], phantom, sizeof(phantom));
+    apply_variations(f, gid, comp_ofs, (uint16_t)(n_comp + 4), NULL, 0);
+    if(adv) *adv = comp_ofs[n_comp + 1].x - comp_ofs[n_comp].x;
+
+    for(uint16_t i = 0; i < n_comp; i++) {
+        const float * cm = comp_m[i];
+        float child_m[6] = {
+            m[0] * cm[0] + m[2] * cm[1],
+            m[1] * cm[0] + m[3] * cm[1],
+            m[0] * cm[2] + m[2] * cm[3],
+            m[1] * cm[2] + m[3] * cm[3],
+            m[0] * comp_ofs[i].x + m[2] * comp_ofs[i].y + m[4],
+            m[1] * comp_ofs[i].x + m[3] * comp_ofs[i].y + m[5],
+        };
+        if(!load_glyph(f, comp_gid[i], child_m, depth + 1, NULL)) return false;
+    }
+    return true;
+}
+
+/*
+ * Rasterizer
+ */
+
+static void raster_line(float * a, int32_t stride, int32_t h, float x0, float y0, float x1, float y1)
+{
+    if(fabsf(y0 - y1) <= 1e-6f) return;
+    float dir = 1.0f;
+    if(y0 > y1) {
+        float t = x0; x0 = x1; x1 = t;
+        t = y0; y0 = y1; y1 = t;
+        dir = -1.0f;
+    }
+    float dxdy = (x1 - x0) / (y1 - y0);
+    float x = x0;
+    if(y0 < 0.0f) {
+        x -= y0 * dxdy;
+        y0 = 0.0f;
+    }
+    int32_t y_end = (int32_t)ceilf(y1);
+    if(y_end > h) y_end = h;
+
+    for(int32_t y = (int32_t)y0; y < y_end; y++) {
+        float * row = a + y * stride;
+        float dy = fminf((float)(y + 1), y1) - fmaxf((float)y, y0);
+        float x_next = x + dxdy * dy;
+        float d = dy * dir;
+        float xa = x < x_next ? x : x_next;
+        float xb = x < x_next ? x_next : x;
+        float xa_floor = floorf(xa);
+        int32_t xai = (int32_t)xa_floor;
+        float xb_ceil = ceilf(xb);
+        int32_t xbi = (int32_t)xb_ceil;
+        if(xai < 0) xai = 0;
+
+        if(xbi <= xai + 1) {
+            float xmf = 0.5f * (x + x_next) - xa_floor;
+            row[xai] += d - d * xmf;
+            row[xai + 1] += d * xmf;
+        } else {
+            float s = 1.0f / (xb - xa);
+            float xaf = xa - xa_floor;
+            float a0 = 0.5f * s * (1.0f - xaf) * (1.0f - xaf);
+            float xbf = xb - xb_ceil + 1.0f;
+            float am = 0.5f * s * xbf * xbf;
+            row[xai] += d * a0;
+            if(xbi == xai + 2) {
+                row[xai + 1] += d * (1.0f - a0 - am);
+            } else {
+                float a1 = s * (1.5f - xaf);
+                row[xai + 1] += d * (a1 - a0);
+                for(int32_t xi = xai + 2; xi < xbi - 1; xi++) row[xi] += d * s;
+                float a2 = a1 + (float)(xbi - xai - 3) * s;
+                row[xbi - 1] += d * (1.0f - a2 - am);
+            }
+            row[xbi] += d * am;
+        }
+        x = x_next;
+    }
+}
+
+static void raster_quad(float * a, int32_t stride, int32_t h, const ttf_point_t * p0, const ttf_point_t * p1, const ttf_point_t * p2)
+{
+    float dev_x = p0->x - 2.0f * p1->x + p2->x;
+    float dev_y = p0->y - 2.0f * p1->y + p2->y;
+    float dev_sq = dev_x * dev_x + dev_y * dev_y;
+    if(dev_sq < 0.333f) {
+        raster_line(a, stride, h, p0->x, p0->y, p2->x, p2->y);
+        return;
+    }
+    int32_t n = 1 + (int32_t)floorf(sqrtf(sqrtf(3.0f * dev_sq)));
+    float px = p0->x;
+    float py = p0->y;
+    for(int32_t i = 1; i <= n; i++) {
+        float t = (float)i / (float)n;
+        float mt = 1.0f - t;
+        float qx = mt * mt * p0->x + 2.0f * mt * t * p1->x + t * t * p2->x;
+        float qy = mt * mt * p0->y + 2.0f * mt * t * p1->y + t * t * p2->y;
+        raster_line(a, stride, h, px, py, qx, qy);
+        px = qx;
+        py = qy;
+    }
+}
+
+static void raster_contour(float * a, int32_t stride, int32_t h, uint16_t first, uint16_t last)
+{
+    uint16_t n = (uint16_t)(last - first + 1);
+    if(n < 2) return;
+
+    uint16_t start_idx = n;
+    for(uint16_t i = 0; i < n; i++) {
+        if(pts[first + i].on) {
+            start_idx = i;
+            break;
+        }
+    }
+
+    ttf_point_t start;
+    uint16_t k0;
+    if(start_idx < n) {
+        start = pts[first + start_idx];
+        k0 = 1;
+    } else {
+        /* All points off-curve: start on the implied point between the last and the first */
+        start.x = 0.5f * (pts[last].x + pts[first].x);
+        start.y = 0.5f * (pts[last].y + pts[first].y);
+        start.on = 1;
+        start_idx = 0;
+        k0 = 0;
+    }
+
+    ttf_point_t cur = start;
+    ttf_point_t ctrl = start;
+    bool has_ctrl = false;
+    for(uint16_t k = k0; k < n; k++) {
+        const ttf_point_t * pt = &pts[first + (start_idx + k) % n];
+        if(pt->on) {
+            if(has_ctrl) raster_quad(a, stride, h, &cur, &ctrl, pt);
+            else raster_line(a, stride, h, cur.x, cur.y, pt->x, pt->y);
+            cur = *pt;
+            has_ctrl = false;
+        } else if(has_ctrl) {
+            ttf_point_t mid = {0.5f * (ctrl.x + pt->x), 0.5f * (ctrl.y + pt->y), 1};
+            raster_quad(a, stride, h, &cur, &ctrl, &mid);
+            cur = mid;
+            ctrl = *pt;
+        } else {
+            ctrl = *pt;
+            has_ctrl = true;
+        }
+    }
+    if(has_ctrl) raster_quad(a, stride, h, &cur, &ctrl, &start);
+    else raster_line(a, stride, h, cur.x, cur.y, start.x, start.y);
+}
+
+/*
+ * Glyph cache
+ */
+
+static inline uint32_t bucket_of(uint8_t font_id, uint32_t letter)
+{
+    return (letter * 2654435761U ^ font_id) & (TTF_CACHE_BUCKETS - 1);
+}
+
+static void lru_unlink(ttf_glyph_t * g)
+{
+    if(g->lru_prev) g->lru_prev->lru_next = g->lru_next;
+    else lru_head = g->lru_next;
+    if(g->lru_next) g->lru_next->lru_prev = g->lru_prev;
+    else lru_tail = g->lru_prev;
+}
+
+static void lru_push_front(ttf_glyph_t * g)
+{
+    g->lru_prev = NULL;
+    g->lru_next = lru_head;
+    if(lru_head) lru_head->lru_prev = g;
+    lru_head = g;
+    if(lru_tail == NULL) lru_tail = g;
+}
+
+static void cache_remove(ttf_glyph_t * g)
+{
+    ttf_glyph_t ** link = &buckets[bucket_of(g->font_id, g->letter)];
+    while(*link && *link != g) link = &(*link)->hash_next;
+    if(*link) *link = g->hash_next;
+    lru_unlink(g);
+    if(last_glyph == g) last_glyph = NULL;
+    stats.cache_bytes -= g->size;
+    stats.glyphs--;
+    free(g);
+}
+
+static void cache_trim(uint32_t incoming, const ttf_glyph_t * keep)
+{
+    while(lru_tail && stats.cache_bytes + incoming > stats.cache_budget) {
+        ttf_glyph_t * victim = lru_tail;
+        if(victim == keep) break;
+        cache_remove(victim);
+        stats.evictions++;
+    }
+}
+
+static ttf_glyph_t * cache_find(uint8_t font_id, uint32_t letter)
+{
+    if(last_glyph && last_glyph->letter == letter && last_glyph->font_id == font_id) return last_glyph;
+    for(ttf_glyph_t * g = buckets[bucket_of(font_id, letter)]; g; g = g->hash_next) {
+        if(g->letter == letter && g->font_id == font_id) {
+            if(g != lru_head) {
+                lru_unlink(g);
+                lru_push_front(g);
+            }
+            last_glyph = g;
+            return g;
+        }
+    }
+    return NULL;
+}
+
+static ttf_glyph_t * rasterize(const ttf_font_dsc_t * f, uint32_t letter)
+{
+    uint16_t gid = glyph_index(&f->face, letter);
+    if(gid == 0 && letter != ' ') return NULL;
+
+    uint64_t t0 = now_us();
+    static const float identity[6] = {1, 0, 0, 1, 0, 0};
+    float adv = 0;
+    n_pts = 0;
+    n_ends = 0;
+    if(!load_glyph(f, gid, identity, 0, &adv)) return NULL;
+
+    /* Scale to pixels (y down) and find the bitmap box */
+    float min_x = 0, min_y = 0, max_x = 0, max_y = 0;
+    for(uint16_t i = 0; i < n_pts; i++) {
+        pts[i].x *= f->scale;
+        pts[i].y *= -f->scale;
+        if(i == 0 || pts[i].x < min_x) min_x = pts[i].x;
+        if(i == 0 || pts[i].x > max_x) max_x = pts[i].x;
+        if(i == 0 || pts[i].y < min_y) min_y = pts[i].y;
+        if(i == 0 || pts[i].y > max_y) max_y = pts[i].y;
+    }
+    int32_t bx = (int32_t)floorf(min_x);
+    int32_t by = (int32_t)floorf(min_y);
+    int32_t w = n_pts ? (int32_t)ceilf(max_x) - bx : 0;
+    int32_t h = n_pts ? (int32_t)ceilf(max_y) - by : 0;
+    if(w > 255 || h > 255) return NULL;
+
+    uint32_t size = (uint32_t)(w * h);
+    ttf_glyph_t * g = cache_alloc(sizeof(ttf_glyph_t) + size);
+    if(g == NULL) return NULL;
+    g->letter = letter;
+    g->font_id = f->id;
+    g->box_w = (uint8_t)w;
+    g->box_h = (uint8_t)h;
+    g->ofs_x = (int8_t)bx;
+    g->ofs_y = (int8_t)-(by + h);
+    g->adv_w = (uint16_t)(adv * f->scale + 0.5f);
+    g->size = sizeof(ttf_glyph_t) + size;
+
+    if(size) {
+        int32_t stride = w + 2;
+        uint32_t cells = (uint32_t)(stride * (h + 1));
+        if(!grow((void **)&acc, &acc_cap, cells, sizeof(float))) {
+            free(g);
+            return NULL;
+        }
+        memset(acc, 0, cells * sizeof(float));
+        for(uint16_t i = 0; i < n_pts; i++) {
+            pts[i].x -= (float)bx;
+            pts[i].y -= (float)by;
+        }
+        uint16_t first = 0;
+        for(uint16_t c = 0; c < n_ends; c++) {
+            raster_contour(acc, stride, h, first, ends[c]);
+            first = (uint16_t)(ends[c] + 1);
+        }
+        for(int32_t y = 0; y < h; y++) {
+            const float * row = acc + y * stride;
+            uint8_t * out = g->bitmap + y * w;
+            float sum = 0.0f;
+            for(int32_t x = 0; x < w; x++) {
+                sum += row[x];
+                float cov = fabsf(sum);
+                out[x] = cov >= 1.0f ? 255 : (uint8_t)(cov * 255.0f + 0.5f);
+            }
+        }
+    }
+
+    uint32_t elapsed = (uint32_t)(now_us() - t0);
+    stats.raster_count++;
+    stats.raster_us_total += elapsed;
+    if(elapsed > stats.raster_us_max) stats.raster_us_max = elapsed;
+    return g;
+}
+
+static ttf_glyph_t * get_glyph(const lv_font_t * font, uint32_t letter)
+{
+    const ttf_font_dsc_t * f = font->dsc;
+    ttf_glyph_t * g = cache_find(f->id, letter);
+    if(g) {
+        stats.hits++;
+        return g;
+    }
+
+    stats.misses++;
+    g = rasterize(f, letter);
+    if(g == NULL) return NULL;
+
+    cache_trim(g->size, NULL);
+    uint32_t b = bucket_of(g->font_id, letter);
+    g->hash_next = buckets[b];
+    buckets[b] = g;
+    lru_push_front(g);
+    stats.cache_bytes += g->size;
+    stats.glyphs++;
+    last_glyph = g;
+    return g;
+}
+
+/*
+ * LVGL font interface
+ */
+
+static bool ttf_get_glyph_dsc(const lv_font_t * font, lv_font_glyph_dsc_t * dsc_out, uint32_t letter, uint32_t letter_next)
+{
+    (void)letter_next;  /* GPOS kerning is not applied */
+    ttf_glyph_t * g = get_glyph(font, letter);
+    if(g == NULL) return false;
+
+    dsc_out->adv_w = g->adv_w;
+    dsc_out->box_w = g->box_w;
+    dsc_out->box_h = g->box_h;
+    dsc_out->ofs_x = g->ofs_x;
+    dsc_out->ofs_y = g->ofs_y;
+    dsc_out->bpp = 8;
+    return true;
+}
+
+static const uint8_t * ttf_get_glyph_bitmap(const lv_font_t * font, uint32_t letter)
+{
+    ttf_glyph_t * g = get_glyph(font, letter);
+    return g ? g->bitmap : NULL;
+}
+
+lv_font_t * ttf_font_create(const uint8_t * data, size_t size, uint16_t px, uint16_t weight)
+{
+    if(data == NULL || px == 0) return NULL;
+
+    lv_font_t * font = calloc(1, sizeof(lv_font_t));
+    ttf_font_dsc_t * f = calloc(1, sizeof(ttf_font_dsc_t));
+    if(font == NULL || f == NULL || !face_init(&f->face, data, size)) {
+        free(font);
+        free(f);
+        return NULL;
+    }
+
+    f->scale = (float)px / (float)f->face.units_per_em;
+    f->wght = f->face.wght_axis >= 0 ? normalize_weight(&f->face, (float)weight) : 0.0f;
+    f->id = next_font_id++;
+    if(next_font_id == 0) next_font_id = 1;
+
+    font->get_glyph_dsc = ttf_get_glyph_dsc;
+    font->get_glyph_bitmap = ttf_get_glyph_bitmap;
+    font->line_height = (lv_coord_t)ceilf((f->face.ascender - f->face.descender) * f->scale);
+    font->base_line = (lv_coord_t)ceilf(-f->face.descender * f->scale);
+    font->subpx = LV_FONT_SUBPX_NONE;
+    font->underline_position = (int8_t)-(font->base_line / 2);
+    font->underline_thickness = (int8_t)(px / 24 + 1);
+    font->dsc = f;
+    return font;
+}
+
+#ifndef USE_ASSET_PACK
+lv_font_t * ttf_font_montserrat(uint16_t px, uint16_t weight)
+{
+    return ttf_font_create(montserrat_font_data, montserrat_font_data_size, px, weight);
+}
+#endif
+
+void ttf_font_destroy(lv_font_t * font)
+{
+    if(font == NULL) return;
+    ttf_font_dsc_t * f = font->dsc;
+
+    ttf_glyph_t * g = lru_head;
+    while(g) {
+        ttf_glyph_t * next = g->lru_next;
+        if(g->font_id == f->id) cache_remove(g);
+        g = next;
+    }
+    free(f);
+    free(font);
+}
+
+void ttf_font_set_cache_budget(size_t bytes)
+{
+    stats.cache_budget = (uint32_t)bytes;
+    cache_trim(0, NULL);
+}
+
+void ttf_font_get_stats(ttf_font_stats_t * out)
+{
+    *out = stats;
+}
@@ -4,8 +4,12 @@
 // FontAwesome WiFi icon constant
 #define FA_WIFI "\xEF\x87\xAB"  // U+F1EB
 
+#ifdef USE_ASSET_PACK
+#include "asset_pack.h"
+#else
 // Declare FontAwesome font
 LV_FONT_DECLARE(lv_font_fontawesome_16);
+#endif
 
 // Declare Montserrat fonts (16 is ~25% smaller than 22)
 LV_FONT_DECLARE(lv_font_montserrat_16);
@@ -17,6 +21,12 @@ static lv_obj_t *status_label = NULL;
 static lv_task_t *blink_task = NULL;
 static bool icon_visible = true;
 
+// Styles, reset when the screen is destroyed so no style data outlives its arena
+static lv_style_t style_screen;
+static lv_style_t style_transparent;
+static lv_style_t style_icon;
+static lv_style_t style_status;
+
 // Blink task callback
 static void wifi_icon_blink_task(lv_task_t *task)
 {
@@ -35,15 +45,12 @@ static void wifi_icon_blink_task(lv_task_t *task)
     }
 }
 
-void wifi_screen_create(void)
+void wifi_screen_build(lv_obj_t *scr)
 {
-    // Create a full-screen container
-    wifi_screen = lv_obj_create(lv_scr_act(), NULL);
-    lv_obj_set_size(wifi_screen, LV_HOR_RES, LV_VER_RES);
-    lv_obj_set_pos(wifi_screen, 0, 0);
-    
+    wifi_screen = scr;
+    icon_visible = true;
+
     // Set dark gray background
-    static lv_style_t style_screen;
     lv_style_init(&style_screen);
     lv_style_set_bg_color(&style_screen, LV_STATE_DEFAULT, lv_color_hex(0x2A2A2A));
     lv_style_set_border_width(&style_screen, LV_STATE_DEFAULT, 0);
@@ -56,7 +63,6 @@ void wifi_screen_create(void)
     lv_obj_align(content, wifi_screen, LV_ALIGN_CENTER, 0, 0);
     
     // Make container transparent
-    static lv_style_t style_transparent;
     lv_style_init(&style_transparent);
     lv_style_set_bg_opa(&style_transparent, LV_STATE_DEFAULT, LV_OPA_TRANSP);
     lv_style_set_border_width(&style_transparent, LV_STATE_DEFAULT, 0);
@@ -68,9 +74,14 @@ void wifi_screen_create(void)
     lv_label_set_text(wifi_icon, FA_WIFI);  // FontAwesome WiFi icon (U+F1EB)
     
     // Style for WiFi icon (light gray, blinking, with 60px top padding)
-    static lv_style_t style_icon;
     lv_style_init(&style_icon);
+#ifdef USE_ASSET_PACK
+    // never NULL on the device: without a pack only the assets missing screen is shown
+    const lv_font_t *icon_font = asset_pack_font("fontawesome_16", 0, 0);
+    lv_style_set_text_font(&style_icon, LV_STATE_DEFAULT, icon_font ? icon_font : &lv_font_montserrat_16);
+#else
     lv_style_set_text_font(&style_icon, LV_STATE_DEFAULT, &lv_font_fontawesome_16);
+#endif
     lv_style_set_text_color(&style_icon, LV_STATE_DEFAULT, lv_color_hex(0xD0D0D0));
     lv_style_set_pad_top(&style_icon, LV_STATE_DEFAULT, 60);
     lv_obj_add_style(wifi_icon, LV_LABEL_PART_MAIN, &style_icon);
@@ -83,7 +94,6 @@ void wifi_screen_create(void)
     lv_obj_set_width(status_label, LV_HOR_RES - 40);
     
     // Style for status label (very light gray, Montserrat 16 - 25% smaller than 22)
-    static lv_style_t style_status;
     lv_style_init(&style_status);
     lv_style_set_text_color(&style_status, LV_STATE_DEFAULT, lv_color_hex(0xD0D0D0));
     lv_style_set_text_font(&style_status, LV_STATE_DEFAULT, &lv_font_montserrat_16);
@@ -91,24 +101,24 @@ void wifi_screen_create(void)
     
     // Create blink task (500ms interval)
     blink_task = lv_task_create(wifi_icon_blink_task, 500, LV_TASK_PRIO_MID, NULL);
-    
-    // Bring WiFi screen to front
-    lv_obj_move_foreground(wifi_screen);
 }
 
-void wifi_screen_hide(void)
+void wifi_screen_destroy(void)
 {
     if (blink_task != NULL) {
         lv_task_del(blink_task);
         blink_task = NULL;
     }
-    
-    if (wifi_screen != NULL) {
-        lv_obj_del(wifi_screen);
-        wifi_screen = NULL;
-        wifi_icon = NULL;
-        status_label = NULL;
-    }
+
+    // The screen object itself is deleted by the screen manager
+    wifi_screen = NULL;
+    wifi_icon = NULL;
+    status_label = NULL;
+
+    lv_style_reset(&style_screen);
+    lv_style_reset(&style_transparent);
+    lv_style_reset(&style_icon);
+    lv_style_reset(&style_status);
 }
 
 void wifi_screen_update_status(const char* message)
@@ -0,0 +1,241 @@
+#!/usr/bin/env python3
+# Asset pack builder.
+#
+# Packs fonts and images into one binary that is flashed to its own "assets"
+# partition and read at runtime through esp_partition_mmap (simulator: mmap),
+# so assets can be updated without rebuilding or reflashing the firmware.
+#
+# Inputs, optionally prefixed with "name=" (default name is derived from the file):
+#   *.ttf                  TrueType font, rendered at any size by src/ttf_font.c
+#   *.c with uint8_t array TrueType font embedded as a C array (fonts/montserrat_embedded.c)
+#   *.c with lv_font_fmt_txt LVGL bitmap font from lv_font_conv (src/lv_font_fontawesome_16.c)
+#   *.bin                  LVGL image from the image converter (4-byte header + pixel data)
+#
+# Layout (little endian, see include/asset_pack.h):
+#   header  "LPAK", u16 version, u16 count, u32 size, u32 index crc32
+#   index   count x { char name[24], u8 type, u8 reserved[3], u32 offset, u32 size, u32 crc32 }
+#   data    4-byte aligned blobs
+#
+# Standalone:  python support/assetpack.py -o assets.bin fonts/montserrat_embedded.c ...
+# PlatformIO:  pio run -e esp32dev -t buildassets | -t uploadassets (the simulator builds it automatically)
+
+import argparse
+import os
+import re
+import struct
+import sys
+import zlib
+
+MAGIC = b"LPAK"
+VERSION = 1
+HEADER = struct.Struct("<4sHHII")
+ENTRY = struct.Struct("<24sB3xIII")
+NAME_MAX = 23
+
+TYPE_TTF = 1
+TYPE_FONT = 2
+TYPE_IMAGE = 3
+TYPE_NAMES = {TYPE_TTF: "ttf", TYPE_FONT: "font", TYPE_IMAGE: "image"}
+
+# pack_font_t and pack_cmap_t in src/asset_pack.c
+FONT_HEADER = struct.Struct("<HhBBbbHHIII")
+CMAP = struct.Struct("<IHHIIHBx")
+
+CMAP_TYPES = {
+    "LV_FONT_FMT_TXT_CMAP_FORMAT0_FULL": 0,
+    "LV_FONT_FMT_TXT_CMAP_SPARSE_FULL": 1,
+    "LV_FONT_FMT_TXT_CMAP_FORMAT0_TINY": 2,
+    "LV_FONT_FMT_TXT_CMAP_SPARSE_TINY": 3,
+}
+
+ARRAY = re.compile(r"(\w+)\s*\[\]\s*=\s*\{(.*?)\};", re.S)
+NUMBER = re.compile(r"-?(?:0x[0-9a-fA-F]+|\d+)")
+
+def align4(data):
+    return data + b"\0" * (-len(data) % 4)
+
+def numbers(body):
+    body = re.sub(r"/\*.*?\*/", "", body, flags=re.S)
+    return [int(n, 0) for n in NUMBER.findall(body)]
+
+def field(text, name, default=None):
+    m = re.search(r"\.%s\s*=\s*(-?\w+)" % name, text)
+    if not m:
+        return default
+    try:
+        return int(m.group(1), 0)
+    except ValueError:
+        return default
+
+def is_ttf(data):
+    return data[:4] in (b"\0\1\0\0", b"true")
+
+# LVGL bitmap font (lv_font_fmt_txt) from lv_font_conv C output
+def pack_lvgl_font(text, path):
+    arrays = dict(ARRAY.findall(text))
+    bitmap = bytes(numbers(arrays.get("glyph_bitmap", "")))
+
+    glyphs = bytearray()
+    count = 0
+    for m in re.finditer(r"\{\s*\.bitmap_index\s*=.*?\}", arrays.get("glyph_dsc", ""), re.S):
+        g = m.group(0)
+        index, adv = field(g, "bitmap_index"), field(g, "adv_w")
+        if index >= 1 << 20 or adv >= 1 << 12:
+            sys.exit("%s: glyph too large for lv_font_fmt_txt_glyph_dsc_t" % path)
+        # uint32_t bitmap_index:20, adv_w:12; uint8_t box_w, box_h; int8_t ofs_x, ofs_y
+        glyphs += struct.pack("<IBBbb", index | adv << 20, field(g, "box_w"), field(g, "box_h"),
+                              field(g, "ofs_x"), field(g, "ofs_y"))
+        count += 1
+
+    font_dsc = re.search(r"font_dsc\s*=\s*\{(.*?)\};", text, re.S).group(1)
+    if re.search(r"\.kern_dsc\s*=\s*&", font_dsc):
+        print("Warning: %s: kerning is not packed" % path)
+
+    cmap_blocks = re.findall(r"\{\s*\.range_start.*?\}", arrays.get("cmaps", ""), re.S)
+    lists = bytearray()
+    cmaps = []
+    header_size = FONT_HEADER.size + CMAP.size * len(cmap_blocks)
+    glyph_ofs = header_size
+    lists_base = glyph_ofs + len(glyphs)
+    for block in cmap_blocks:
+        kind = re.search(r"\.type\s*=\s*(\w+)", block).group(1)
+        offsets = []
+        for key, elem in (("unicode_list", "<H"), ("glyph_id_ofs_list", "<H" if "SPARSE" in kind else "<B")):
+            m = re.search(r"\.%s\s*=\s*(\w+)" % key, block)
+            if not m or m.group(1) == "NULL":
+                offsets.append(0)
+                continue
+            lists[:] = align4(bytes(lists))
+            offsets.append(lists_base + len(lists))
+            for n in numbers(arrays[m.group(1)]):
+                lists += struct.pack(elem, n)
+        cmaps.append(CMAP.pack(field(block, "range_start"), field(block, "range_length"),
+                               field(block, "glyph_id_start"), offsets[0], offsets[1],
+                               field(block, "list_length"), CMAP_TYPES[kind]))
+
+    lists = align4(bytes(lists))
+    bitmap_ofs = lists_base + len(lists)
+    header = FONT_HEADER.pack(field(text, "line_height"), field(text, "base_line"),
+                              field(font_dsc, "bpp"), field(font_dsc, "bitmap_format", 0),
+                              field(text, "underline_position", 0), field(text, "underline_thickness", 0),
+                              len(cmaps), count, glyph_ofs, FONT_HEADER.size, bitmap_ofs)
+    return header + b"".join(cmaps) + bytes(glyphs) + lists + bitmap
+
+def load_asset(path):
+    with open(path, "rb") as f:
+        data = f.read()
+    if path.endswith(".bin"):
+        return TYPE_IMAGE, data
+    if is_ttf(data):
+        return TYPE_TTF, data
+    if path.endswith(".c"):
+        text = data.decode("utf-8", errors="ignore")
+        if "lv_font_fmt_txt_dsc_t" in text:
+            return TYPE_FONT, pack_lvgl_font(text, path)
+        m = re.search(r"uint8_t\s+\w+\s*\[\]\s*=\s*\{(.*?)\};", text, re.S)
+        if m:
+            blob = bytes(int(b, 16) for b in re.findall(r"0x([0-9A-Fa-f]{2})", m.group(1)))
+            if is_ttf(blob):
+                return TYPE_TTF, blob
+    sys.exit("%s: unsupported asset (TrueType, lv_font_conv C font or LVGL .bin image expected)" % path)
+
+def default_name(path):
+    name = os.path.splitext(os.path.basename(path))[0]
+    name = re.sub(r"^lv_font_", "", name)
+    return re.sub(r"_embedded$", "", name)
+
+def build_pack(specs, output):
+    entries = []
+    for spec in specs:
+        name, sep, path = spec.partition("=")
+        if not sep:
+            name, path = default_name(spec), spec
+        if len(name) > NAME_MAX:
+            sys.exit("%s: asset name longer than %d characters" % (name, NAME_MAX))
+        kind, data = load_asset(path)
+        entries.append((name, kind, data))
+
+    offset = HEADER.size + ENTRY.size * len(entries)
+    index = bytearray()
+    blobs = bytearray()
+    for name, kind, data in entries:
+        index += ENTRY.pack(name.encode(), kind, offset + len(blobs), len(data), zlib.crc32(data))
+        blobs += align4(data)
+    total = offset + len(blobs)
+    pack = HEADER.pack(MAGIC, VERSION, len(entries), total, zlib.crc32(bytes(index))) + index + blobs
+
+    os.makedirs(os.path.dirname(os.path.abspath(output)), exist_ok=True)
+    with open(output, "wb") as f:
+        f.write(pack)
+    print("Asset pack %s: %d bytes" % (output, total))
+    for name, kind, data in entries:
+        print("  %-24s %-5s %8d bytes" % (name, TYPE_NAMES[kind], len(data)))
+    return total
+
+# Offset and size of a partition from a partition table CSV
+def find_partition(csv_path, label):
+    with open(csv_path) as f:
+        for line in f:
+            cols = [c.strip() for c in line.split("#")[0].split(",")]
+            if len(cols) >= 5 and cols[0] == label:
+                return int(cols[3], 0), int(cols[4], 0)
+    return None
+
+def main():
+    parser = argparse.ArgumentParser(description="Build a LilyPi asset pack")
+    parser.add_argument("-o", "--output", default="assets.bin")
+    parser.add_argument("assets", nargs="+", help="[name=]path of a font or image")
+    args = parser.parse_args()
+    build_pack(args.assets, args.output)
+
+try:
+    Import("env")
+except NameError:
+    env = None
+
+if env is None:
+    if __name__ == "__main__":
+        main()
+else:
+    PROJECT_DIR = env.subst("$PROJECT_DIR")
+    PACK = os.path.join(env.subst("$BUILD_DIR"), "assets.bin")
+
+    def sources():
+        return [s if "=" in s else os.path.join(PROJECT_DIR, s)
+                for s in env.GetProjectOption("custom_asset_pack_sources", "").split()]
+
+    def build_assets(*args, **kwargs):
+        build_pack(sources(), PACK)
+
+    def upload_assets(*args, **kwargs):
+        label = env.GetProjectOption("custom_asset_pack_partition", "assets")
+        table = os.path.join(PROJECT_DIR, env.GetProjectOption("board_build.partitions", ""))
+        part = find_partition(table, label) if os.path.exists(table) else None
+        if part is None:
+            sys.exit("Partition '%s' not found in %s" % (label, table))
+        size = build_pack(sources(), PACK)
+        if size > part[1]:
+            sys.exit("Asset pack (%d bytes) does not fit partition '%s' (%d bytes)" % (size, label, part[1]))
+        env.Execute(env.VerboseAction(
+            '"$PYTHONEXE" "$UPLOADER" --chip esp32 --port "$UPLOAD_PORT" --baud $UPLOAD_SPEED '
+            'write_flash 0x%x "%s"' % (part[0], PACK), "Uploading asset pack"))
+
+    # The simulator maps the pack straight from the build directory, rebuilt on every build
+    if env.subst("$PIOPLATFORM") == "native":
+        env.Append(CPPDEFINES=[("ASSET_PACK_FILE", '\\"%s\\"' % PACK.replace("\\", "/"))])
+        build_assets()
+
+    env.AddCustomTarget(
+        name="buildassets",
+        dependencies=None,
+        actions=[build_assets],
+        title="Build assets",
+        description="Pack fonts and images into the asset pack image",
+    )
+    env.AddCustomTarget(
+        name="uploadassets",
+        dependencies=None,
+        actions=[upload_assets],
+        title="Upload assets",
+        description="Write the asset pack to the assets partition",
+    )
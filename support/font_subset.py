@@ -0,0 +1,262 @@
+Import("env")
+import hashlib
+import math
+import os
+import re
+import subprocess
+
+# Glyph-subsetting for the large Montserrat fonts.
+#
+# The full bitmap fonts in fonts/ carry all of 0x20-0x7F plus the degree sign,
+# but at 48 px and above the panel only ever draws numerals. This step scans
+# the UI sources for the text drawn with each large font, regenerates a subset
+# font with lv_font_conv from the Montserrat TTF embedded in
+# fonts/montserrat_embedded.c, and reports flash and glyph-lookup cost against
+# the full font.
+#
+# Options (platformio.ini, per environment):
+#   custom_font_subset_sizes        sizes to subset, e.g. "48 56 64 72 96"
+#   custom_font_subset_sources      directories scanned for UI text (default: src)
+#   custom_font_subset_output       where subset fonts are written (default: src/fonts_subset)
+#   custom_font_subset_extra        glyphs always included (default: digits, sign, point, degree)
+#   custom_font_subset_compress_min smallest size stored compressed (default: 48)
+#
+# lv_font_conv must be the version pinned in package.json, installed in the
+# project with "npm install"; the build never downloads it.
+
+PROJECT_DIR = env.subst("$PROJECT_DIR")
+FONTS_DIR = os.path.join(PROJECT_DIR, "fonts")
+TTF_SOURCE = os.path.join(FONTS_DIR, "montserrat_embedded.c")
+WORK_DIR = os.path.join(env.subst("$PROJECT_WORKSPACE_DIR"), "font_subset")
+LV_FONT_CONV_VERSION = "1.5.2"
+
+# sizeof(lv_font_fmt_txt_glyph_dsc_t) and sizeof(lv_font_fmt_txt_cmap_t) on ESP32
+GLYPH_DSC_SIZE = 8
+CMAP_SIZE = 20
+
+def get_option(name, default):
+    value = env.GetProjectOption(name, default)
+    return value.strip() if value else default
+
+# Decode a C string literal body into text (handles \xNN UTF-8 byte escapes)
+def decode_c_literal(body):
+    raw = bytearray()
+    i = 0
+    while i < len(body):
+        c = body[i]
+        if c == "\\" and i + 1 < len(body):
+            n = body[i + 1]
+            if n == "x":
+                m = re.match(r"[0-9a-fA-F]{1,2}", body[i + 2:])
+                if m is None:
+                    # "\x" without digits is invalid C, keep the x like other unknown escapes
+                    raw.extend(b"x")
+                    i += 2
+                    continue
+                raw.append(int(m.group(0), 16))
+                i += 2 + len(m.group(0))
+                continue
+            if n == "u":
+                raw.extend(chr(int(body[i + 2:i + 6], 16)).encode("utf-8"))
+                i += 6
+                continue
+            raw.extend({"n": b"\n", "t": b"\t", "0": b"\0"}.get(n, n.encode("utf-8")))
+            i += 2
+            continue
+        raw.extend(c.encode("utf-8"))
+        i += 1
+    return raw.decode("utf-8", errors="ignore")
+
+# Characters a printf conversion can produce
+def format_glyphs(spec):
+    conv = spec[-1]
+    if conv in "diu":
+        return "0123456789-"
+    if conv in "fFeEgG":
+        return "0123456789-."
+    if conv in "xX":
+        return "0123456789abcdefABCDEF"
+    return ""
+
+TEXT_CALLS = re.compile(r"\b(?:lv_label_set_text(?:_fmt|_static)?|lv_snprintf|snprintf|sprintf)\s*\(([^;]*)\)\s*;", re.S)
+LITERAL = re.compile(r'"((?:[^"\\]|\\.)*)"')
+FORMAT_SPEC = re.compile(r"%[-+ #0]*\d*(?:\.\d+)?[a-zA-Z]")
+FONT_REF = re.compile(r"\blv_font_montserrat_(\d+)\b")
+
+# Collect the glyphs drawn per font size, keyed by size
+def scan_sources(source_dirs, skip_dir):
+    used = {}
+    for source_dir in source_dirs:
+        for root, _, files in os.walk(source_dir):
+            if os.path.abspath(root).startswith(skip_dir):
+                continue
+            for name in files:
+                if not name.endswith((".c", ".cpp", ".h")) or name.startswith("lv_font_"):
+                    continue
+                with open(os.path.join(root, name), encoding="utf-8", errors="ignore") as f:
+                    text = f.read()
+                sizes = set(int(s) for s in FONT_REF.findall(text))
+                if not sizes:
+                    continue
+                glyphs = set()
+                for call in TEXT_CALLS.finditer(text):
+                    for literal in LITERAL.findall(call.group(1)):
+                        decoded = decode_c_literal(literal)
+                        for spec in FORMAT_SPEC.findall(decoded):
+                            glyphs.update(format_glyphs(spec))
+                        glyphs.update(FORMAT_SPEC.sub("", decoded).replace("%%", "%"))
+                for size in sizes:
+                    used.setdefault(size, set()).update(glyphs)
+    return used
+
+# Recover the TTF from the C array so the subset is built from the same face
+def extract_ttf():
+    ttf_path = os.path.join(WORK_DIR, "Montserrat-VariableFont_wght.ttf")
+    if os.path.exists(ttf_path) and os.path.getmtime(ttf_path) >= os.path.getmtime(TTF_SOURCE):
+        return ttf_path
+    data = bytearray()
+    with open(TTF_SOURCE, encoding="utf-8") as f:
+        in_array = False
+        for line in f:
+            if not in_array:
+                in_array = "montserrat_font_data[]" in line
+                continue
+            if line.startswith("};"):
+                break
+            data.extend(int(b, 16) for b in re.findall(r"0x([0-9A-Fa-f]{2})", line))
+    os.makedirs(WORK_DIR, exist_ok=True)
+    with open(ttf_path, "wb") as f:
+        f.write(data)
+    return ttf_path
+
+# Bitmap bytes, glyph count and cmap list of a generated LVGL font source
+def measure_font(path):
+    with open(path, encoding="utf-8", errors="ignore") as f:
+        text = f.read()
+    bitmap = re.search(r"glyph_bitmap\[\]\s*=\s*\{(.*?)\};", text, re.S)
+    bitmap_bytes = len(re.findall(r"0x[0-9a-fA-F]+", bitmap.group(1))) if bitmap else 0
+    dsc = re.search(r"glyph_dsc\[\]\s*=\s*\{(.*?)\};", text, re.S)
+    glyphs = dsc.group(1).count("{") if dsc else 0
+    cmaps = []
+    for m in re.finditer(r"\.list_length\s*=\s*(\d+),\s*\.type\s*=\s*(\w+)", text):
+        cmaps.append((int(m.group(1)), m.group(2)))
+    unicode_lists = sum(n * 2 for n, _ in cmaps)
+    size = bitmap_bytes + glyphs * GLYPH_DSC_SIZE + len(cmaps) * CMAP_SIZE + unicode_lists
+    return size, glyphs, cmaps
+
+# Worst-case comparisons for lv_font_get_glyph_dsc_fmt_txt: linear over the
+# cmaps, then a binary search inside sparse lists
+def lookup_cost(cmaps):
+    cost = len(cmaps)
+    for length, kind in cmaps:
+        if "SPARSE" in kind and length > 0:
+            cost += int(math.ceil(math.log2(length + 1)))
+    return cost
+
+# A full font only costs flash if the build compiles it: anything under src/
+# or pulled in through build_src_filter
+def linked_in_build(path):
+    rel = os.path.relpath(path, PROJECT_DIR).replace(os.sep, "/")
+    if rel.startswith("src/"):
+        return True
+    src_filter = env.GetProjectOption("build_src_filter", "") or ""
+    return ("+<../%s>" % rel) in src_filter
+
+# The project-local lv_font_conv at the pinned version, or exit the build
+def find_font_conv():
+    tool = os.path.join(PROJECT_DIR, "node_modules", ".bin", "lv_font_conv")
+    if os.name == "nt":
+        tool += ".cmd"
+    if not os.path.exists(tool):
+        print("Error: lv_font_conv %s is required for font subsetting but not installed." % LV_FONT_CONV_VERSION)
+        print("  Run \"npm install\" in %s (installs the version pinned in package.json)." % PROJECT_DIR)
+        env.Exit(1)
+    try:
+        version = subprocess.check_output([tool, "--version"], universal_newlines=True).strip()
+    except (OSError, subprocess.CalledProcessError) as err:
+        print("Error: cannot run %s (%s)" % (tool, err))
+        env.Exit(1)
+    if version != LV_FONT_CONV_VERSION:
+        print("Error: lv_font_conv %s found, %s required. Run \"npm install\" in %s." % (version, LV_FONT_CONV_VERSION, PROJECT_DIR))
+        env.Exit(1)
+    return [tool]
+
+def subset_fonts(*args, **kwargs):
+    sizes = [int(s) for s in get_option("custom_font_subset_sizes", "").split()]
+    if not sizes:
+        return
+    source_dirs = [os.path.join(PROJECT_DIR, d) for d in get_option("custom_font_subset_sources", "src").split()]
+    output_dir = os.path.join(PROJECT_DIR, get_option("custom_font_subset_output", "src/fonts_subset"))
+    extra = get_option("custom_font_subset_extra", "0123456789-.°")
+    compress_min = int(get_option("custom_font_subset_compress_min", "48"))
+
+    used = scan_sources(source_dirs, os.path.abspath(output_dir))
+    font_conv = None
+    saved_total = 0     # flash of linked full fonts minus the subsets replacing them
+
+    print("Font subset report:")
+    for size in sizes:
+        full_path = os.path.join(FONTS_DIR, "lv_font_montserrat_%d.c" % size)
+        full_size, full_glyphs, full_cmaps = measure_font(full_path) if os.path.exists(full_path) else (0, 0, [])
+        full_linked = full_size > 0 and linked_in_build(full_path)
+        out_path = os.path.join(output_dir, "lv_font_montserrat_%d.c" % size)
+
+        if size not in used:
+            if os.path.exists(out_path):
+                os.remove(out_path)
+            if full_linked:
+                print("  %3d px: not referenced by the UI, dropped (%d bytes)" % (size, full_size))
+                saved_total += full_size
+            else:
+                print("  %3d px: not referenced by the UI and not linked" % size)
+            continue
+
+        glyphs = sorted(set(extra) | set(g for g in used[size] if g.isprintable()))
+        symbols = "".join(glyphs)
+        compress = size >= compress_min
+        stamp = hashlib.sha1(("%d|%s|%d" % (size, symbols, compress)).encode("utf-8")).hexdigest()
+
+        stale = True
+        if os.path.exists(out_path):
+            with open(out_path, encoding="utf-8", errors="ignore") as f:
+                stale = ("subset:" + stamp) not in f.read(2048)
+
+        if stale:
+            font_conv = font_conv or find_font_conv()
+            os.makedirs(output_dir, exist_ok=True)
+            cmd = font_conv + [
+                "--font", extract_ttf(), "--size", str(size), "--bpp", "4", "--format", "lvgl",
+                "--symbols", symbols, "--output", out_path, "--force-fast-kern-format",
+                "--lv-include", "lvgl.h", "--lv-font-name", "lv_font_montserrat_%d" % size,
+            ]
+            if not compress:
+                cmd.append("--no-compress")
+            try:
+                subprocess.check_call(cmd)
+            except (OSError, subprocess.CalledProcessError) as err:
+                print("Warning: lv_font_conv failed for %d px (%s), keeping previous fonts" % (size, err))
+                continue
+            with open(out_path, encoding="utf-8") as f:
+                body = f.read()
+            with open(out_path, "w", encoding="utf-8") as f:
+                f.write("/* subset:%s */\n" % stamp + body)
+
+        sub_size, sub_glyphs, sub_cmaps = measure_font(out_path)
+        # the subset under src/ is always compiled; the full font only counts if it was
+        saved_total += (full_size if full_linked else 0) - sub_size
+        print("  %3d px: %d -> %d glyphs, %d -> %d bytes%s%s, lookup %d -> %d comparisons (\"%s\")" % (
+            size, full_glyphs, sub_glyphs, full_size, sub_size, " compressed" if compress else "",
+            "" if full_linked else " (full font not linked)",
+            lookup_cost(full_cmaps), lookup_cost(sub_cmaps), symbols))
+
+    print("  flash saved: %d bytes (negative: the subsets add flash)" % saved_total)
+
+subset_fonts()
+
+env.AddCustomTarget(
+    name="fontsubset",
+    dependencies=None,
+    actions=[subset_fonts],
+    title="Font subset",
+    description="Regenerate subset Montserrat fonts and report flash and lookup cost",
+)